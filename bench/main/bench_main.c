@@ -0,0 +1,365 @@
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <malloc.h>
+#include <sys/ioctl.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "mtos.h"
+
+// Ejecuta un rol (master o slave) sobre el descriptor heredado de tools/mtos_bench.py,
+// que simula el enlace entre ambos procesos. Los parametros llegan por variables de entorno
+// y los resultados se imprimen en stdout como una linea JSON.
+
+#define BENCH_NAME "bench"
+#define BENCH_MAX_LINKS 8
+#define BENCH_MAX_SLAVES 32
+
+static char bench_name[16] = BENCH_NAME; // los nombres de bloque son char[16]
+static char bench_trigger[8] = "bncht";
+static char bench_pattern[8] = "bnchp";
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+static size_t heap_used = 0;
+static size_t heap_peak = 0;
+
+static void bench_heap_add(void* ptr)
+{
+    if (ptr) {
+        size_t used = __atomic_add_fetch(&heap_used,malloc_usable_size(ptr),__ATOMIC_RELAXED);
+        size_t peak = __atomic_load_n(&heap_peak,__ATOMIC_RELAXED);
+        while ((used > peak) && !__atomic_compare_exchange_n(&heap_peak,&peak,used,true,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+    }
+}
+
+static void bench_heap_sub(void* ptr)
+{
+    if (ptr) {
+        __atomic_sub_fetch(&heap_used,malloc_usable_size(ptr),__ATOMIC_RELAXED);
+    }
+}
+
+void* __wrap_malloc(size_t size)
+{
+    void* ptr = __real_malloc(size);
+    bench_heap_add(ptr);
+    return ptr;
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+    void* ptr = __real_calloc(n,size);
+    bench_heap_add(ptr);
+    return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    bench_heap_sub(ptr);
+    void* new_ptr = __real_realloc(ptr,size);
+    if (new_ptr) {
+        bench_heap_add(new_ptr);
+    }
+    else if (size) {
+        bench_heap_add(ptr);
+    }
+    return new_ptr;
+}
+
+void __wrap_free(void* ptr)
+{
+    bench_heap_sub(ptr);
+    __real_free(ptr);
+}
+
+static int bench_write(void* ctx, const void* src, size_t len)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t result = write((int)(intptr_t)ctx,(const uint8_t*)src+done,len-done);
+        if (result > 0) {
+            done += result;
+        }
+        else if ((result < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+            vTaskDelay(1);
+        }
+        else {
+            break;
+        }
+    }
+    return done;
+}
+
+static int bench_read(void* ctx, void* dst, size_t len)
+{
+    ssize_t result = read((int)(intptr_t)ctx,dst,len);
+    return (result > 0 ? result : 0);
+}
+
+static size_t bench_buffered(void* ctx)
+{
+    int len = 0;
+    ioctl((int)(intptr_t)ctx,FIONREAD,&len);
+    return (len > 0 ? len : 0);
+}
+
+static unsigned long bench_env(const char* name, unsigned long def)
+{
+    const char* value = getenv(name);
+    return (value ? strtoul(value,NULL,0) : def);
+}
+
+// MTOS_BENCH_ZERO_RUN: el bloque tiene un 0x00 en el offset 58 y despues solo bytes distintos de cero; en la
+// trama del primer chunk (>= 313 bytes) el grupo COBS que sigue al 0x00 se cierra justo al final del buffer del emisor
+static void bench_fill(uint8_t* ptr, size_t length)
+{
+    bool zero_run = bench_env("MTOS_BENCH_ZERO_RUN",0);
+    for (size_t i = 0; i < length; i++) {
+        ptr[i] = (zero_run ? (i == 58 ? 0 : (uint8_t)(i%255+1)) : (uint8_t)(i*31+7));
+    }
+}
+
+// MTOS_BENCH_SEGMENTED: ambos roles usan un blob segmentado (CONFIG_MTOS_SEGMENTS), que el slave sirve
+// segmento por segmento
+static int bench_new_blob(size_t length, uint8_t slave)
+{
+    if (bench_env("MTOS_BENCH_SEGMENTED",0)) {
+        return mtos_new_segmented_blob(bench_name,length,slave,bench_trigger,bench_pattern);
+    }
+    return mtos_new_blob(bench_name,length,slave,bench_trigger,bench_pattern);
+}
+
+static SemaphoreHandle_t bench_done = NULL;
+static volatile bool bench_in_flight = false;
+static volatile bool bench_updated = false;
+
+static void bench_cb(mtos_event_id_t event_id, void* event_data, void* user_data)
+{
+    switch (event_id) {
+        case MTOS_EVENT_MASTER_CALL: {
+            bench_in_flight = true;
+            bench_updated = false;
+            break;
+        }
+        case MTOS_EVENT_MASTER_UPDATED:
+        case MTOS_EVENT_MASTER_UNCHANGED: {
+            bench_updated = true;
+            break;
+        }
+        case MTOS_EVENT_MASTER_IDLE: {
+            // la maquina de estados del master volvio a esperar llamadas
+            if (bench_in_flight) {
+                bench_in_flight = false;
+                xSemaphoreGive(bench_done);
+            }
+            break;
+        }
+        default: break;
+    }
+}
+
+static void bench_print_stats(mtos_stats_t* stats)
+{
+    printf("\"bytes\":%llu,\"chunks\":%" PRIu32 ",\"crc8_errors\":%" PRIu32 ",\"crc32_errors\":%" PRIu32 ","
+        "\"resends\":%" PRIu32 ",\"timeouts\":%" PRIu32 ",\"unchanged\":%" PRIu32 ",\"rtt_min_us\":%" PRIu32 ","
+        "\"rtt_avg_us\":%" PRIu32 ",\"rtt_max_us\":%" PRIu32 ",\"lock_wait_us\":%llu,\"peak_heap\":%u",
+        (unsigned long long)stats->bytes,stats->chunks,stats->crc8_errors,stats->crc32_errors,
+        stats->resends,stats->timeouts,stats->unchanged,stats->rtt_min_us,stats->rtt_avg_us,stats->rtt_max_us,
+        (unsigned long long)stats->lock_wait_us,(unsigned)__atomic_load_n(&heap_peak,__ATOMIC_RELAXED));
+}
+
+static void bench_master(size_t size, unsigned int chunk, unsigned int calls, unsigned int timeout_ms)
+{
+    uint8_t* expected = (uint8_t*)malloc(size ? size : 1);
+    uint8_t* received = (uint8_t*)malloc(size ? size : 1);
+    uint32_t* latency_us = (uint32_t*)calloc(calls,sizeof(uint32_t));
+    unsigned int ok = 0;
+    unsigned int corrupt = 0;
+    assert(expected && received && latency_us);
+    bench_fill(expected,size);
+    if (bench_new_blob(1,0) != 0) {
+        fprintf(stderr,"could not create the bench block\n");
+        exit(2);
+    }
+    for (unsigned int i = 0; i < calls; i++) {
+        // se altera la copia local para que cada llamada transfiera el bloque completo (un bloque vacio no cambia)
+        mtos_write_at(bench_name,"",0,1);
+        int64_t ini = esp_timer_get_time();
+        mtos_call(bench_name,timeout_ms,chunk);
+        xSemaphoreTake(bench_done,(timeout_ms+1000)/portTICK_PERIOD_MS);
+        latency_us[i] = esp_timer_get_time()-ini;
+        if (bench_updated) {
+            // mtos_read_at tambien recorre un blob segmentado, que no tiene vista contigua
+            if ((mtos_get_length(bench_name) == (int)size) && (mtos_read_at(bench_name,received,0,size) == 0) &&
+                (memcmp(received,expected,size) == 0)) {
+                ok++;
+            }
+            else {
+                corrupt++;
+            }
+        }
+        else {
+            latency_us[i] |= 0x80000000; // llamada fallida
+        }
+    }
+    mtos_stats_t stats = {};
+    mtos_get_stats(bench_name,&stats);
+    printf("{\"role\":\"master\",\"size\":%u,\"chunk\":%u,\"calls\":%u,\"ok\":%u,\"corrupt\":%u,",
+        (unsigned)size,chunk,calls,ok,corrupt);
+    bench_print_stats(&stats);
+    printf(",\"latency_us\":[");
+    for (unsigned int i = 0; i < calls; i++) {
+        if (latency_us[i] & 0x80000000) {
+            printf("%snull",i ? "," : "");
+        }
+        else {
+            printf("%s%" PRIu32,i ? "," : "",latency_us[i]);
+        }
+    }
+    printf("]}\n");
+    fflush(stdout);
+    exit(0);
+}
+
+// bus compartido: un bloque por slave, sondeados por mtos_poll durante duration_ms
+static void bench_bus_master(unsigned int slaves, unsigned int chunk, unsigned int period_ms, unsigned int duration_ms, unsigned int timeout_ms)
+{
+    char names[BENCH_MAX_SLAVES][16] = {};
+    for (unsigned int i = 0; i < slaves; i++) {
+        snprintf(names[i],sizeof(names[i]),BENCH_NAME "%u",i+2);
+        mtos_new_blob(names[i],1,0,bench_trigger,bench_pattern);
+        mtos_set_remote(names[i],i+2);
+    }
+    for (unsigned int i = 0; i < slaves; i++) {
+        mtos_poll(names[i],period_ms,timeout_ms,chunk);
+    }
+    vTaskDelay(duration_ms/portTICK_PERIOD_MS);
+    for (unsigned int i = 0; i < slaves; i++) {
+        mtos_poll(names[i],0,0,0);
+    }
+    // se espera a que termine la llamada en curso
+    vTaskDelay((timeout_ms+100)/portTICK_PERIOD_MS);
+    mtos_stats_t stats = {};
+    mtos_get_link_stats(&stats);
+    printf("{\"role\":\"master\",\"duration_ms\":%u,",duration_ms);
+    bench_print_stats(&stats);
+    printf(",\"slaves\":[");
+    for (unsigned int i = 0; i < slaves; i++) {
+        mtos_get_stats(names[i],&stats);
+        printf("%s{\"address\":%u,\"polls\":%" PRIu32 ",\"timeouts\":%" PRIu32 ",\"unchanged\":%" PRIu32 ","
+            "\"bytes\":%llu,\"resends\":%" PRIu32 ",\"rtt_avg_us\":%" PRIu32 "}",
+            i ? "," : "",i+2,stats.calls,stats.timeouts,stats.unchanged,(unsigned long long)stats.bytes,stats.resends,
+            stats.rtt_avg_us);
+    }
+    printf("]}\n");
+    fflush(stdout);
+    exit(0);
+}
+
+static void bench_slave(size_t size)
+{
+    char command[16] = {};
+    size_t command_len = 0;
+    uint8_t* data = (uint8_t*)malloc(size ? size : 1);
+    assert(data);
+    bench_fill(data,size);
+    if (bench_new_blob(size,1) != 0) {
+        fprintf(stderr,"could not create the bench block\n");
+        exit(2);
+    }
+    mtos_write_at(bench_name,data,0,size);
+    free(data);
+    fcntl(STDIN_FILENO,F_SETFL,fcntl(STDIN_FILENO,F_GETFL)|O_NONBLOCK);
+    printf("{\"role\":\"slave\",\"ready\":true}\n");
+    fflush(stdout);
+    for (;;) {
+        // el orquestador envia "stop" al terminar el master
+        ssize_t result = read(STDIN_FILENO,command+command_len,sizeof(command)-1-command_len);
+        if (result > 0) {
+            command_len += result;
+        }
+        if ((result == 0) || strstr(command,"stop")) {
+            break;
+        }
+        vTaskDelay(50/portTICK_PERIOD_MS);
+    }
+    mtos_stats_t stats = {};
+    mtos_get_stats(bench_name,&stats);
+    printf("{\"role\":\"slave\",\"size\":%u,",(unsigned)size);
+    bench_print_stats(&stats);
+    printf("}\n");
+    fflush(stdout);
+    exit(0);
+}
+
+void app_main(void)
+{
+    const char* role = getenv("MTOS_BENCH_ROLE");
+    const char* fds = getenv("MTOS_BENCH_FD");
+    size_t size = bench_env("MTOS_BENCH_SIZE",16384);
+    if (role == NULL) {
+        fprintf(stderr,"run through tools/mtos_bench.py\n");
+        exit(2);
+    }
+    // MTOS_BENCH_FD puede ser una lista separada por comas, un descriptor por enlace agregado
+    mtos_transport_t links[BENCH_MAX_LINKS];
+    size_t count = 0;
+    char* next = (char*)(fds ? fds : "3");
+    do {
+        int fd = strtol(next,&next,0);
+        fcntl(fd,F_SETFL,fcntl(fd,F_GETFL)|O_NONBLOCK);
+        links[count++] = (mtos_transport_t){
+            .write = bench_write,
+            .read = bench_read,
+            .buffered = bench_buffered,
+            .ctx = (void*)(intptr_t)fd,
+        };
+    } while ((*next++ == ',') && (count < BENCH_MAX_LINKS));
+    bench_done = xSemaphoreCreateBinary();
+    if (count > 1) {
+        if (mtos_set_bonded_transport(links,count) != 0) {
+            fprintf(stderr,"bonded transport not available, enable CONFIG_MTOS_BOND\n");
+            exit(2);
+        }
+    }
+    else {
+        mtos_set_transport(&links[0]);
+    }
+    unsigned int slaves = bench_env("MTOS_BENCH_SLAVES",0);
+    unsigned int address = bench_env("MTOS_BENCH_ADDRESS",0);
+    if ((slaves || address) && (mtos_set_address(address ? address : 1) != 0)) {
+        fprintf(stderr,"bus addressing not available, enable CONFIG_MTOS_BUS\n");
+        exit(2);
+    }
+    mtos_init(bench_cb,NULL);
+    if ((strcmp(role,"master") == 0) && slaves) {
+        bench_bus_master((slaves < BENCH_MAX_SLAVES ? slaves : BENCH_MAX_SLAVES),
+            bench_env("MTOS_BENCH_CHUNK",1024),
+            bench_env("MTOS_BENCH_POLL_MS",100),
+            bench_env("MTOS_BENCH_DURATION_MS",10000),
+            bench_env("MTOS_BENCH_TIMEOUT_MS",10000));
+    }
+    else if (strcmp(role,"master") == 0) {
+        bench_master(size,
+            bench_env("MTOS_BENCH_CHUNK",1024),
+            bench_env("MTOS_BENCH_CALLS",10),
+            bench_env("MTOS_BENCH_TIMEOUT_MS",10000));
+    }
+    else {
+        bench_slave(size);
+    }
+}
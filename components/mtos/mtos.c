@@ -1,16 +1,20 @@
 #define _GNU_SOURCE
 #include <stdbool.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include "esp_log.h"
 #include "esp_event.h"
 #include "esp_event_base.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "esp_rom_crc.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "driver/uart.h"
-#include "esp32/rom/crc.h"
+#endif
 #include "typedefs.h"
 
 
@@ -32,22 +36,27 @@ typedef enum {
     MTOS_MEMMOVE
 } mtos_fnc_idx_t;
 
-//maquina de estados de recepcion de datos por uart
+// operaciones que el master aplica sobre el bloque del slave sin transferirlo
 typedef enum {
-    MTOS_MASTER_ABORT,
-    MTOS_MASTER_IDLE,
-    MTOS_MASTER_INIT,
-    MTOS_MASTER_CHUNK,
-    MTOS_MASTER_ENDING
-} mtos_master_status_t;
+    MTOS_OP_NONE,
+    MTOS_OP_WRITE, // el operando se copia en offset
+    MTOS_OP_APPEND, // el operando se agrega al final, el bloque crece
+    MTOS_OP_MEMSET, // count bytes desde offset con el byte del operando
+    MTOS_OP_STRCPY, // el operando como cadena desde el comienzo, count distinto de 0: strncpy
+    MTOS_OP_STRCAT, // el operando se agrega al final de la cadena
+    MTOS_OP_RESIZE, // el bloque pasa a tener count bytes
+    MTOS_OP_QUERY = 0x10 // MTOS_OP_QUERY+mtos_query_t: consulta que no modifica el bloque, offset y count delimitan los elementos
+} mtos_op_t;
 
-typedef enum {
-    MTOS_SLAVE_ABORT,
-    MTOS_SLAVE_IDLE,
-    MTOS_SLAVE_INIT,
-    MTOS_SLAVE_CHUNK,
-    MTOS_SLAVE_ENDING
-} mtos_slave_status_t;
+// operando de una consulta: |tipo (mtos_elem_type_t)|campo dentro del elemento (uint16_t)|patron|
+#define MTOS_QUERY_HEAD 3
+
+// resultado de una consulta, en la respuesta sigue a la extension con su crc32
+typedef struct __attribute__((packed)) {
+    uint64_t value;
+    uint32_t index;
+    uint32_t count;
+} mtos_query_wire_t;
 
 //union para manejar crc32
 typedef union {
@@ -76,6 +85,61 @@ typedef union {
     uint32_t uint32;
 } mtos_header_t;
 
+// flags que lleva el byte resend de la solicitud de trigger
+#define MTOS_TRIGGER_EXT 0x01 // al header le sigue un mtos_ext_t, la respuesta tambien lo lleva
+
+// flags de la extension, en la respuesta el slave devuelve los que acepto
+#define MTOS_EXT_RESUME 0x01 // offset: bytes del bloque completo que el master ya tiene
+#define MTOS_EXT_RANGE 0x02 // offset y length delimitan la porcion solicitada
+#define MTOS_EXT_UNCHANGED 0x04 // crc32 y length: version de la copia del master, aceptado si el bloque no cambio
+#define MTOS_EXT_FRAMED 0x08 // los chunks y sus solicitudes viajan en tramas delimitadas, se combina con los demas
+#define MTOS_EXT_PUT 0x10 // crc32 y length: bloque que el master envia al slave en lugar de pedirlo
+#define MTOS_EXT_OP 0x20 // operacion remota, a la extension le sigue |operando|crc32|; respuesta: crc32 y length resultantes
+#define MTOS_EXT_SEQ 0x40 // con MTOS_EXT_OP: seq tiene que seguir a la ultima operacion aplicada, un salto se rechaza
+#define MTOS_EXT_MAX 0xFFFFFF // maximo offset/length representable
+#define MTOS_SEQ_NEXT(seq) ((uint16_t)((seq)+1) ? (uint16_t)((seq)+1) : 1) // numero de operacion siguiente, sin el 0
+
+// extension que sigue al header del trigger y de su respuesta
+typedef union {
+    struct __attribute__((packed)) {
+        uint32_t offset:24; // respuesta: offset desde el que se envia
+        uint32_t flags:8;
+        uint32_t crc32; // version del bloque, crc32 de su contenido completo
+        uint32_t length:24; // respuesta: largo del bloque completo
+        uint32_t crc8:8;
+    } session;
+    struct __attribute__((packed)) {
+        uint32_t offset:24; // byte del bloque donde se aplica
+        uint32_t flags:8;
+        uint32_t count:24; // memset y strncpy: bytes del destino
+        uint32_t code:8; // mtos_op_t
+        uint32_t length:8; // bytes del operando
+        uint32_t seq:16; // numero de la operacion, un trigger reenviado no la aplica dos veces
+        uint32_t crc8:8;
+    } op;
+    uint8_t raw[12];
+} mtos_ext_t;
+
+// trama delimitada: |COBS(id del bloque|header|[chunk|crc32])|0x00|, sin bytes en cero antes del delimitador
+#define MTOS_FRAME_HEAD (sizeof(uint16_t)+sizeof(mtos_header_t))
+
+#if CONFIG_MTOS_BUS
+#define MTOS_ADDR_LEN 1 // byte de direccion que se agrega al final del trigger y del pattern
+#define MTOS_ADDR_REMOTE 1 // direccion que llaman los bloques master hasta que se les asigna otra
+#else
+#define MTOS_ADDR_LEN 0
+#endif
+
+// busqueda incremental de un token en un buffer que crece por el final (KMP): cada byte se examina una
+// sola vez aunque llegue de a poco, y una coincidencia parcial sigue valiendo en la proxima lectura
+typedef struct {
+    const char* token; // NULL hasta la primera busqueda
+    uint8_t len;
+    uint8_t fail[8+MTOS_ADDR_LEN]; // largo del prefijo del token que sigue coincidiendo si falla el byte siguiente
+    uint8_t matched; // bytes del token que coinciden con el final de lo examinado
+    size_t scanned; // bytes del buffer ya examinados
+} mtos_scan_t;
+
 //nodo de una lista enlazada que lleva cuenta de bloques de memoria
 //compartidos entre dos equipos, uno local y otro remoto
 typedef struct mtos_node {
@@ -85,13 +149,75 @@ typedef struct mtos_node {
     bool blob;
     uint8_t slave;
     mtos_crc32_t crc32;
-    char trigger[8];
-    char pattern[8];
+    char trigger[8+MTOS_ADDR_LEN+1]; // hasta 8 caracteres, el byte de direccion y el terminador
+    char pattern[8+MTOS_ADDR_LEN+1];
     char name[16];
     SemaphoreHandle_t smphr;
+#if CONFIG_MTOS_STATIC
+    StaticSemaphore_t smphr_buf;
+#endif
+    bool external; // ptr es un buffer de la aplicacion, no se libera ni se realoca
+    size_t capacity; // bytes del buffer de la aplicacion, el largo del bloque no lo supera
+    uint16_t index; // orden de creacion, unico entre todas las instancias
+    size_t str_length; // largo de la cadena guardada en un blob, MTOS_STRLEN_UNKNOWN si hay que medirlo
+    bool crc_stale; // las funciones de cadena difieren el calculo del crc32 hasta que se necesite
+    uint32_t srtt_us; // master: rtt suavizado entre un request y su respuesta, 0 si todavia no hay muestras
+    uint32_t rttvar_us; // master: variacion del rtt, junto a srtt_us da la espera antes de retransmitir
+    unsigned int poll_period_ms; // periodo de mtos_poll, 0 si el bloque no se sondea
+    unsigned int poll_timeout_ms;
+    unsigned int poll_max_chunk_size;
+    uint32_t poll_due; // proximo sondeo, en milisegundos
+    uint64_t poll_vtime_us; // tiempo de bus consumido por los sondeos del bloque, reparte el bus entre los atrasados
+    unsigned int poll_coalesce_ms; // mtos_watch: se llama antes de tiempo si otro bloque vigilado esta por llamarse
+    unsigned int poll_backoff; // multiplo del periodo aplicado mientras el enlace esta saturado
+    unsigned int poll_max_backoff; // 1 en los sondeos de mtos_poll, no se espacian
+    bool call_timed_out; // la ultima llamada al bloque vencio sin completarse
+    bool legacy; // master: el slave respondio el trigger sin extension, las llamadas comunes empiezan con ese formato
+    uint16_t op_seq; // master: ultima operacion remota enviada, slave: ultima aplicada
+    uint32_t op_crc; // slave: crc32 que dejo la ultima operacion aplicada
+#if CONFIG_MTOS_REPLICATE
+    bool repl; // master: las modificaciones locales se replican en el slave
+    bool repl_queued; // hay una replicacion en la cola o en curso, las modificaciones siguientes se suman a ella
+    bool repl_more; // la replicacion en curso termino una parte y el reactor tiene que seguir con la proxima
+    bool repl_full; // la proxima parte envia el bloque completo con un put
+    size_t repl_lo; // bytes modificados desde la ultima parte enviada, [repl_lo, repl_hi)
+    size_t repl_hi;
+    size_t repl_length; // largo del bloque del slave segun lo ya replicado
+    unsigned int repl_timeout_ms;
+    unsigned int repl_max_chunk_size;
+#endif
+#if CONFIG_MTOS_SLAVE_SNAPSHOT
+    void* volatile snap; // slave: buffer que la sesion en curso envia sin el semaforo, NULL si no hay ninguna
+#endif
+#if CONFIG_MTOS_BUS
+    uint8_t address; // slave: direccion propia, master: direccion del slave que sirve el bloque
+#endif
+    mtos_instance_t* inst; // instancia que sirve o llama el bloque
+    mtos_scan_t trigger_scan; // slave: busqueda del trigger en el buffer del slave
+    uint16_t channel; // id del bloque en las tramas delimitadas, crc16 del pattern
+#if CONFIG_MTOS_TRACE
+    int64_t lock_ts; // instante en que se tomo el semaforo
+#endif
+#if CONFIG_MTOS_STATS
+    mtos_stats_t stats;
+#endif
+#if CONFIG_MTOS_RESUME
+    uint8_t* partial; // acumulador de una transferencia interrumpida
+    size_t partial_count; // bytes validos en partial
+    size_t partial_length; // longitud del bloque remoto
+    uint32_t partial_crc; // version del bloque remoto
+#endif
+#if CONFIG_MTOS_SEGMENTS
+    bool segmented; // blob guardado en segmentos de CONFIG_MTOS_SEGMENT_SIZE bytes, ptr queda en NULL
+    uint8_t** segs; // tabla de segmentos
+    size_t seg_count; // segmentos alocados
+    size_t seg_cap; // capacidad de la tabla
+#endif
     struct mtos_node* next;
 } mtos_list_t; //<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<REALIZAR VERSION I2C CON ASISTENCIA
 
+#define MTOS_STRLEN_UNKNOWN SIZE_MAX
+
 // receptor de chunk
 typedef struct {
     uint8_t* chunk;
@@ -99,1211 +225,4670 @@ typedef struct {
     mtos_crc32_t crc32;
 } mtos_chunk_vessel_t;
 
-// receptor de chunk
+// solicitud que se encola para el master
 typedef struct {
-    void* buffer;
-    size_t* rx_bytes;
-    void* header;
-    TaskHandle_t th;
-} mtos_uart_vessel_t;
+    mtos_list_t* node;
+    size_t offset; // primer byte solicitado
+    size_t length; // bytes solicitados, 0 para el bloque completo
+    unsigned int timeout_ms;
+    unsigned int max_chunk_size;
+    TaskHandle_t notify; // tarea que se notifica al terminar la llamada
+    bool put; // el bloque local se envia al slave en lugar de pedirlo
+    uint8_t op; // operacion remota (mtos_op_t), se aplica en offset
+    size_t op_count;
+    uint16_t op_seq;
+    size_t op_length;
+    uint8_t operand[CONFIG_MTOS_REMOTE_OP_MAX];
+    bool repl; // replicacion de las modificaciones locales, la operacion se arma al salir de la cola
+} mtos_call_t;
+
+// llamada al bloque completo, la unica que se puede hacer con el trigger sin extension
+#define MTOS_CALL_PLAIN(call) (!(call)->put && !(call)->op && !(call)->length && !(call)->repl)
+
+// todo el estado de un enlace, cada instancia atiende a un equipo remoto con sus propias tareas
+struct mtos_instance {
+    mtos_list_t* list_head; // registro de bloques
+    mtos_transport_t transport;
+    bool transport_custom;
+    QueueHandle_t call_queue;
+    esp_event_loop_handle_t loop_handle;
+    mtos_event_handler_t usr_cb;
+    void* usr_data;
+    int slave_timeout;
+    volatile uint32_t uart_rx_ts; // ultima vez que el reactor vio llegar bytes
+    uint32_t master_to; // ultima actividad del master, para su timeout
+    uint32_t slave_to; // ultima actividad del slave, para su timeout
+    TaskHandle_t reactor_th; // unica tarea que atiende el transporte
+    volatile mtos_trace_task_t role; // maquina que esta ejecutando el reactor
+    TaskHandle_t poll_th;
+    volatile bool repl_more; // algun bloque tiene pendiente la proxima parte de su replicacion
+#if CONFIG_MTOS_BUS
+    uint8_t address; // direccion de los bloques slave
+#endif
+#if CONFIG_MTOS_STATIC
+    struct mtos_storage* storage; // colas, pilas y buffers de la instancia
+#endif
+    struct mtos_instance* next;
+};
 
 static const char *TAG = "mtos";
 
-static mtos_list_t* mtos_list_head = NULL;
+// la instancia por defecto usa el puerto de menuconfig, es la de mtos_init y de las funciones sin instancia
+static mtos_instance_t mtos_default;
+static mtos_instance_t* mtos_instances = &mtos_default;
 
+// los nombres son unicos entre todas las instancias, las funciones por nombre no necesitan la instancia
 static mtos_list_t* mtos_lookup(char name[16])
 {
-    mtos_list_t* retval = mtos_list_head;
-    while (retval != NULL) {
-        if (strcmp(retval->name, name) == 0) {
-            break;
+    mtos_list_t* retval = NULL;
+    for (mtos_instance_t* inst = mtos_instances; (inst != NULL) && (retval == NULL); inst = inst->next) {
+        retval = inst->list_head;
+        while (retval != NULL) {
+            if (strcmp(retval->name, name) == 0) {
+                break;
+            }
+            retval = retval->next;
         }
-        retval = retval->next;
     }
     return retval;
 }
 
-static void* mtos_strlib_wrap(char name[16], void *src, size_t n, mtos_fnc_idx_t fnc)
+#if CONFIG_MTOS_BUS
+
+// en un bus el trigger y el pattern terminan con la direccion del slave que sirve el bloque,
+// asi cada trama queda dirigida a un solo equipo y el resto no encuentra sus tokens
+static void mtos_node_address(mtos_list_t* node, uint8_t address)
 {
-    char *TAG = "mtos_strlib";
-    mtos_list_t* node = mtos_lookup(name);
-    if (node != NULL) {
-        void* dest = node->ptr;
-        void* retval = NULL;
-        bool changed = false;
-        xSemaphoreTake(node->smphr, portMAX_DELAY);
-        ESP_LOGI(TAG,"%s's semaphore taken",node->name);
-        switch (fnc) {
-            case MTOS_STRCAT:
-                ESP_LOGI(TAG,"MTOS_STRCAT");
-                retval = strcat((char*)dest, (const char*)src);
-                changed = true;
-                break;
-                // char * strcat ( char * destination, const char * source );
-            case MTOS_STRCHR:
-                ESP_LOGI(TAG,"MTOS_STRCHR");
-                retval = strchr((const char*)dest, *(const char*)src);
-                break;
-                // const char * strchr ( const char * str, int character );
-            case MTOS_STRCMP:
-                ESP_LOGI(TAG,"MTOS_STRCMP");
-                retval = (void*)strcmp((const char*)dest, (const char*)src);
-                break;
-                // int strcmp ( const char * str1, const char * str2 );
-            case MTOS_STRCPY:
-                ESP_LOGI(TAG,"MTOS_STRCPY");
-                retval = strcpy((char*)dest, (const char*)src);
-                changed = true;
-                break;
-                // char * strcpy ( char * destination, const char * source );
-            case MTOS_STRLEN:
-                ESP_LOGI(TAG,"MTOS_STRLEN");
-                retval = (void*)strlen((const char*)src);
-                break;
-                // size_t strlen ( const char * str );
-            case MTOS_STRNCAT:
-                ESP_LOGI(TAG,"MTOS_STRNCAT");
-                retval = strncat((char*)dest, (const char*)src, n);
-                changed = true;
-                break;
-                // char * strncat ( char * destination, const char * source, size_t num );
-            case MTOS_STRNCMP:
-                ESP_LOGI(TAG,"MTOS_STRNCMP");
-                retval = (void*)strncmp((const char*)dest, (const char*)src, n);
-                break;
-                // int strncmp ( const char * str1, const char * str2, size_t num );
-            case MTOS_STRNCPY:
-                ESP_LOGI(TAG,"MTOS_STRNCPY");
-                retval = strncpy((char*)dest, (const char*)src, n);
-                changed = true;
-                break;
-                // char * strncpy ( char * destination, const char * source, size_t num );
-            case MTOS_STRPBRK:
-                ESP_LOGI(TAG,"MTOS_STRPBRK");
-                retval = strpbrk((const char*)dest, (const char*)src);
-                break;
-                // const char * strpbrk ( const char * str1, const char * str2 );
-            case MTOS_STRRCHR:
-                ESP_LOGI(TAG,"MTOS_STRPBRK");
-                retval = strrchr((const char*)dest, *(const char*)src);
-                break;
-                // const char * strrchr ( const char * str, int character );
-            case MTOS_STRSTR:
-                retval = strstr((const char*)dest, (const char*)src);
-                break;
-                // const char * strstr ( const char * str1, const char * str2 );
-            case MTOS_STRTOK:
-                ESP_LOGI(TAG,"MTOS_STRTOK");
-                retval = strtok((char*)dest, (const char*)src);
-                changed = true;
-                break;
-                // char * strtok ( char * str, const char * delimiters );
-            case MTOS_MEMSET:
-                ESP_LOGI(TAG,"MTOS_MEMSET");
-                retval = memset(dest, *(int*)src, n);
-                changed = true;
-                break;
-                //void * memset ( void * ptr, int value, size_t num );
-            case MTOS_MEMCPY:
-                ESP_LOGI(TAG,"MTOS_MEMCPY");
-                retval = memcpy(dest, src, n);
-                break;
-                // void * memcpy ( void * destination, const void * source, size_t num );
-            case MTOS_MEMMOVE:
-                ESP_LOGI(TAG,"MTOS_MEMMOVE");
-                retval = memmove(dest, src, n);
-                break;
-                //void * memmove ( void * destination, const void * source, size_t num );
+    size_t len = strlen(node->trigger)-(node->address ? MTOS_ADDR_LEN : 0);
+    node->trigger[len] = address;
+    node->trigger[len+1] = '\0';
+    len = strlen(node->pattern)-(node->address ? MTOS_ADDR_LEN : 0);
+    node->pattern[len] = address;
+    node->pattern[len+1] = '\0';
+    node->address = address;
+    node->trigger_scan.token = NULL; // la tabla del trigger anterior ya no sirve
+    node->channel = esp_rom_crc16_be(0,(uint8_t*)node->pattern,strlen(node->pattern));
+}
+#endif
+
+static void mtos_scan_init(mtos_scan_t* scan, const char* token)
+{
+    scan->token = token;
+    scan->len = strnlen(token,sizeof(scan->fail));
+    scan->matched = 0;
+    scan->scanned = 0;
+    uint8_t k = 0;
+    for (uint8_t i = 0; i < scan->len; i++) {
+        while ((k > 0) && (i > 0) && (token[i] != token[k])) {
+            k = scan->fail[k-1];
         }
-        if (changed) {
-            node->crc32.value = crc32_be(0,node->ptr,node->length);
+        if ((i > 0) && (token[i] == token[k])) {
+            k++;
         }
-        xSemaphoreGive(node->smphr);
-        ESP_LOGI(TAG,"%s's semaphore given",node->name);
-        return retval;
+        scan->fail[i] = k;
     }
-    return NULL;
-
 }
 
-int mtos_new_blob(char name[16], size_t length, uint8_t slave, char trigger[8], char pattern[8])
+// continua la busqueda desde el ultimo byte examinado, devuelve el comienzo del token o NULL
+static uint8_t* mtos_scan(mtos_scan_t* scan, const char* token, uint8_t* buffer, size_t rx_bytes)
 {
-    //Use for blobs
-    ESP_LOGI(TAG,"mtos_new_blob");
-    mtos_list_t* current_node = mtos_list_head;
-    size_t entries = 0;
-    while (current_node != NULL) {
-        if (strcmp(current_node->name, name) == 0) {
-            ESP_LOGI(TAG,"name already as entry in the list");
-            return -3; //return -3 to tell name already exists
-        }
-        current_node = current_node->next;
-        entries++;
-    }
-    if (entries) {
-        ESP_LOGI(TAG,"%u entr%s in the list",entries,(entries == 1 ? "\b\b\b\b\b\bone entry" : "ies"));
-    }
-    else {
-        ESP_LOGI(TAG,"the list is empty");
+    if (scan->token != token) {
+        mtos_scan_init(scan,token);
     }
-    mtos_list_t* new_node = (mtos_list_t*)calloc(1,sizeof(mtos_list_t));
-    if (new_node) {
-        ESP_LOGI(TAG,"node malloc ok");
-        new_node->size = 0;
-        new_node->length = length;
-        new_node->blob = true;
-        new_node->slave = slave;
-        memcpy(new_node->trigger,trigger,sizeof(((mtos_list_t*)0)->trigger));
-        memcpy(new_node->pattern,pattern,sizeof(((mtos_list_t*)0)->pattern));
-        memset(new_node->crc32.raw,0,sizeof(((mtos_crc32_t*)0)->raw));
-        strcpy(new_node->name,name);
-        new_node->ptr = malloc(new_node->length);
-        if (new_node->ptr) {
-            ESP_LOGI(TAG,"mb malloc ok");
-            new_node->smphr = xSemaphoreCreateMutex();
-            new_node->next = NULL;
-
-            new_node->crc32.value = crc32_be(0,new_node->ptr,new_node->length);
-            
-            entries = 0;
-            if (mtos_list_head) {
-                current_node = mtos_list_head;
-                while (current_node->next != NULL) {
-                    current_node = current_node->next;
-                    entries++;
-                }
-                ESP_LOGI(TAG,"node placed in list at #%u",entries);
-                current_node->next = new_node;
-            }
-            else {
-                ESP_LOGI(TAG,"list initied");
-                mtos_list_head = new_node;
-            }
-            ESP_LOGI(TAG,"node: {\n"
-                "   .ptr: *(%p) = %.*s...,\n"
-                "   .size: %u,\n"
-                "   .length: %u,\n"
-                "   .blob: %s,\n"
-                "   .slave: %02X,\n"
-                "   .crc32: %08X,\n"
-                "   .trigger: %s,\n"
-                "   .pattern: %s,\n"
-                "   .name: %s,\n"
-                "}\n",new_node->ptr,5,(char*)new_node->ptr,
-                new_node->size,new_node->length,
-                new_node->blob ? "true" : "false",
-                new_node->slave,
-                new_node->crc32.value,new_node->trigger,
-                new_node->pattern,new_node->name
-            );
+    while (scan->scanned < rx_bytes) {
+        uint8_t c = buffer[scan->scanned++];
+        while ((scan->matched > 0) && ((uint8_t)token[scan->matched] != c)) {
+            scan->matched = scan->fail[scan->matched-1];
         }
-        else {
-            ESP_LOGI(TAG,"mb alloc error");
-            free(new_node);
-            return -2;
+        if ((uint8_t)token[scan->matched] == c) {
+            scan->matched++;
+        }
+        if (scan->matched == scan->len) {
+            // queda detenida al comienzo del token, si no se consume se vuelve a encontrar ahi
+            scan->scanned -= scan->len;
+            scan->matched = 0;
+            return buffer+scan->scanned;
         }
     }
-    else {
-        ESP_LOGI(TAG,"node alloc error");
-        return -1;
-    }
-    return 0;
+    return NULL;
 }
 
-int mtos_new_array(char name[16], size_t n, size_t size, uint8_t slave, char trigger[8], char pattern[8])
+// descarta el token hallado en at, la busqueda sigue a partir del byte siguiente
+static void mtos_scan_skip(mtos_scan_t* scan, uint8_t* buffer, uint8_t* at)
 {
-    //Use for arrays
-    ESP_LOGI(TAG,"mtos_new_array");
-    mtos_list_t* current_node = mtos_list_head;
-    size_t entries = 0;
-    while (current_node != NULL) {
-        if (strcmp(current_node->name, name) == 0) {
-            ESP_LOGI(TAG,"name already as entry in the list");
-            return -3; //return -3 to indicate name already exists
-        }
-        current_node = current_node->next;
-        entries++;
-    }
-    if (entries) {
-        ESP_LOGI(TAG,"%u entr%s in the list",entries,(entries == 1 ? "\b\b\b\b\b\bone entry" : "ies"));
-    }
-    else {
-        ESP_LOGI(TAG,"the list is empty");
-    }
-    mtos_list_t* new_node = (mtos_list_t*)calloc(1,sizeof(mtos_list_t));
-    if (new_node) {
-        ESP_LOGI(TAG,"node malloc ok");
-        ESP_LOGI(TAG,"node: %p",new_node);
-        new_node->size = size;
-        new_node->length = n*size;
-        new_node->blob = false;
-        new_node->slave = slave;
-        memcpy(new_node->trigger,trigger,sizeof(((mtos_list_t*)0)->trigger));
-        memcpy(new_node->pattern,pattern,sizeof(((mtos_list_t*)0)->pattern));
-        memset(new_node->crc32.raw,0,sizeof(((mtos_crc32_t*)0)->raw));
-        strcpy(new_node->name,name);
-        new_node->ptr = calloc(n,size);
-        if (new_node->ptr) {
-            ESP_LOGI(TAG,"array calloc ok");
-            new_node->smphr = xSemaphoreCreateMutex();
-            new_node->next = NULL;
+    scan->scanned = at-buffer+1;
+    scan->matched = 0;
+}
 
-            new_node->crc32.value = crc32_be(0,new_node->ptr,new_node->length);
-            
-            entries = 0;
-            if (mtos_list_head) {
-                current_node = mtos_list_head;
-                while (current_node->next != NULL) {
-                    current_node = current_node->next;
-                }
-                ESP_LOGI(TAG,"node placed in list at #%u",entries);
-                current_node->next = new_node;
-            }
-            else {
-                ESP_LOGI(TAG,"list initied");
-                mtos_list_head = new_node;
-            }
-            ESP_LOGI(TAG,"node: {\n"
-                "   .ptr: *(%p) = %.*s...,\n"
-                "   .size: %u,\n"
-                "   .length: %u,\n"
-                "   .blob: %s,\n"
-                "   .slave: %02X,\n"
-                "   .crc32: %08X,\n"
-                "   .trigger: %s,\n"
-                "   .pattern: %s,\n"
-                "   .name: %s,\n"
-                "}\n",new_node->ptr,5,(char*)new_node->ptr,
-                new_node->size,new_node->length,
-                new_node->blob ? "true" : "false",
-                new_node->slave,
-                new_node->crc32.value,new_node->trigger,
-                new_node->pattern,new_node->name
-            );
-        }
-        else {
-            ESP_LOGI(TAG,"array alloc error");
-            free(new_node);
-            return -2;
-        }
+// el buffer elimino n bytes de su comienzo
+static void mtos_scan_shift(mtos_scan_t* scan, size_t n)
+{
+    if (scan->scanned-scan->matched >= n) {
+        scan->scanned -= n;
     }
     else {
-        ESP_LOGI(TAG,"node alloc error");
-        return -1;
+        // la coincidencia parcial empezaba en lo descartado, se reexaminan los pocos bytes que quedan
+        scan->scanned = 0;
+        scan->matched = 0;
     }
-    return 0;
 }
 
-int mtos_grab_mb(char name[16], TickType_t ticks, void** ptr, size_t* length)
+// continua la busqueda del delimitador de una trama, devuelve su posicion o NULL
+static uint8_t* mtos_frame_scan(mtos_scan_t* scan, uint8_t* buffer, size_t rx_bytes)
 {
-    mtos_list_t* node = mtos_lookup(name);
-    if (node != NULL) {
-        if (xSemaphoreTake(node->smphr, ticks) == pdTRUE) {
-                *ptr = node->ptr;
-                *length = node->length;
-                return 0;
-        }
-        else {
-            return -2;
-        }
-
-    }
-    else {
-        return -1;
+    if (scan->token != NULL) {
+        // lo examinado buscando un token no sirve para el delimitador
+        scan->token = NULL;
+        scan->scanned = 0;
+        scan->matched = 0;
     }
+    uint8_t* delim = (uint8_t*)memchr(buffer+scan->scanned,0,rx_bytes-scan->scanned);
+    // queda detenida en el delimitador, si la trama no se consume se vuelve a encontrar ahi
+    scan->scanned = (delim ? delim-buffer : rx_bytes);
+    return delim;
 }
 
-int mtos_return_mb(char name[16])
+// decodifica la trama src (sin el delimitador) en dst, que puede ser src; devuelve el largo decodificado,
+// 0 si la trama esta mal formada, no entra en size o es de otro bloque
+static size_t mtos_frame_open(mtos_list_t* node, const uint8_t* src, size_t len, uint8_t* dst, size_t size)
 {
-    mtos_list_t* node = mtos_lookup(name);
-    if (node != NULL) {
-        node->crc32.value = crc32_be(0,node->ptr,node->length);
-        if (xSemaphoreGive(node->smphr) == pdTRUE) {
+    size_t in = 0;
+    size_t out = 0;
+    while (in < len) {
+        uint8_t code = src[in++];
+        if ((code == 0) || (code-1 > len-in) || (code-1 > size-out)) {
             return 0;
         }
-        else {
-            return -2;
+        // cada grupo reemplaza un cero por su byte de codigo, lo decodificado nunca alcanza a lo que falta leer
+        memmove(dst+out,src+in,code-1);
+        in += code-1;
+        out += code-1;
+        if ((code < 0xFF) && (in < len)) {
+            if (out == size) {
+                return 0;
+            }
+            dst[out++] = 0;
         }
     }
-    else {
-        return -1;
+    uint16_t channel = 0;
+    if (out >= sizeof(channel)) {
+        memcpy(&channel,dst,sizeof(channel));
     }
+    return ((out >= MTOS_FRAME_HEAD) && (channel == node->channel) ? out : 0);
 }
 
-int mtos_resize(char name[16], size_t n)
+static void mtos_node_tokens(mtos_list_t* node, char trigger[8], char pattern[8])
 {
-    mtos_list_t* node = mtos_lookup(name);
-    int retval = -2;
-    if (node != NULL) {
-        retval = -1;
-        xSemaphoreTake(node->smphr, portMAX_DELAY);
-        void* new_ptr = realloc(node->ptr,n);
-        if (new_ptr) {
-            retval = 0;
-            node->ptr = new_ptr;
-            node->length = n;
-            node->crc32.value = crc32_be(0,node->ptr,node->length);
-        }
-        xSemaphoreGive(node->smphr);
-    }
-    return retval;
+    // un token de 8 caracteres no trae terminador, se agrega despues del octavo
+    strncpy(node->trigger,trigger,8);
+    node->trigger[8] = '\0';
+    strncpy(node->pattern,pattern,8);
+    node->pattern[8] = '\0';
+    node->channel = esp_rom_crc16_be(0,(uint8_t*)node->pattern,strlen(node->pattern));
+#if CONFIG_MTOS_BUS
+    mtos_node_address(node,(node->slave ? node->inst->address : MTOS_ADDR_REMOTE));
+#endif
 }
 
-char* mtos_strcat(char name[16], const char* src)
-{
-    // char * strcat ( char * destination, const char * source );
-    return (char*)mtos_strlib_wrap(name, (void*)src, 0, MTOS_STRCAT);
-}
+#if CONFIG_MTOS_STATS
+// contadores globales del enlace, los de cada bloque se alojan en el nodo
+static mtos_stats_t mtos_link_stats = {};
+static portMUX_TYPE mtos_stats_mux = portMUX_INITIALIZER_UNLOCKED;
 
-const char* mtos_strchr(char name[16], char const chr)
+#define MTOS_STATS_ADD(node,field,value) do { \
+        mtos_list_t* stats_node = (node); \
+        portENTER_CRITICAL(&mtos_stats_mux); \
+        if (stats_node) stats_node->stats.field += (value); \
+        mtos_link_stats.field += (value); \
+        portEXIT_CRITICAL(&mtos_stats_mux); \
+    } while(0)
+
+static void mtos_stats_rtt(mtos_list_t* node, uint32_t rtt_us)
 {
-    // const char * strchr ( const char * str, int character );
-    return (const char*)mtos_strlib_wrap(name, (void*)(&chr), 0, MTOS_STRCHR);
+    mtos_stats_t* targets[2] = {&mtos_link_stats, node ? &node->stats : NULL};
+    portENTER_CRITICAL(&mtos_stats_mux);
+    for (int i = 0; i < 2; i++) {
+        if (targets[i]) {
+            if ((targets[i]->rtt_samples == 0) || (rtt_us < targets[i]->rtt_min_us)) targets[i]->rtt_min_us = rtt_us;
+            if (rtt_us > targets[i]->rtt_max_us) targets[i]->rtt_max_us = rtt_us;
+            targets[i]->rtt_total_us += rtt_us;
+            targets[i]->rtt_samples++;
+        }
+    }
+    portEXIT_CRITICAL(&mtos_stats_mux);
 }
 
-int mtos_strcmp(char name[16], const char* src)
+static void mtos_stats_copy(mtos_stats_t* dst, mtos_stats_t* src)
 {
-    // int strcmp ( const char * str1, const char * str2 );
-    return (int)mtos_strlib_wrap(name, (void*)src, 0, MTOS_STRCMP);
+    portENTER_CRITICAL(&mtos_stats_mux);
+    *dst = *src;
+    portEXIT_CRITICAL(&mtos_stats_mux);
+    // los valores derivados se calculan al leer para no cargar el camino de datos
+    dst->rtt_avg_us = dst->rtt_samples ? dst->rtt_total_us/dst->rtt_samples : 0;
+    uint64_t active_us = dst->master_state_us[MTOS_MASTER_INIT]
+        + dst->master_state_us[MTOS_MASTER_CHUNK]
+        + dst->master_state_us[MTOS_MASTER_ENDING]
+        + dst->slave_state_us[MTOS_SLAVE_INIT]
+        + dst->slave_state_us[MTOS_SLAVE_CHUNK]
+        + dst->slave_state_us[MTOS_SLAVE_ENDING];
+    dst->goodput = active_us ? (dst->bytes*1000000)/active_us : 0;
 }
 
-char* mtos_strcpy(char name[16], const char* src)
+// acumula en el estado indicado el tiempo transcurrido desde ts
+#define MTOS_STATS_STATE(node,field,status,ts) do { \
+        int64_t now = esp_timer_get_time(); \
+        MTOS_STATS_ADD(node,field[status],now-(ts)); \
+        (ts) = now; \
+    } while(0)
+#else
+#define MTOS_STATS_ADD(node,field,value) do {} while(0)
+#define MTOS_STATS_STATE(node,field,status,ts) do { (void)(status); (void)(ts); } while(0)
+#define mtos_stats_rtt(node,rtt_us) do {} while(0)
+#endif
+
+#if CONFIG_MTOS_TRACE
+// buffer circular de eventos con marca de tiempo en microsegundos
+static mtos_trace_record_t mtos_trace_ring[CONFIG_MTOS_TRACE_DEPTH];
+static uint32_t mtos_trace_head = 0; // cantidad total de registros escritos
+static portMUX_TYPE mtos_trace_mux = portMUX_INITIALIZER_UNLOCKED;
+// rol de la tarea que registra el evento, en cualquiera de las instancias
+static mtos_trace_task_t mtos_trace_task(TaskHandle_t th)
 {
-    // char * strcpy ( char * destination, const char * source );
-    return (char*)mtos_strlib_wrap(name, (void*)src, 0, MTOS_STRCPY);
+    for (mtos_instance_t* inst = mtos_instances; inst != NULL; inst = inst->next) {
+        if (th == inst->reactor_th) return inst->role;
+    }
+    return MTOS_TRACE_TASK_APP;
 }
 
-size_t mtos_strlen(char name[16])
+static void mtos_trace_add(mtos_trace_type_t type, mtos_list_t* node, int64_t ts, int64_t dur, uint32_t value)
 {
-    // size_t strlen ( const char * str );
-    return (size_t)mtos_strlib_wrap(name, NULL, 0, MTOS_STRLEN);
+    mtos_trace_record_t record = {
+        .ts_us = (uint32_t)ts,
+        .dur_us = (uint32_t)dur,
+        .value = value,
+        .type = type,
+        .task = mtos_trace_task(xTaskGetCurrentTaskHandle()),
+        .block = (node ? node->index : 0xFFFF),
+    };
+    portENTER_CRITICAL(&mtos_trace_mux);
+    mtos_trace_ring[mtos_trace_head%CONFIG_MTOS_TRACE_DEPTH] = record;
+    mtos_trace_head++;
+    portEXIT_CRITICAL(&mtos_trace_mux);
 }
 
-char* mtos_strncat(char name[16], const char* src, size_t n)
+#define MTOS_TRACE_NOW() esp_timer_get_time()
+// evento con duracion, ts es el instante de inicio
+#define MTOS_TRACE_SPAN(type,node,ts,value) mtos_trace_add(type,node,ts,esp_timer_get_time()-(ts),value)
+// evento instantaneo
+#define MTOS_TRACE_MARK(type,node,value) mtos_trace_add(type,node,esp_timer_get_time(),0,value)
+#else
+#define MTOS_TRACE_NOW() 0
+#define MTOS_TRACE_SPAN(type,node,ts,value) do { (void)(ts); } while(0)
+#define MTOS_TRACE_MARK(type,node,value) do {} while(0)
+#endif
+
+// verifica el crc8 del header, todas las variantes lo alojan en el ultimo byte
+static bool mtos_header_check(mtos_list_t* node, mtos_header_t* header)
 {
-    // char * strncat ( char * destination, const char * source, size_t num );
-    return (char*)mtos_strlib_wrap(name, (void*)src, n, MTOS_STRNCAT);
+    bool retval = (esp_rom_crc8_be(0,header->raw,sizeof(mtos_header_t)-1) == header->raw[sizeof(mtos_header_t)-1]);
+    if (!retval) {
+        MTOS_STATS_ADD(node,crc8_errors,1);
+    }
+    MTOS_TRACE_MARK(MTOS_TRACE_CRC8,node,retval);
+    return retval;
 }
 
-int mtos_strncmp(char name[16], const char* src, size_t n)
+// verifica el crc8 de la extension, alojado en el ultimo byte
+static bool mtos_ext_check(mtos_list_t* node, mtos_ext_t* ext)
 {
-    // int strncmp ( const char * str1, const char * str2, size_t num );
-    return (int)mtos_strlib_wrap(name, (void*)src, n, MTOS_STRNCMP);
+    bool retval = (esp_rom_crc8_be(0,ext->raw,sizeof(mtos_ext_t)-1) == ext->raw[sizeof(mtos_ext_t)-1]);
+    if (!retval) {
+        MTOS_STATS_ADD(node,crc8_errors,1);
+    }
+    MTOS_TRACE_MARK(MTOS_TRACE_CRC8,node,retval);
+    return retval;
 }
 
-char* mtos_strncpy(char name[16], const char* src, size_t n)
+// toma el semaforo del nodo contabilizando el tiempo de espera
+static BaseType_t mtos_take(mtos_list_t* node, TickType_t ticks)
 {
-    // char * strncpy ( char * destination, const char * source, size_t num );
-    return (char*)mtos_strlib_wrap(name, (void*)src, n, MTOS_STRNCPY);
+#if CONFIG_MTOS_STATS || CONFIG_MTOS_TRACE
+    int64_t ini = esp_timer_get_time();
+    BaseType_t retval = xSemaphoreTake(node->smphr, ticks);
+    MTOS_STATS_ADD(node,lock_wait_us,esp_timer_get_time()-ini);
+    MTOS_STATS_ADD(node,lock_count,1);
+    MTOS_TRACE_SPAN(MTOS_TRACE_LOCK_WAIT,node,ini,retval == pdTRUE);
+#if CONFIG_MTOS_TRACE
+    node->lock_ts = esp_timer_get_time();
+#endif
+    return retval;
+#else
+    return xSemaphoreTake(node->smphr, ticks);
+#endif
 }
 
-const char * mtos_strpbrk(char name[16], const char* src)
+// libera el semaforo del nodo
+static BaseType_t mtos_give(mtos_list_t* node)
 {
-    // const char * strpbrk ( const char * str1, const char * str2 );
-    return (const char *)mtos_strlib_wrap(name, (void*)src, 0, MTOS_STRPBRK);
+#if CONFIG_MTOS_TRACE
+    MTOS_TRACE_SPAN(MTOS_TRACE_LOCK_HELD,node,node->lock_ts,0);
+#endif
+    return xSemaphoreGive(node->smphr);
 }
 
-const char * mtos_strrchr(char name[16], char const chr)
+#if CONFIG_MTOS_SLAVE_SNAPSHOT
+static portMUX_TYPE mtos_snap_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// el slave envia los chunks desde el buffer actual del bloque y libera el semaforo despues del trigger
+static uint8_t* mtos_snap_begin(mtos_list_t* node)
 {
-    // const char * strrchr ( const char * str, int character );
-    return (const char *)mtos_strlib_wrap(name, (void*)(&chr), 0,MTOS_STRRCHR);
+    portENTER_CRITICAL(&mtos_snap_mux);
+    node->snap = node->ptr;
+    portEXIT_CRITICAL(&mtos_snap_mux);
+    return (uint8_t*)node->snap;
 }
 
-const char * mtos_strstr(char name[16], const char* src)
+// la primera modificacion local durante la sesion copia el bloque y sigue sobre la copia,
+// el buffer que envia el slave no cambia hasta que termine. Se llama con el semaforo tomado;
+// devuelve false si no hay memoria para la copia y el bloque sigue compartido con el slave
+static bool mtos_snap_detach(mtos_list_t* node)
 {
-    // const char * strstr ( const char * str1, const char * str2 );
-    return (const char * )mtos_strlib_wrap(name, (void*)src, 0,MTOS_STRSTR);
+    portENTER_CRITICAL(&mtos_snap_mux);
+    void* old = node->ptr;
+    bool shared = (node->snap != NULL) && (node->snap == old);
+    portEXIT_CRITICAL(&mtos_snap_mux);
+    if (!shared) {
+        return true;
+    }
+    void* copy = malloc(node->length ? node->length : 1);
+    if (copy == NULL) {
+        return false;
+    }
+    memcpy(copy,old,node->length);
+    portENTER_CRITICAL(&mtos_snap_mux);
+    node->ptr = copy;
+    shared = (node->snap == old);
+    portEXIT_CRITICAL(&mtos_snap_mux);
+    if (!shared) {
+        // la sesion termino durante la copia y el buffer ya no lo usa nadie
+        free(old);
+    }
+    MTOS_STATS_ADD(node,snapshot_copies,1);
+    return true;
 }
 
-char * mtos_strtok(char name[16], const char* src)
+// fin de la sesion: si el bloque se copio mientras tanto, el buffer enviado quedo solo para el slave
+static void mtos_snap_release(mtos_list_t* node)
 {
-    // char * strtok ( char * str, const char * delimiters );
-    return (char *)mtos_strlib_wrap(name, (void*)src, 0, MTOS_STRTOK);
+    portENTER_CRITICAL(&mtos_snap_mux);
+    void* snap = node->snap;
+    bool detached = (snap != node->ptr);
+    node->snap = NULL;
+    portEXIT_CRITICAL(&mtos_snap_mux);
+    if (detached) {
+        free(snap);
+    }
 }
+#define MTOS_SNAP_DETACH(node) mtos_snap_detach(node)
+// el slave esta enviando desde el buffer actual del bloque
+#define MTOS_SNAP_SHARED(node) (((node)->snap != NULL) && ((node)->snap == (node)->ptr))
+#else
+#define MTOS_SNAP_DETACH(node) ((void)(node),true)
+#define MTOS_SNAP_SHARED(node) false
+#endif
 
-void* mtos_memset(char name[16], char const chr, size_t n)
+// toma el semaforo para modificar el bloque, que deja de compartir su buffer con el slave;
+// sin memoria para la copia se suelta el semaforo hasta que el slave termine de enviar el bloque
+static BaseType_t mtos_take_modify(mtos_list_t* node, TickType_t ticks)
 {
-    //void * memset ( void * ptr, int value, size_t num );
-    return (void*)mtos_strlib_wrap(name, (void*)(&chr), n, MTOS_MEMSET);
+    BaseType_t retval = mtos_take(node,ticks);
+    while ((retval == pdTRUE) && !MTOS_SNAP_DETACH(node)) {
+        mtos_give(node);
+        for (TickType_t waited = 0; MTOS_SNAP_SHARED(node) && (waited < ticks); waited++) {
+            vTaskDelay(1);
+        }
+        retval = mtos_take(node,ticks);
+    }
+    return retval;
 }
 
-void* mtos_memcpy(char name[16], const void* src, size_t n)
+#if CONFIG_MTOS_SEGMENTS
+#define MTOS_SEGMENTED(node) ((node)->segmented)
+
+// ajusta la cantidad de segmentos para albergar n bytes, solo se alocan o liberan los del final
+static bool mtos_seg_resize(mtos_list_t* node, size_t n)
 {
-    // void * memcpy ( void * destination, const void * source, size_t num );
-    return (void*)mtos_strlib_wrap(name, (void*)src, n, MTOS_MEMCPY);
+    size_t count = (n+CONFIG_MTOS_SEGMENT_SIZE-1)/CONFIG_MTOS_SEGMENT_SIZE;
+    while (node->seg_count > count) {
+        free(node->segs[--node->seg_count]);
+    }
+    if (count > node->seg_cap) {
+        // se realoca solo la tabla de punteros, los datos no se mueven
+        size_t cap = (node->seg_cap ? node->seg_cap : 4);
+        while (cap < count) {
+            cap *= 2;
+        }
+        uint8_t** segs = (uint8_t**)realloc(node->segs,cap*sizeof(uint8_t*));
+        if (segs == NULL) {
+            return false;
+        }
+        node->segs = segs;
+        node->seg_cap = cap;
+    }
+    while (node->seg_count < count) {
+        uint8_t* seg = (uint8_t*)malloc(CONFIG_MTOS_SEGMENT_SIZE);
+        if (seg == NULL) {
+            return false;
+        }
+        node->segs[node->seg_count++] = seg;
+    }
+    return true;
 }
 
-void* mtos_memmove(char name[16], const void* src, size_t n)
+static void mtos_seg_free(mtos_list_t* node)
 {
-    //void * memmove ( void * destination, const void * source, size_t num );
-    return (void*)mtos_strlib_wrap(name, (void*)src, n, MTOS_MEMMOVE);
+    mtos_seg_resize(node,0);
+    free(node->segs);
+    node->segs = NULL;
+    node->seg_cap = 0;
 }
+#else
+#define MTOS_SEGMENTED(node) (false)
+#endif
 
-int mtos_get_length(char name[16])
+// puntero al byte offset del bloque, en un blob segmentado *len se recorta al final del segmento;
+// fuera del bloque devuelve NULL con *len en 0, un blob segmentado no tiene segmento para ese offset
+static uint8_t* mtos_block_at(mtos_list_t* node, size_t offset, size_t* len)
 {
-    mtos_list_t* node = mtos_lookup(name);
-    if (node != NULL) {
-        return node->length;
+    if (offset >= node->length) {
+        *len = 0;
+        return NULL;
     }
-    return -1;
+#if CONFIG_MTOS_SEGMENTS
+    if (node->segmented) {
+        size_t in = offset%CONFIG_MTOS_SEGMENT_SIZE;
+        if (*len > CONFIG_MTOS_SEGMENT_SIZE-in) {
+            *len = CONFIG_MTOS_SEGMENT_SIZE-in;
+        }
+        return node->segs[offset/CONFIG_MTOS_SEGMENT_SIZE]+in;
+    }
+#endif
+    return (uint8_t*)node->ptr+offset;
 }
 
-int mtos_borrow_element(char name[16], void* element, size_t index)
+// copia entre buf y el bloque desde offset (write: hacia el bloque), con buf NULL se escriben ceros
+static void mtos_block_copy(mtos_list_t* node, size_t offset, void* buf, size_t n, bool write)
 {
-    mtos_list_t* node = mtos_lookup(name);
-    if (node != NULL) {
-        if(!node->blob) {
-            size_t raw_idx = index*node->size;
-            if (raw_idx < node->length) {
-                xSemaphoreTake(node->smphr, portMAX_DELAY);
-                memcpy(element,node->ptr+raw_idx,node->size);
-                xSemaphoreGive(node->smphr);
-                return 0;
-            }
-            else {
-                return -3;
-            }
+    uint8_t* p = (uint8_t*)buf;
+    size_t len;
+    for (; n > 0; n -= len, offset += len) {
+        len = n;
+        uint8_t* at = mtos_block_at(node,offset,&len);
+        if (!write) {
+            memcpy(p,at,len);
+        }
+        else if (p) {
+            memcpy(at,p,len);
         }
         else {
-            return -2;
+            memset(at,0,len);
+        }
+        if (p) {
+            p += len;
         }
-    }
-    else {
-        return -1;
     }
 }
 
-int mtos_return_element(char name[16], void* element, size_t index)
+// cambia el largo del bloque, un blob segmentado no copia los datos existentes
+static bool mtos_block_resize(mtos_list_t* node, size_t n)
 {
-    mtos_list_t* node = mtos_lookup(name);
-    if (node != NULL) {
-        if(!node->blob) {
-            size_t raw_idx = index*node->size;
-            if (raw_idx < node->length) {
-                xSemaphoreTake(node->smphr, portMAX_DELAY);
-                memcpy(node->ptr+raw_idx,element,node->size);
-                xSemaphoreGive(node->smphr);
-                return 0;
-            }
-            else {
-                return -3;
-            }
+#if CONFIG_MTOS_SEGMENTS
+    if (node->segmented) {
+        if (!mtos_seg_resize(node,n)) {
+            return false;
         }
-        else {
-            return -2;
+        node->length = n;
+        return true;
+    }
+#endif
+    if (node->external) {
+        if (n > node->capacity) {
+            return false;
         }
+        node->length = n;
+        return true;
     }
-    else {
-        return -1;
+    void* new_ptr = realloc(node->ptr,(n ? n : 1));
+    if (new_ptr == NULL) {
+        return false;
     }
+    node->ptr = new_ptr;
+    node->length = n;
+    return true;
 }
 
-#define MILLIS(ini) (((uint32_t)(portTICK_PERIOD_MS*xTaskGetTickCount()))-ini)
-#define MTOS_PORT CONFIG_MTOS_UART_PORT
-#define MTOS_BUFFER_EFFECTIVE (((CONFIG_MTOS_BUFFER_SIZE)&(0xFFFFFF))+CONFIG_MTOS_BUFFER_LEGACY)
-#define MTOS_BUFFER_AVAILABLE ((CONFIG_MTOS_BUFFER_SIZE)&(0xFFFFFF))
-#define MTOS_BUFFER_SLAVE (2*CONFIG_MTOS_BUFFER_LEGACY)
-#define MTOS_EVT_POST(x,y,z) esp_event_post_to(mtos_loop_handle,MTOS_EVENTS,x,y,z,CONFIG_MTOS_UART_STEP_MS/portTICK_PERIOD_MS)
-
-static QueueHandle_t mtos_call_queue;
-static QueueHandle_t mtos_uart_queue;
-static esp_event_loop_handle_t mtos_loop_handle;
-static int uart_master_timeout = CONFIG_MTOS_DEFAULT_TIMEOUT;
-static int uart_slave_timeout = CONFIG_MTOS_DEFAULT_TIMEOUT;
-static unsigned int chunk_current_max = MTOS_BUFFER_AVAILABLE;
-static uint32_t to;
-
-ESP_EVENT_DEFINE_BASE(MTOS_EVENTS);
+// crc32 del contenido completo del bloque, encadenado segmento por segmento
+static uint32_t mtos_node_crc32(mtos_list_t* node)
+{
+    uint32_t crc = 0;
+    size_t len;
+    for (size_t offset = 0; offset < node->length; offset += len) {
+        len = node->length-offset;
+        uint8_t* at = mtos_block_at(node,offset,&len);
+        crc = esp_rom_crc32_be(crc,at,len);
+    }
+    return crc;
+}
 
-int mtos_call(char* name, unsigned int timeout_ms, unsigned int max_chunk_size)
+// largo de la cadena del bloque, se mide una sola vez (sin pasar de node->length) y queda cacheado
+static size_t mtos_str_length(mtos_list_t* node)
 {
-    mtos_list_t* node = mtos_lookup(name);
-    if (node != NULL) {
-        if (!node->slave) {
-            ESP_LOGI(TAG,"found %s",node->name);
-            xQueueSend(mtos_call_queue,&node,portMAX_DELAY);
-            uart_master_timeout = timeout_ms;
-            if ((max_chunk_size <= MTOS_BUFFER_AVAILABLE) && (max_chunk_size >= CONFIG_MTOS_BUFFER_LEGACY)) {
-                chunk_current_max = max_chunk_size;
-            }
-            else if (max_chunk_size < CONFIG_MTOS_BUFFER_LEGACY) {
-                chunk_current_max = CONFIG_MTOS_BUFFER_LEGACY;
-            }
-            else {
-                chunk_current_max = MTOS_BUFFER_AVAILABLE;
-            }
-            return 0;
-        }
-        else {
-            return -2;
-        }
+    if (node->str_length == MTOS_STRLEN_UNKNOWN) {
+        node->str_length = strnlen((const char*)node->ptr,node->length);
     }
-    else {
-        return -1;
+    return node->str_length;
+}
+
+// recalcula el crc32 si alguna funcion de cadena lo dejo desactualizado, con el semaforo tomado
+static void mtos_crc_sync(mtos_list_t* node)
+{
+    if (node->crc_stale) {
+        node->crc32.value = mtos_node_crc32(node);
+        node->crc_stale = false;
     }
 }
 
-static void mtos_main_uart(void* pvParameters)
+// aplica una operacion remota con el semaforo tomado, devuelve false si no entra en el bloque
+static bool mtos_op_apply(mtos_list_t* node, mtos_op_t code, size_t offset, size_t count, const uint8_t* src, size_t len)
 {
-    char *TAG = "mtos_uart";
-    mtos_uart_vessel_t uart_call = {};
-    int uart_result = 0;
-    size_t last_rx_bytes = 0;
-    size_t buffered_size = 0;
-    for(;;) {
-        uint32_t last_rx_time = MILLIS(0);
-        uint32_t delta_ms = MILLIS(0);
-        while(1) {
-            last_rx_bytes = buffered_size;
-            vTaskDelay(10/portTICK_RATE_MS);
-            uart_get_buffered_data_len(CONFIG_MTOS_UART_PORT, &buffered_size);
-            if (buffered_size != last_rx_bytes) {
-                last_rx_time = MILLIS(0);
+    size_t length = node->length;
+    size_t at;
+    size_t end;
+    switch (code) {
+        case MTOS_OP_WRITE:
+            if ((offset > length) || (len > length-offset)) {
+                return false;
             }
-            else {
-                if(delta_ms > CONFIG_MTOS_UART_STEP_MS) {
-                    break;
-                }
-                else {
-                    delta_ms = MILLIS(last_rx_time);
-                }
+            mtos_block_copy(node,offset,(void*)src,len,true);
+            node->str_length = MTOS_STRLEN_UNKNOWN;
+            node->crc_stale = true;
+            break;
+        case MTOS_OP_APPEND:
+            if (!mtos_block_resize(node,length+len)) {
+                return false;
             }
-        }
-        ESP_LOGD("ultradbg","messages waiting now: %u",uxQueueMessagesWaiting(mtos_uart_queue));
-        ESP_LOGD("ultradbg","[[[[[[[[RECIEVING QUEUE FROM read_bytes > uart_main]]]]]]]]");
-        if (xQueueReceive(mtos_uart_queue,&uart_call,2*CONFIG_MTOS_UART_STEP_MS/portTICK_PERIOD_MS) == pdTRUE) {
-            last_rx_bytes = *uart_call.rx_bytes;
-            uart_result = uart_read_bytes(CONFIG_MTOS_UART_PORT, uart_call.buffer+*uart_call.rx_bytes, buffered_size, 0);
-            *uart_call.rx_bytes += (uart_result > 0 ? uart_result : 0);
-            if (*uart_call.rx_bytes != last_rx_bytes) {
-                ESP_LOGI(TAG,"rx_bytes pre: %u >>>",last_rx_bytes);
-                ESP_LOG_BUFFER_HEXDUMP(TAG,uart_call.buffer,*uart_call.rx_bytes,ESP_LOG_INFO);
-                ESP_LOGI(TAG,"rx_bytes pos: %u <<<",*uart_call.rx_bytes);
+            mtos_block_copy(node,length,(void*)src,len,true);
+            if (node->str_length == length) {
+                node->str_length = length+strnlen((const char*)src,len);
             }
-            xTaskNotifyGive(uart_call.th);
-            uart_call.th = xTaskGetCurrentTaskHandle();
-            do {
-                ESP_LOGD("ultradbg","!!messages waiting now: %u",uxQueueMessagesWaiting(mtos_uart_queue));
-                ESP_LOGD("ultradbg","]]]]]]]]QUEUE SENDIG FROM  uart_main > read_bytes[[[[[[[[");
-            } while (xQueueSend(mtos_uart_queue,&uart_call,CONFIG_MTOS_UART_STEP_MS/portTICK_PERIOD_MS) != pdTRUE);
-            ulTaskNotifyTake(pdTRUE,2*CONFIG_MTOS_UART_STEP_MS/portTICK_PERIOD_MS);
-            vTaskDelay(1/portTICK_RATE_MS);
-        }
+            if (!node->crc_stale) {
+                // el crc32 se encadena sobre lo agregado, no se recorre el bloque
+                node->crc32.value = esp_rom_crc32_be(node->crc32.value,src,len);
+            }
+            break;
+        case MTOS_OP_MEMSET:
+            if ((len != 1) || (offset > length) || (count > length-offset)) {
+                return false;
+            }
+            node->str_length = ((src[0] == 0) && (offset == 0) && (count > 0) ? 0 : MTOS_STRLEN_UNKNOWN);
+            for (size_t n = count; n > 0; n -= end, offset += end) {
+                end = n;
+                memset(mtos_block_at(node,offset,&end),src[0],end);
+            }
+            node->crc_stale = true;
+            break;
+        case MTOS_OP_RESIZE:
+            if (!mtos_block_resize(node,count)) {
+                return false;
+            }
+            if ((node->str_length != MTOS_STRLEN_UNKNOWN) && (node->str_length >= count)) {
+                node->str_length = MTOS_STRLEN_UNKNOWN;
+            }
+            node->crc_stale = true;
+            break;
+        case MTOS_OP_STRCPY:
+        case MTOS_OP_STRCAT:
+            if (MTOS_SEGMENTED(node)) {
+                return false;
+            }
+            at = (code == MTOS_OP_STRCAT ? mtos_str_length(node) : 0);
+            end = (count ? count : len+1); // strncpy completa con ceros hasta count
+            if ((len > end) || (at > length) || (end > length-at)) {
+                return false;
+            }
+            memcpy((uint8_t*)node->ptr+at,src,len);
+            memset((uint8_t*)node->ptr+at+len,0,end-len);
+            node->str_length = (len < end ? at+len : MTOS_STRLEN_UNKNOWN);
+            node->crc_stale = true;
+            break;
+        default:
+            return false;
     }
+    return true;
+}
+
+#if CONFIG_MTOS_REMOTE_QUERIES
+// min, max y sum sobre n valores de un tipo, separados stride bytes. Cada recorrido solo depende del
+// acumulador: con stride igual al tamaño del tipo los elementos son contiguos y el compilador lo vectoriza
+#define MTOS_QUERY_KERNEL(name,type,acc_type) \
+static inline acc_type mtos_query_loop_##name(const uint8_t* p, size_t stride, size_t n, uint8_t query) \
+{ \
+    type v; \
+    type best; \
+    acc_type sum = 0; \
+    memcpy(&best,p,sizeof(type)); \
+    if (query == MTOS_QUERY_SUM) { \
+        for (size_t i = 0; i < n; i++) { \
+            memcpy(&v,p+i*stride,sizeof(type)); \
+            sum += v; \
+        } \
+        return sum; \
+    } \
+    if (query == MTOS_QUERY_MIN) { \
+        for (size_t i = 1; i < n; i++) { \
+            memcpy(&v,p+i*stride,sizeof(type)); \
+            best = (v < best ? v : best); \
+        } \
+    } \
+    else { \
+        for (size_t i = 1; i < n; i++) { \
+            memcpy(&v,p+i*stride,sizeof(type)); \
+            best = (v > best ? v : best); \
+        } \
+    } \
+    return best; \
+} \
+static void mtos_query_##name(const uint8_t* p, size_t stride, size_t n, uint8_t query, mtos_query_wire_t* out) \
+{ \
+    acc_type r = (stride == sizeof(type) ? mtos_query_loop_##name(p,sizeof(type),n,query) : mtos_query_loop_##name(p,stride,n,query)); \
+    memcpy(&out->value,&r,sizeof(out->value)); \
+    if (query != MTOS_QUERY_SUM) { \
+        /* primer elemento con el minimo o el maximo */ \
+        type best = (type)r; \
+        type v; \
+        for (size_t i = 0; i < n; i++) { \
+            memcpy(&v,p+i*stride,sizeof(type)); \
+            if (v == best) { \
+                out->index = i; \
+                break; \
+            } \
+        } \
+    } \
 }
 
+MTOS_QUERY_KERNEL(u8,uint8_t,uint64_t)
+MTOS_QUERY_KERNEL(i8,int8_t,int64_t)
+MTOS_QUERY_KERNEL(u16,uint16_t,uint64_t)
+MTOS_QUERY_KERNEL(i16,int16_t,int64_t)
+MTOS_QUERY_KERNEL(u32,uint32_t,uint64_t)
+MTOS_QUERY_KERNEL(i32,int32_t,int64_t)
+MTOS_QUERY_KERNEL(float,float,double)
+MTOS_QUERY_KERNEL(double,double,double)
+
+static const struct {
+    void (*run)(const uint8_t*,size_t,size_t,uint8_t,mtos_query_wire_t*);
+    size_t size;
+} mtos_query_types[] = {
+    [MTOS_TYPE_U8] = {mtos_query_u8,sizeof(uint8_t)},
+    [MTOS_TYPE_I8] = {mtos_query_i8,sizeof(int8_t)},
+    [MTOS_TYPE_U16] = {mtos_query_u16,sizeof(uint16_t)},
+    [MTOS_TYPE_I16] = {mtos_query_i16,sizeof(int16_t)},
+    [MTOS_TYPE_U32] = {mtos_query_u32,sizeof(uint32_t)},
+    [MTOS_TYPE_I32] = {mtos_query_i32,sizeof(int32_t)},
+    [MTOS_TYPE_FLOAT] = {mtos_query_float,sizeof(float)},
+    [MTOS_TYPE_DOUBLE] = {mtos_query_double,sizeof(double)},
+};
 
-static size_t mtos_read_bytes(void *buf, size_t *length, void *ptr)
+// cuenta los elementos cuyo campo coincide con el patron, o busca el primero
+static void mtos_query_match(const uint8_t* p, size_t stride, size_t n, const uint8_t* pat, size_t len, bool find, mtos_query_wire_t* out)
 {
-    ESP_LOGD("ultradbg","/entering mtos_read_bytes\\");
-    mtos_uart_vessel_t input = {
-        .buffer = buf,
-        .rx_bytes = length,
-        .header = ptr,
-        .th = xTaskGetCurrentTaskHandle()
-    };
-    if (uxQueueMessagesWaiting(mtos_uart_queue)) {
-        ESP_LOGD("ultradbg","retained messages: %u",uxQueueMessagesWaiting(mtos_uart_queue));
-        mtos_uart_vessel_t retained = {};
-        if (xQueueReceive(mtos_uart_queue,&retained,
-            CONFIG_MTOS_UART_STEP_MS/portTICK_PERIOD_MS) == pdTRUE) {
-            ESP_LOGD("ultradbg","retained vessel recieved");
-            if (retained.th != xTaskGetCurrentTaskHandle()) {
-                ESP_LOGD("ultradbg","retained vessel from uart_main (%u bytes)",*retained.rx_bytes);
-                ESP_LOG_BUFFER_HEXDUMP("ultradbg",retained.buffer,*retained.rx_bytes,ESP_LOG_DEBUG);
-                ESP_LOGD("ultradbg","now retained messages: %u",uxQueueMessagesWaiting(mtos_uart_queue));
-                return *retained.rx_bytes;
-            }
-            else {
-                ESP_LOGD("ultradbg","retained vessel not for this task");
-                return *input.rx_bytes;
+    uint32_t found = 0;
+    if ((stride == 1) && (len == 1)) {
+        // un byte en un blob: memchr para buscar, comparacion sin saltos para contar
+        if (find) {
+            const uint8_t* at = memchr(p,pat[0],n);
+            if (at) {
+                out->index = at-p;
+                found = 1;
             }
         }
         else {
-            ESP_LOGD("ultradbg","retained vessel not recieved");
-            return *input.rx_bytes;
+            for (size_t i = 0; i < n; i++) {
+                found += (p[i] == pat[0]);
+            }
         }
     }
     else {
-        mtos_uart_vessel_t new = {};
-        ESP_LOGD("ultradbg","[[[[[[[[QUEUE SENDIG FROM read_bytes > uart_main]]]]]]]]");
-        if (xQueueSend(mtos_uart_queue,&input,CONFIG_MTOS_UART_STEP_MS/portTICK_PERIOD_MS) == pdTRUE) {
-            ESP_LOGD("ultradbg","/vessel sended\\");
-            if (ulTaskNotifyTake(pdTRUE,2*CONFIG_MTOS_UART_STEP_MS/portTICK_PERIOD_MS) == 0) return *input.rx_bytes; // espero a uart_main haya mandado al queue
-            ESP_LOGD("ultradbg","/notif recieved\\");
-            ESP_LOGD("ultradbg","messages waiting now: %u",uxQueueMessagesWaiting(mtos_uart_queue));
-            ESP_LOGD("ultradbg","[[[[[[[[RECIEVING QUEUE FROM uart_main > read_bytes]]]]]]]]");
-            if (xQueueReceive(mtos_uart_queue,&new,2*CONFIG_MTOS_UART_STEP_MS/portTICK_PERIOD_MS) == pdTRUE) {
-                xTaskNotifyGive(new.th); // desbloqueo uart_main luego de haber tomado el queue
-                ESP_LOGD("ultradbg","/uart_main restored\\");
-                if (new.th == input.th) {
-                    ESP_LOGD("ultradbg","llego un vessel que no es el que corresponde\n");
-                    ESP_LOGD("ultradbg","/abort: returning input\\");
-                    return *input.rx_bytes;
-                }
-                else {
-                    ESP_LOGD("ultradbg","llego un vessel correspondiente\n");
+        for (size_t i = 0; i < n; i++) {
+            if ((p[i*stride] == pat[0]) && !memcmp(p+i*stride,pat,len)) {
+                if (find) {
+                    out->index = i;
+                    found = 1;
+                    break;
                 }
-                ESP_LOGD("ultradbg","/vessel recieved back\\");
-                ESP_LOGD("ultradbg","messages waiting now: %u",uxQueueMessagesWaiting(mtos_uart_queue));
+                found++;
             }
-            else {
-                ESP_LOGD("ultradbg","/abort: no vessel recieved\\");
-                return *input.rx_bytes;
-            }
-            return *new.rx_bytes;
         }
-        return *input.rx_bytes;
     }
+    out->value = found;
 }
 
-static void mtos_send_bytes(char* token, mtos_header_t* header, void* chunk, size_t len)
+// ejecuta una consulta sobre el bloque, con el semaforo tomado. Los elementos de un blob son bytes en count y find,
+// y valores del tipo en min, max y sum; el indice del resultado se cuenta desde el comienzo del bloque
+static bool mtos_query_run(mtos_list_t* node, uint8_t code, size_t first, size_t count, const uint8_t* operand, size_t len, mtos_query_wire_t* out)
 {
-    if (token) uart_write_bytes(MTOS_PORT,token,strlen(token));
-    if (header) uart_write_bytes(MTOS_PORT,header->raw,sizeof(((mtos_header_t*)0)->raw));
-    if (chunk) {
-        mtos_crc32_t block_crc = {};
-        block_crc.value = crc32_be(0,chunk,len);
-        ESP_LOGI(TAG,"sending chunk_response:{.chunk_size:%u,.crc8:%x,.block_crc32:%x}",
-            header->chunk_response.size,
-            header->chunk_response.crc8,
-            block_crc.value);
-        uart_write_bytes(MTOS_PORT,chunk,len);
-        uart_write_bytes(MTOS_PORT,block_crc.raw,sizeof(mtos_crc32_t));
+    uint8_t query = code-MTOS_OP_QUERY;
+    if ((len < MTOS_QUERY_HEAD) || MTOS_SEGMENTED(node) || (query > MTOS_QUERY_FIND)) {
+        return false;
+    }
+    uint8_t type = operand[0];
+    size_t field = operand[1] | (operand[2] << 8);
+    const uint8_t* pat = operand+MTOS_QUERY_HEAD;
+    size_t pat_len = len-MTOS_QUERY_HEAD;
+    bool reduce = (query <= MTOS_QUERY_SUM);
+    size_t width; // bytes del campo que se compara o reduce
+    if (reduce) {
+        if (type >= sizeof(mtos_query_types)/sizeof(mtos_query_types[0])) {
+            return false;
+        }
+        width = mtos_query_types[type].size;
+    }
+    else {
+        width = pat_len;
+        if (width == 0) {
+            return false;
+        }
     }
+    size_t stride = (node->blob ? (reduce ? width : 1) : node->size);
+    if (node->blob ? (field != 0) : (field+width > node->size)) {
+        return false;
+    }
+    size_t total = node->length/stride;
+    if (node->blob && !reduce) {
+        // posiciones donde puede comenzar el patron
+        total = (node->length >= width ? node->length-width+1 : 0);
+    }
+    if (first > total) {
+        return false;
+    }
+    size_t n = total-first;
+    if (count && (count < n)) {
+        n = count;
+    }
+    memset(out,0,sizeof(mtos_query_wire_t));
+    out->index = MTOS_QUERY_NONE;
+    out->count = n;
+    if (n > 0) {
+        const uint8_t* p = (const uint8_t*)node->ptr+first*stride+field;
+        if (reduce) {
+            mtos_query_types[type].run(p,stride,n,query,out);
+        }
+        else {
+            mtos_query_match(p,stride,n,pat,pat_len,(query == MTOS_QUERY_FIND),out);
+        }
+        if (out->index != MTOS_QUERY_NONE) {
+            out->index += first;
+        }
+    }
+    return true;
 }
+#endif
 
-static void mtos_slave_task(void* pvParameters)
-{
-    char *TAG = "mtos_slave";
-    uint8_t *buffer = (uint8_t*)malloc(MTOS_BUFFER_SLAVE); // reservar bloque de datos donde se recibiran los comandos del maestro
-    uint8_t *ptr = buffer; // puntero de posicion
-    TaskHandle_t master_task_handle = (TaskHandle_t)pvParameters;
-    size_t rx_bytes = 0; // cantidad de bytes recibidos por uart
-    mtos_list_t* node = NULL; // puntero donde se cargara el nodo a procesar
-    size_t chunk_limit = MTOS_BUFFER_AVAILABLE;
-    size_t chunk_max = chunk_limit; // max chunk size
-    mtos_header_t current_session = {};
-    mtos_header_t response = {};
-    size_t bytes_confirmed = 0;
-    size_t bytes_to_send = 0;
-    mtos_slave_status_t status = MTOS_SLAVE_IDLE;
-    assert(buffer);
-    MTOS_EVT_POST(MTOS_EVENT_SLAVE_INITED,NULL,0);
-    for(;;) {
-        // if timeout abort
-        if ((MILLIS(to) > uart_slave_timeout)&&(status != MTOS_SLAVE_IDLE)) {
-            ESP_LOGI(TAG,"timeout expired");
-            status = MTOS_SLAVE_ABORT;
-            MTOS_EVT_POST(MTOS_EVENT_SLAVE_TIMEOUT,(node?node->name:NULL),(node?sizeof(((mtos_list_t*)0)->name):0));
-        }
-        // si el puntero ptr avanzo
-        if (buffer < ptr) {
-            ESP_LOGI(TAG,"buffer < ptr, se elimina %u bytes procesados",ptr-buffer);
-            ESP_LOG_BUFFER_HEXDUMP(TAG,buffer,ptr-buffer,ESP_LOG_DEBUG);
-            memmove(buffer,ptr,MTOS_BUFFER_SLAVE-(ptr-buffer));
-            rx_bytes -= (ptr-buffer); // se descartan los bytes usados
-        }
-        else if (rx_bytes > CONFIG_MTOS_BUFFER_LEGACY) {
-            ESP_LOGI(TAG,"rx_bytes > CONFIG_MTOS_BUFFER_LEGACY, se eliminan bytes sin informacion");
-            // si no se extrajo ningun dato y rx_bytes se hacerca al final del buffer
-            // se transfiere los bytes mas recientes al comienzo del buffer
-            memmove(buffer,buffer+(rx_bytes-CONFIG_MTOS_BUFFER_LEGACY),CONFIG_MTOS_BUFFER_LEGACY);
-            rx_bytes = CONFIG_MTOS_BUFFER_LEGACY;
-        }
-
-        ptr = buffer;
-
-        // se leen mas datos de uart para que esten disponibles en el proximo ciclo
-        ulTaskNotifyTake(pdTRUE,0);
-        mtos_read_bytes(buffer,&rx_bytes,ptr);
-        xTaskNotifyGive(master_task_handle);
-
-        if (rx_bytes > sizeof(mtos_header_t)) {
-            ESP_LOGI(TAG,"suficientes bytes para analizar");
-            switch (status) {
-                case MTOS_SLAVE_IDLE: {
-                    ESP_LOGI(TAG,"MTOS_SLAVE_IDLE");
-                    node = mtos_list_head;
-                    status = MTOS_SLAVE_ABORT;
-                    ESP_LOGI(TAG,"buscando nodo");
-                    do {
-                        ESP_LOGI(TAG,"node: %p | trigger: %s",node,node->trigger);
-                        ESP_LOG_BUFFER_HEXDUMP(TAG,buffer,rx_bytes,ESP_LOG_DEBUG);
-                        if (node->slave) {
-                            ptr = memmem(buffer,rx_bytes,node->trigger,strlen(node->trigger));
-                            if (ptr != NULL) {
-                                ESP_LOGI(TAG,"trigger found!");
-                                memcpy(&current_session,ptr+strlen(node->pattern),sizeof(mtos_header_t));
-                                ESP_LOGI(TAG,"recieved crc8: %02X",current_session.chunk_request.crc8);
-                                ESP_LOGI(TAG,"raw: %02X %02X %02X %02X",current_session.raw[0],current_session.raw[1],current_session.raw[2],current_session.raw[3]);
-                                if (crc8_be(0,current_session.raw,sizeof(mtos_header_t)-1)
-                                == current_session.chunk_request.crc8) {
-                                    ESP_LOGI(TAG,"nodo encontrado");
-                                    to = MILLIS(0);
-                                    MTOS_EVT_POST(MTOS_EVENT_SLAVE_DEMANDED,node->name,sizeof(((mtos_list_t*)0)->name));
-                                    ESP_LOGI(TAG,"timeout reset");
-                                    ESP_LOGI(TAG,"recieved trigger:{.max_size:%u,.resend:%u.crc8:%x}",
-                                    current_session.chunk_request.max_size,
-                                    current_session.chunk_request.resend,
-                                    current_session.chunk_request.crc8);
-                                    chunk_max = (current_session.chunk_request.max_size < chunk_limit ?
-                                        current_session.chunk_request.max_size : chunk_limit);
-                                    if (current_session.chunk_request.resend) {
-                                        ESP_LOGI(TAG,"error: trigger con comando de resend => MTOS_SLAVE_ABORT");
-                                    }
-                                    else {
-                                        ESP_LOGI(TAG,">>>reacomodamiento inicial de buffer");
-                                        ESP_LOGI(TAG,"rx_bytes: %u",rx_bytes);
-                                        ESP_LOG_BUFFER_HEXDUMP(TAG,buffer,rx_bytes,ESP_LOG_DEBUG);
-                                        uint8_t* aux = (uint8_t*)memmem(buffer,rx_bytes,node->trigger,strlen(node->trigger));
-                                        if (aux) {
-                                            size_t removed_header_length = aux+strlen(node->trigger)-buffer;
-                                            memmove(buffer+strlen(node->pattern),buffer+removed_header_length,rx_bytes-removed_header_length);
-                                            memcpy(buffer,node->pattern,strlen(node->pattern));
-                                            rx_bytes += strlen(node->trigger);
-                                            rx_bytes -= removed_header_length;
-                                            ESP_LOGI(TAG,"rx_bytes: %u",rx_bytes);
-                                            ESP_LOG_BUFFER_HEXDUMP(TAG,buffer,rx_bytes,ESP_LOG_DEBUG);
-                                            ESP_LOGI(TAG,"<<<");
-                                        }
-                                        status = MTOS_SLAVE_INIT;
-                                        ptr = buffer;
-                                    }
-                                    break; // sale de loop con node asignado
-                                }
-                                else {
-                                    ESP_LOGI(TAG,"fallo verif. crc8");
-                                }
-                            }
-                            else {
-                                ESP_LOGI(TAG,"trigger not found.");
-                            }
-                        }
-                        node = node->next;
-                    } while(node);
-                    if (node == NULL) {
-                        ESP_LOGI(TAG,"error: nodo no encontrado => MTOS_SLAVE_ABORT");
-                        break;
-                    }
-                }
-                case MTOS_SLAVE_INIT: {
-                    ESP_LOGI(TAG,"MTOS_SLAVE_INIT");
-                    if (status == MTOS_SLAVE_ABORT) {
-                        ESP_LOGI(TAG,"falltrough con status en MTOS_SLAVE_ABORT se aborta");
-                        break;
-                    }
-                    if (xSemaphoreTake(node->smphr, (uart_slave_timeout)/portTICK_PERIOD_MS) != pdTRUE) {
-                        ESP_LOGI(TAG,"no se pudo tomar el semaforo a tiempo");
-                        status = MTOS_SLAVE_ABORT;
-                        break;
-                    }
-                    else {
-                        // trigger response
-                        ESP_LOGI(TAG,"semaforo tomado (%p), se prosesa la respuesta al trigger",node->smphr);
-                        response.trigger_response.payload_length = node->length;
-                        response.trigger_response.crc8 = crc8_be(0,response.raw,sizeof(mtos_header_t)-1);
-                        ESP_LOGI(TAG,"sending trigger_response:{.payload_length:%u,.crc8:%x}",
-                            response.trigger_response.payload_length,
-                            response.trigger_response.crc8);
-                        mtos_send_bytes(node->trigger,&response,NULL,0);
-                        memset(&response,'\0',sizeof(mtos_header_t));
-                        status = MTOS_SLAVE_CHUNK;
-                    }
-                }
-                case MTOS_SLAVE_CHUNK: {
-                    // chunk response
-                    ESP_LOGI(TAG,"MTOS_SLAVE_CHUNK");
-                    status = MTOS_SLAVE_ABORT;
-                    if (node != NULL) {
-                        if (node->slave) {
-                            status = MTOS_SLAVE_CHUNK;
-                            ptr = memmem(buffer,rx_bytes,node->pattern,strlen(node->pattern));
-                            if (ptr != NULL) {
-                                ESP_LOGI(TAG,"pattern found!");
-                                memcpy(&current_session,ptr+strlen(node->pattern),sizeof(mtos_header_t));
-                                ESP_LOGI(TAG,"recieved crc8: %02X",current_session.chunk_request.crc8);
-                                ESP_LOGI(TAG,"raw: %02X %02X %02X %02X",current_session.raw[0],current_session.raw[1],current_session.raw[2],current_session.raw[3]);
-                                if (crc8_be(0,current_session.raw,sizeof(mtos_header_t)-1)
-                                == current_session.chunk_request.crc8) {
-                                    to = MILLIS(0);
-                                    ESP_LOGI(TAG,"timeout reset");
-                                    ESP_LOGI(TAG,"recieved chunk_request:{.max_size:%u,.resend:%u.crc8:%x}",
-                                        current_session.chunk_request.max_size,
-                                        current_session.chunk_request.resend,
-                                        current_session.chunk_request.crc8);
-                                    chunk_max = (current_session.chunk_request.max_size < chunk_limit ?
-                                        current_session.chunk_request.max_size : chunk_limit);
-                                    mtos_event_chunk_t* evt = (mtos_event_chunk_t*)calloc(1,sizeof(mtos_event_chunk_t));
-                                    if (evt) {
-                                        evt->chunk_rq.max_size = current_session.chunk_request.max_size;
-                                        evt->chunk_rq.tx_size = chunk_max;
-                                        evt->chunk_rq.resend = current_session.chunk_request.resend;
-                                        evt->chunk_rq.name = node->name;
-                                        MTOS_EVT_POST(MTOS_EVENT_SLAVE_CHUNK_RQ,evt,sizeof(mtos_event_chunk_t));
-                                    }
-                                    else {
-                                        MTOS_EVT_POST(MTOS_EVENT_SLAVE_ALLOC_ERROR,node->name,sizeof(((mtos_list_t*)0)->name));
-                                    }
-                                    if (current_session.chunk_request.resend == 0) {
-                                        bytes_confirmed += bytes_to_send;
-                                        bytes_to_send = bytes_confirmed + chunk_max > node->length ? node->length - bytes_confirmed : chunk_max;
-                                        response.chunk_response.count++;
-                                        if (bytes_confirmed == node->length) {
-                                            MTOS_EVT_POST(MTOS_EVENT_SLAVE_FINISHED,node->name,sizeof(((mtos_list_t*)0)->name));
-                                            status = MTOS_SLAVE_ENDING;
-                                            break;
-                                        }
-                                    }
-                                    uint8_t* send_ptr = node->ptr;
-                                    send_ptr += bytes_confirmed;
-                                    response.chunk_response.size = bytes_to_send;
-                                    response.chunk_response.crc8 = crc8_be(0,response.raw,sizeof(mtos_header_t)-1);
-                                    mtos_send_bytes(node->pattern,&response,send_ptr,bytes_to_send);
-                                }
-                                ptr += strlen(node->pattern)+sizeof(mtos_header_t);
-                            }
-                            else {
-                                ESP_LOGI(TAG,"pattern not found!");
-                            }
-                        }
-                    }
-                    if (status == MTOS_SLAVE_ABORT) {
-                        ESP_LOGI(TAG,"error en node seleccionado => MTOS_SLAVE_ABORT");
-                    }
-                }
-                default: break;
-            }
-        }
+#if CONFIG_MTOS_CACHE
+// cache persistente: cada bloque recibido como master se guarda en <path>/<name>.mtc
+// |magic|length|size|crc32|contenido|
+#define MTOS_CACHE_MAGIC 0x3143544D // "MTC1"
 
-        if ((status == MTOS_SLAVE_ABORT)||(status == MTOS_SLAVE_ENDING)) {
-            // luego de la finalizacion o el aborto, se reinicia el estado
-            ESP_LOGI(TAG,"MTOS_SLAVE_ABORT/MTOS_SLAVE_ENDING");
-            if (node) {
-                ESP_LOGI(TAG,"smphr: %p",node->smphr);
-                xSemaphoreGive(node->smphr);
-                ESP_LOGI(TAG,"semaforo liberado");
-            }
-            MTOS_EVT_POST(MTOS_EVENT_SLAVE_RELEASED,(node?node->name:NULL),(node?sizeof(((mtos_list_t*)0)->name):0));
-            rx_bytes = 0;
-            ptr = buffer;
-            bytes_confirmed = 0;
-            bytes_to_send = 0;
-            node = NULL;
-            status = MTOS_SLAVE_IDLE;
-        }
+typedef struct {
+    uint32_t magic;
+    uint32_t length;
+    uint32_t size; // largo de cada elemento, 0 en los blobs
+    uint32_t crc32;
+} mtos_cache_header_t;
+
+static char mtos_cache_path[64] = CONFIG_MTOS_CACHE_PATH;
+
+// guarda la copia del master con el semaforo tomado, en un temporal que reemplaza al anterior ya completo
+static void mtos_cache_save(mtos_list_t* node)
+{
+    char file[sizeof(mtos_cache_path)+sizeof(((mtos_list_t*)0)->name)+8];
+    char tmp[sizeof(file)+1];
+    snprintf(file,sizeof(file),"%s/%s.mtc",mtos_cache_path,node->name);
+    snprintf(tmp,sizeof(tmp),"%s~",file);
+    FILE* f = fopen(tmp,"wb");
+    if (f == NULL) {
+        ESP_LOGI(TAG,"no se pudo crear %s",tmp);
+        return;
+    }
+    mtos_cache_header_t header = {
+        .magic = MTOS_CACHE_MAGIC,
+        .length = node->length,
+        .size = (node->blob ? 0 : node->size),
+        .crc32 = node->crc32.value,
+    };
+    bool ok = (fwrite(&header,sizeof(header),1,f) == 1);
+    size_t len;
+    for (size_t offset = 0; ok && (offset < node->length); offset += len) {
+        len = node->length-offset;
+        uint8_t* at = mtos_block_at(node,offset,&len);
+        ok = (fwrite(at,1,len,f) == len);
+    }
+    ok = (fclose(f) == 0) && ok;
+    // algunos sistemas de archivos (FAT, SPIFFS) no renombran sobre un archivo existente
+    if (ok) {
+        remove(file);
+        ok = (rename(tmp,file) == 0);
+    }
+    if (!ok) {
+        ESP_LOGI(TAG,"no se pudo guardar %s",file);
+        remove(tmp);
     }
 }
 
-static void mtos_master_task(void *pvParameters)
+// restaura la copia guardada de un bloque master recien creado, todavia fuera de la lista
+static void mtos_cache_load(mtos_list_t* node)
 {
-    char *TAG = "mtos_master";
-    TaskHandle_t slave_task_handle;
-    TaskHandle_t master_task_handle = xTaskGetCurrentTaskHandle();
-    uint8_t *buffer = (uint8_t*)malloc(MTOS_BUFFER_EFFECTIVE); // reservar bloque de datos donde se recibiran los bloques enviados por uart
-    uint8_t *ptr = buffer; // puntero a una posicion dentro del bloque reservado
-    uint8_t *acc = NULL;  // acumulador de chunks
-    size_t rx_bytes = 0; // cantidad de bytes recibidos por uart
-    size_t payload_size = 0; // cantidad de bytes totales a recibir
-    size_t payload_count = 0; // canidad de bytes recibidos
-    mtos_list_t* node = NULL; // puntero donde se cargara el nodo a procesar
-    mtos_master_status_t status = MTOS_MASTER_IDLE; // estado inicial de la maquina de estado
-    mtos_header_t extracted = {}; // variable auxiliar donde se volcaran los headers que se vayan recibiendo
-    mtos_header_t outgoing = {}; // headers que se utilizan en los mensajes de request
-    char* token = NULL; // puntero donde se asigna el string que se desea buscar en el buffer de datos recibidos
-    size_t token_len = 0; // largo del string que se desea buscar en el buffer de datos recibidos
-    assert(buffer);
-    for(;;) {
-        xTaskCreate(mtos_slave_task, "mtos_slv", 4096, (void*)master_task_handle, uxTaskPriorityGet(NULL)-1, &slave_task_handle);
-        MTOS_EVT_POST(MTOS_EVENT_MASTER_IDLE,(node?node->name:NULL),(node?sizeof(((mtos_list_t*)0)->name):0));
-        xQueueReceive(mtos_call_queue,&node,portMAX_DELAY);
-        MTOS_EVT_POST(MTOS_EVENT_MASTER_CALL,node->name,sizeof(((mtos_list_t*)0)->name));
-        ESP_LOGI(TAG,"node recibido por queue");
-        ulTaskNotifyTake(pdTRUE,portMAX_DELAY);
-        vTaskDelete(slave_task_handle); //porque no puede recibir un bloque mientras esta enviando otro
-        to = MILLIS(0);
+    char file[sizeof(mtos_cache_path)+sizeof(((mtos_list_t*)0)->name)+8];
+    snprintf(file,sizeof(file),"%s/%s.mtc",mtos_cache_path,node->name);
+    FILE* f = fopen(file,"rb");
+    if (f == NULL) {
+        return;
+    }
+    mtos_cache_header_t header = {};
+    size_t length = node->length;
+    bool ok = (fread(&header,sizeof(header),1,f) == 1) && (header.magic == MTOS_CACHE_MAGIC) &&
+        (header.size == (node->blob ? 0 : node->size)) && (node->blob || (header.length%node->size == 0)) &&
+        mtos_block_resize(node,header.length);
+    size_t len;
+    for (size_t offset = 0; ok && (offset < node->length); offset += len) {
+        len = node->length-offset;
+        uint8_t* at = mtos_block_at(node,offset,&len);
+        ok = (fread(at,1,len,f) == len);
+    }
+    fclose(f);
+    if (ok && (mtos_node_crc32(node) == header.crc32)) {
+        ESP_LOGI(TAG,"%s restaurado desde %s, %zu bytes",node->name,file,node->length);
+        return;
+    }
+    // archivo corrupto o de otro tipo de bloque, se vuelve al bloque vacio
+    ESP_LOGI(TAG,"%s descartado",file);
+    if ((node->length == length) || mtos_block_resize(node,length)) {
+        mtos_block_copy(node,0,NULL,node->length,true);
+    }
+}
+
+int mtos_set_cache_path(const char* path)
+{
+    if (strlen(path) >= sizeof(mtos_cache_path)) {
+        return -1;
+    }
+    strcpy(mtos_cache_path,path);
+    return 0;
+}
+#else
+int mtos_set_cache_path(const char* path)
+{
+    return -1;
+}
+#endif
+
+#if CONFIG_MTOS_REPLICATE
+// quedan modificaciones locales que el slave todavia no tiene
+static bool mtos_repl_dirty(mtos_list_t* node)
+{
+    return node->repl_full || (node->repl_lo < node->repl_hi) || (node->repl_length != node->length);
+}
+
+// suma [offset, offset+n) a los bytes modificados, con el semaforo tomado
+static void mtos_repl_mark(mtos_list_t* node, size_t offset, size_t n)
+{
+    if (!node->repl || (n == 0)) {
+        return;
+    }
+    if (node->repl_lo >= node->repl_hi) {
+        node->repl_lo = offset;
+        node->repl_hi = offset+n;
+    }
+    else {
+        node->repl_lo = (offset < node->repl_lo ? offset : node->repl_lo);
+        node->repl_hi = (offset+n > node->repl_hi ? offset+n : node->repl_hi);
+    }
+}
+#define MTOS_REPL_MARK(node,offset,n) mtos_repl_mark(node,offset,n)
+#else
+#define MTOS_REPL_MARK(node,offset,n) ((void)(offset),(void)(n))
+#endif
+
+// devuelve el semaforo luego de una modificacion local; en un bloque replicado encola la replicacion,
+// salvo que ya haya una en curso, que tomara estos cambios en su proxima parte
+static BaseType_t mtos_give_modified(mtos_list_t* node)
+{
+#if CONFIG_MTOS_REPLICATE
+    bool kick = node->repl && !node->repl_queued && mtos_repl_dirty(node);
+    if (kick) {
+        node->repl_queued = true;
+    }
+    BaseType_t retval = mtos_give(node);
+    if (kick) {
+        mtos_call_t call = {
+            .node = node,
+            .timeout_ms = node->repl_timeout_ms,
+            .max_chunk_size = node->repl_max_chunk_size,
+            .repl = true,
+        };
+        xQueueSend(node->inst->call_queue,&call,portMAX_DELAY);
+    }
+    return retval;
+#else
+    return mtos_give(node);
+#endif
+}
+
+static void* mtos_strlib_wrap(char name[16], void *src, size_t n, mtos_fnc_idx_t fnc)
+{
+    char *TAG = "mtos_strlib";
+    mtos_list_t* node = mtos_lookup(name);
+    if (node != NULL) {
+        void* dest;
+        void* retval = NULL;
+        bool changed = false;
+        size_t length;
+        size_t mark_lo = 0; // bytes modificados, para la replicacion
+        size_t mark_n = 0;
+        if (MTOS_SEGMENTED(node)) {
+            // las funciones de libc necesitan el bloque contiguo, ver mtos_flatten
+            ESP_LOGI(TAG,"%s esta segmentado",node->name);
+            return NULL;
+        }
+        // las funciones que solo leen no copian el buffer que este enviando el slave
+        if ((fnc == MTOS_STRCHR) || (fnc == MTOS_STRCMP) || (fnc == MTOS_STRLEN) || (fnc == MTOS_STRNCMP) ||
+            (fnc == MTOS_STRPBRK) || (fnc == MTOS_STRRCHR) || (fnc == MTOS_STRSTR)) {
+            mtos_take(node, portMAX_DELAY);
+        }
+        else {
+            mtos_take_modify(node, portMAX_DELAY);
+        }
+        dest = node->ptr;
+        ESP_LOGI(TAG,"%s's semaphore taken",node->name);
+        switch (fnc) {
+            case MTOS_STRCAT:
+                ESP_LOGI(TAG,"MTOS_STRCAT");
+                // se copia a partir del largo cacheado en lugar de buscar el final del destino
+                length = mtos_str_length(node);
+                n = strlen((const char*)src);
+                if ((length >= node->length) || (n+1 > node->length-length)) {
+                    // la cadena resultante no entra en el bloque, no se escribe nada
+                    break;
+                }
+                memcpy((char*)dest+length, src, n+1);
+                node->str_length = length+n;
+                retval = dest;
+                changed = true;
+                mark_lo = length;
+                mark_n = n+1;
+                break;
+                // char * strcat ( char * destination, const char * source );
+            case MTOS_STRCHR:
+                ESP_LOGI(TAG,"MTOS_STRCHR");
+                retval = strchr((const char*)dest, *(const char*)src);
+                break;
+                // const char * strchr ( const char * str, int character );
+            case MTOS_STRCMP:
+                ESP_LOGI(TAG,"MTOS_STRCMP");
+                retval = (void*)strcmp((const char*)dest, (const char*)src);
+                break;
+                // int strcmp ( const char * str1, const char * str2 );
+            case MTOS_STRCPY:
+                ESP_LOGI(TAG,"MTOS_STRCPY");
+                n = strlen((const char*)src);
+                retval = memcpy(dest, src, n+1);
+                node->str_length = n;
+                changed = true;
+                mark_n = n+1;
+                break;
+                // char * strcpy ( char * destination, const char * source );
+            case MTOS_STRLEN:
+                ESP_LOGI(TAG,"MTOS_STRLEN");
+                retval = (void*)mtos_str_length(node);
+                break;
+                // size_t strlen ( const char * str );
+            case MTOS_STRNCAT:
+                ESP_LOGI(TAG,"MTOS_STRNCAT");
+                length = mtos_str_length(node);
+                n = strnlen((const char*)src, n);
+                if ((length >= node->length) || (n+1 > node->length-length)) {
+                    break;
+                }
+                memcpy((char*)dest+length, src, n);
+                ((char*)dest)[length+n] = '\0';
+                node->str_length = length+n;
+                retval = dest;
+                changed = true;
+                mark_lo = length;
+                mark_n = n+1;
+                break;
+                // char * strncat ( char * destination, const char * source, size_t num );
+            case MTOS_STRNCMP:
+                ESP_LOGI(TAG,"MTOS_STRNCMP");
+                retval = (void*)strncmp((const char*)dest, (const char*)src, n);
+                break;
+                // int strncmp ( const char * str1, const char * str2, size_t num );
+            case MTOS_STRNCPY:
+                ESP_LOGI(TAG,"MTOS_STRNCPY");
+                retval = strncpy((char*)dest, (const char*)src, n);
+                // si src no entra en n bytes el destino no queda terminado en n
+                length = strnlen((const char*)src, n);
+                node->str_length = (length < n ? length : MTOS_STRLEN_UNKNOWN);
+                changed = true;
+                mark_n = n;
+                break;
+                // char * strncpy ( char * destination, const char * source, size_t num );
+            case MTOS_STRPBRK:
+                ESP_LOGI(TAG,"MTOS_STRPBRK");
+                retval = strpbrk((const char*)dest, (const char*)src);
+                break;
+                // const char * strpbrk ( const char * str1, const char * str2 );
+            case MTOS_STRRCHR:
+                ESP_LOGI(TAG,"MTOS_STRPBRK");
+                retval = strrchr((const char*)dest, *(const char*)src);
+                break;
+                // const char * strrchr ( const char * str, int character );
+            case MTOS_STRSTR:
+                retval = strstr((const char*)dest, (const char*)src);
+                break;
+                // const char * strstr ( const char * str1, const char * str2 );
+            case MTOS_STRTOK:
+                ESP_LOGI(TAG,"MTOS_STRTOK");
+                retval = strtok((char*)dest, (const char*)src);
+                node->str_length = MTOS_STRLEN_UNKNOWN;
+                changed = true;
+                // los delimitadores reemplazados pueden estar en cualquier parte de la cadena
+                mark_n = node->length;
+                break;
+                // char * strtok ( char * str, const char * delimiters );
+            case MTOS_MEMSET:
+                ESP_LOGI(TAG,"MTOS_MEMSET");
+                retval = memset(dest, *(int*)src, n);
+                node->str_length = ((n > 0) && ((uint8_t)*(int*)src == 0) ? 0 : MTOS_STRLEN_UNKNOWN);
+                changed = true;
+                mark_n = n;
+                break;
+                //void * memset ( void * ptr, int value, size_t num );
+            case MTOS_MEMCPY:
+                ESP_LOGI(TAG,"MTOS_MEMCPY");
+                retval = memcpy(dest, src, n);
+                node->str_length = MTOS_STRLEN_UNKNOWN;
+                changed = true;
+                mark_n = n;
+                break;
+                // void * memcpy ( void * destination, const void * source, size_t num );
+            case MTOS_MEMMOVE:
+                ESP_LOGI(TAG,"MTOS_MEMMOVE");
+                retval = memmove(dest, src, n);
+                node->str_length = MTOS_STRLEN_UNKNOWN;
+                changed = true;
+                mark_n = n;
+                break;
+                //void * memmove ( void * destination, const void * source, size_t num );
+        }
+        if (changed) {
+            // el crc32 se recalcula recien cuando se sirve el bloque, asi un append no recorre todo el blob
+            node->crc_stale = true;
+            MTOS_REPL_MARK(node,mark_lo,mark_n);
+        }
+        mtos_give_modified(node);
+        ESP_LOGI(TAG,"%s's semaphore given",node->name);
+        return retval;
+    }
+    return NULL;
+
+}
+
+#if CONFIG_MTOS_STATIC
+static mtos_list_t mtos_node_pool[CONFIG_MTOS_STATIC_BLOCKS];
+static size_t mtos_node_pool_used = 0; // los bloques no se eliminan, el pool solo crece
+#endif
+
+// nodo nuevo en cero, del pool estatico o del heap
+static mtos_list_t* mtos_node_alloc(void)
+{
+#if CONFIG_MTOS_STATIC
+    if (mtos_node_pool_used >= CONFIG_MTOS_STATIC_BLOCKS) {
+        return NULL;
+    }
+    mtos_list_t* node = &mtos_node_pool[mtos_node_pool_used++];
+    memset(node,0,sizeof(mtos_list_t));
+    return node;
+#else
+    return (mtos_list_t*)calloc(1,sizeof(mtos_list_t));
+#endif
+}
+
+// devuelve un nodo que no llego a agregarse a la lista
+static void mtos_node_free(mtos_list_t* node)
+{
+#if CONFIG_MTOS_STATIC
+    if (node == &mtos_node_pool[mtos_node_pool_used-1]) {
+        mtos_node_pool_used--;
+    }
+#else
+    free(node);
+#endif
+}
+
+static SemaphoreHandle_t mtos_node_mutex(mtos_list_t* node)
+{
+#if CONFIG_MTOS_STATIC
+    return xSemaphoreCreateMutexStatic(&node->smphr_buf);
+#else
+    return xSemaphoreCreateMutex();
+#endif
+}
+
+static int mtos_new_blob_node(mtos_instance_t* inst, char name[16], size_t length, uint8_t slave, char trigger[8], char pattern[8], bool segmented, void* buffer)
+{
+    //Use for blobs
+    ESP_LOGI(TAG,"mtos_new_blob");
+    if (inst == NULL) {
+        inst = &mtos_default;
+    }
+    if (mtos_lookup(name) != NULL) {
+        ESP_LOGI(TAG,"name already as entry in the list");
+        return -3; //return -3 to tell name already exists
+    }
+    // el indice cuenta los bloques de todas las instancias
+    size_t entries = 0;
+    for (mtos_instance_t* other = mtos_instances; other != NULL; other = other->next) {
+        for (mtos_list_t* current_node = other->list_head; current_node != NULL; current_node = current_node->next) {
+            entries++;
+        }
+    }
+    mtos_list_t* current_node = NULL;
+    if (entries) {
+        ESP_LOGI(TAG,"%zu entr%s in the list",entries,(entries == 1 ? "\b\b\b\b\b\bone entry" : "ies"));
+    }
+    else {
+        ESP_LOGI(TAG,"the list is empty");
+    }
+    mtos_list_t* new_node = mtos_node_alloc();
+    if (new_node) {
+        new_node->index = entries;
+        ESP_LOGI(TAG,"node malloc ok");
+        new_node->size = 0;
+        new_node->length = length;
+        new_node->blob = true;
+        new_node->slave = slave;
+        new_node->inst = inst;
+        mtos_node_tokens(new_node,trigger,pattern);
+        memset(new_node->crc32.raw,0,sizeof(((mtos_crc32_t*)0)->raw));
+        strcpy(new_node->name,name);
+        bool allocated;
+#if CONFIG_MTOS_SEGMENTS
+        new_node->segmented = segmented;
+        if (segmented) {
+            allocated = mtos_seg_resize(new_node,new_node->length);
+        }
+        else
+#endif
+        if (buffer) {
+            // el contenido del buffer es el valor inicial del bloque
+            new_node->ptr = buffer;
+            new_node->external = true;
+            new_node->capacity = length;
+            allocated = true;
+        }
+        else {
+            new_node->ptr = malloc(new_node->length);
+            allocated = (new_node->ptr != NULL);
+        }
+        if (allocated) {
+            ESP_LOGI(TAG,"mb malloc ok");
+            new_node->smphr = mtos_node_mutex(new_node);
+            new_node->next = NULL;
+
+#if CONFIG_MTOS_CACHE
+            if (!new_node->slave) {
+                mtos_cache_load(new_node);
+            }
+#endif
+            new_node->crc32.value = mtos_node_crc32(new_node);
+            new_node->str_length = MTOS_STRLEN_UNKNOWN;
+            
+            entries = 0;
+            if (inst->list_head) {
+                current_node = inst->list_head;
+                while (current_node->next != NULL) {
+                    current_node = current_node->next;
+                    entries++;
+                }
+                ESP_LOGI(TAG,"node placed in list at #%zu",entries);
+                current_node->next = new_node;
+            }
+            else {
+                ESP_LOGI(TAG,"list initied");
+                inst->list_head = new_node;
+            }
+            ESP_LOGI(TAG,"node: {\n"
+                "   .ptr: *(%p) = %.*s...,\n"
+                "   .size: %zu,\n"
+                "   .length: %zu,\n"
+                "   .blob: %s,\n"
+                "   .slave: %02X,\n"
+                "   .crc32: %08" PRIX32 ",\n"
+                "   .trigger: %s,\n"
+                "   .pattern: %s,\n"
+                "   .name: %s,\n"
+                "}\n",new_node->ptr,5,(new_node->ptr ? (char*)new_node->ptr : ""),
+                new_node->size,new_node->length,
+                new_node->blob ? "true" : "false",
+                new_node->slave,
+                new_node->crc32.value,new_node->trigger,
+                new_node->pattern,new_node->name
+            );
+        }
+        else {
+            ESP_LOGI(TAG,"mb alloc error");
+#if CONFIG_MTOS_SEGMENTS
+            mtos_seg_free(new_node);
+#endif
+            mtos_node_free(new_node);
+            return -2;
+        }
+    }
+    else {
+        ESP_LOGI(TAG,"node alloc error");
+        return -1;
+    }
+    return 0;
+}
+
+int mtos_new_blob(char name[16], size_t length, uint8_t slave, char trigger[8], char pattern[8])
+{
+    return mtos_new_blob_node(NULL,name,length,slave,trigger,pattern,false,NULL);
+}
+
+int mtos_instance_new_blob(mtos_instance_t* inst, char name[16], size_t length, uint8_t slave, char trigger[8], char pattern[8])
+{
+    return mtos_new_blob_node(inst,name,length,slave,trigger,pattern,false,NULL);
+}
+
+int mtos_new_segmented_blob(char name[16], size_t length, uint8_t slave, char trigger[8], char pattern[8])
+{
+    return mtos_new_blob_node(NULL,name,length,slave,trigger,pattern,true,NULL);
+}
+
+int mtos_instance_new_segmented_blob(mtos_instance_t* inst, char name[16], size_t length, uint8_t slave, char trigger[8], char pattern[8])
+{
+    return mtos_new_blob_node(inst,name,length,slave,trigger,pattern,true,NULL);
+}
+
+int mtos_instance_new_static_blob(mtos_instance_t* inst, char name[16], void* buffer, size_t capacity, uint8_t slave, char trigger[8], char pattern[8])
+{
+    if ((buffer == NULL) || (capacity == 0)) {
+        return -2;
+    }
+    return mtos_new_blob_node(inst,name,capacity,slave,trigger,pattern,false,buffer);
+}
+
+int mtos_new_static_blob(char name[16], void* buffer, size_t capacity, uint8_t slave, char trigger[8], char pattern[8])
+{
+    return mtos_instance_new_static_blob(NULL,name,buffer,capacity,slave,trigger,pattern);
+}
+
+static int mtos_new_array_node(mtos_instance_t* inst, char name[16], size_t n, size_t size, uint8_t slave, char trigger[8], char pattern[8], void* buffer)
+{
+    //Use for arrays
+    ESP_LOGI(TAG,"mtos_new_array");
+    if (inst == NULL) {
+        inst = &mtos_default;
+    }
+    if (mtos_lookup(name) != NULL) {
+        ESP_LOGI(TAG,"name already as entry in the list");
+        return -3; //return -3 to indicate name already exists
+    }
+    // el indice cuenta los bloques de todas las instancias
+    size_t entries = 0;
+    for (mtos_instance_t* other = mtos_instances; other != NULL; other = other->next) {
+        for (mtos_list_t* current_node = other->list_head; current_node != NULL; current_node = current_node->next) {
+            entries++;
+        }
+    }
+    mtos_list_t* current_node = NULL;
+    if (entries) {
+        ESP_LOGI(TAG,"%zu entr%s in the list",entries,(entries == 1 ? "\b\b\b\b\b\bone entry" : "ies"));
+    }
+    else {
+        ESP_LOGI(TAG,"the list is empty");
+    }
+    mtos_list_t* new_node = mtos_node_alloc();
+    if (new_node) {
+        new_node->index = entries;
+        ESP_LOGI(TAG,"node malloc ok");
+        ESP_LOGI(TAG,"node: %p",new_node);
+        new_node->size = size;
+        new_node->length = n*size;
+        new_node->blob = false;
+        new_node->slave = slave;
+        new_node->inst = inst;
+        mtos_node_tokens(new_node,trigger,pattern);
+        memset(new_node->crc32.raw,0,sizeof(((mtos_crc32_t*)0)->raw));
+        strcpy(new_node->name,name);
+        if (buffer) {
+            // los elementos del buffer son el valor inicial del bloque
+            new_node->ptr = buffer;
+            new_node->external = true;
+            new_node->capacity = n*size;
+        }
+        else {
+            new_node->ptr = calloc(n,size);
+        }
+        if (new_node->ptr) {
+            ESP_LOGI(TAG,"array calloc ok");
+            new_node->smphr = mtos_node_mutex(new_node);
+            new_node->next = NULL;
+
+#if CONFIG_MTOS_CACHE
+            if (!new_node->slave) {
+                mtos_cache_load(new_node);
+            }
+#endif
+            new_node->crc32.value = mtos_node_crc32(new_node);
+            new_node->str_length = MTOS_STRLEN_UNKNOWN;
+            
+            entries = 0;
+            if (inst->list_head) {
+                current_node = inst->list_head;
+                while (current_node->next != NULL) {
+                    current_node = current_node->next;
+                }
+                ESP_LOGI(TAG,"node placed in list at #%zu",entries);
+                current_node->next = new_node;
+            }
+            else {
+                ESP_LOGI(TAG,"list initied");
+                inst->list_head = new_node;
+            }
+            ESP_LOGI(TAG,"node: {\n"
+                "   .ptr: *(%p) = %.*s...,\n"
+                "   .size: %zu,\n"
+                "   .length: %zu,\n"
+                "   .blob: %s,\n"
+                "   .slave: %02X,\n"
+                "   .crc32: %08" PRIX32 ",\n"
+                "   .trigger: %s,\n"
+                "   .pattern: %s,\n"
+                "   .name: %s,\n"
+                "}\n",new_node->ptr,5,(char*)new_node->ptr,
+                new_node->size,new_node->length,
+                new_node->blob ? "true" : "false",
+                new_node->slave,
+                new_node->crc32.value,new_node->trigger,
+                new_node->pattern,new_node->name
+            );
+        }
+        else {
+            ESP_LOGI(TAG,"array alloc error");
+            mtos_node_free(new_node);
+            return -2;
+        }
+    }
+    else {
+        ESP_LOGI(TAG,"node alloc error");
+        return -1;
+    }
+    return 0;
+}
+
+int mtos_instance_new_array(mtos_instance_t* inst, char name[16], size_t n, size_t size, uint8_t slave, char trigger[8], char pattern[8])
+{
+    return mtos_new_array_node(inst,name,n,size,slave,trigger,pattern,NULL);
+}
+
+int mtos_new_array(char name[16], size_t n, size_t size, uint8_t slave, char trigger[8], char pattern[8])
+{
+    return mtos_instance_new_array(NULL,name,n,size,slave,trigger,pattern);
+}
+
+int mtos_instance_new_static_array(mtos_instance_t* inst, char name[16], void* buffer, size_t n, size_t size, uint8_t slave, char trigger[8], char pattern[8])
+{
+    if ((buffer == NULL) || (n*size == 0)) {
+        return -2;
+    }
+    return mtos_new_array_node(inst,name,n,size,slave,trigger,pattern,buffer);
+}
+
+int mtos_new_static_array(char name[16], void* buffer, size_t n, size_t size, uint8_t slave, char trigger[8], char pattern[8])
+{
+    return mtos_instance_new_static_array(NULL,name,buffer,n,size,slave,trigger,pattern);
+}
+
+int mtos_grab_mb(char name[16], TickType_t ticks, void** ptr, size_t* length)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node != NULL) {
+        if (MTOS_SEGMENTED(node)) {
+            // no hay vista contigua de un blob segmentado sin pedirla con mtos_flatten
+            return -3;
+        }
+        if (mtos_take_modify(node, ticks) == pdTRUE) {
+                *ptr = node->ptr;
+                *length = node->length;
+                return 0;
+        }
+        else {
+            return -2;
+        }
+
+    }
+    else {
+        return -1;
+    }
+}
+
+int mtos_grab_mb_ro(char name[16], TickType_t ticks, const void** ptr, size_t* length)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node != NULL) {
+        if (MTOS_SEGMENTED(node)) {
+            return -3;
+        }
+        // solo lectura: se comparte el buffer que este enviando el slave, no se copia
+        if (mtos_take(node, ticks) == pdTRUE) {
+            *ptr = node->ptr;
+            *length = node->length;
+            return 0;
+        }
+        else {
+            return -2;
+        }
+    }
+    else {
+        return -1;
+    }
+}
+
+int mtos_return_mb_range(char name[16], size_t offset, size_t n)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node != NULL) {
+        int retval = 0;
+        if ((offset > node->length) || (n > node->length-offset)) {
+            // el bloque se devuelve igual, como modificado por completo
+            offset = 0;
+            n = node->length;
+            retval = -3;
+        }
+        node->crc32.value = mtos_node_crc32(node);
+        node->crc_stale = false;
+        node->str_length = MTOS_STRLEN_UNKNOWN;
+        MTOS_REPL_MARK(node,offset,n);
+        if (mtos_give_modified(node) != pdTRUE) {
+            retval = -2;
+        }
+        return retval;
+    }
+    else {
+        return -1;
+    }
+}
+
+int mtos_return_mb(char name[16])
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node != NULL) {
+        return mtos_return_mb_range(name,0,node->length);
+    }
+    else {
+        return -1;
+    }
+}
+
+int mtos_release_mb(char name[16])
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node != NULL) {
+        // el bloque no se modifico, no hace falta recalcular el crc
+        if (mtos_give(node) == pdTRUE) {
+            return 0;
+        }
+        else {
+            return -2;
+        }
+    }
+    else {
+        return -1;
+    }
+}
+
+int mtos_resize(char name[16], size_t n)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    int retval = -2;
+    if (node != NULL) {
+        retval = -1;
+        mtos_take_modify(node, portMAX_DELAY);
+        size_t length = node->length;
+        if (mtos_block_resize(node,n)) {
+            retval = 0;
+            node->crc32.value = mtos_node_crc32(node);
+            node->crc_stale = false;
+            node->str_length = MTOS_STRLEN_UNKNOWN;
+            if (n > length) {
+                MTOS_REPL_MARK(node,length,n-length);
+            }
+        }
+        mtos_give_modified(node);
+    }
+    return retval;
+}
+
+int mtos_append(char name[16], const void* src, size_t n)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node == NULL) {
+        return -1;
+    }
+    int retval = -2;
+    mtos_take_modify(node, portMAX_DELAY);
+    size_t length = node->length;
+    if (mtos_block_resize(node,length+n)) {
+        retval = 0;
+        mtos_block_copy(node,length,(void*)src,n,true);
+        // si el bloque no tenia terminador la cadena sigue hasta el primer nulo de lo agregado
+        if (node->str_length == length) {
+            node->str_length = length+strnlen((const char*)src,n);
+        }
+        // el crc32 se difiere como en las funciones de cadena
+        node->crc_stale = true;
+        MTOS_REPL_MARK(node,length,n);
+    }
+    mtos_give_modified(node);
+    return retval;
+}
+
+int mtos_read_at(char name[16], void* dst, size_t offset, size_t n)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node == NULL) {
+        return -1;
+    }
+    int retval = -3;
+    mtos_take(node, portMAX_DELAY);
+    if ((offset <= node->length) && (n <= node->length-offset)) {
+        retval = 0;
+        mtos_block_copy(node,offset,dst,n,false);
+    }
+    mtos_give(node);
+    return retval;
+}
+
+int mtos_write_at(char name[16], const void* src, size_t offset, size_t n)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node == NULL) {
+        return -1;
+    }
+    int retval = -3;
+    mtos_take_modify(node, portMAX_DELAY);
+    if ((offset <= node->length) && (n <= node->length-offset)) {
+        retval = 0;
+        mtos_block_copy(node,offset,(void*)src,n,true);
+        node->str_length = MTOS_STRLEN_UNKNOWN;
+        node->crc_stale = true;
+        MTOS_REPL_MARK(node,offset,n);
+    }
+    mtos_give_modified(node);
+    return retval;
+}
+
+int mtos_flatten(char name[16])
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node == NULL) {
+        return -1;
+    }
+    int retval = 0;
+#if CONFIG_MTOS_SEGMENTS
+    mtos_take(node, portMAX_DELAY);
+    if (node->segmented) {
+        // unica copia del blob completo, a partir de aca se comporta como un blob comun
+        void* ptr = malloc(node->length ? node->length : 1);
+        if (ptr) {
+            mtos_block_copy(node,0,ptr,node->length,false);
+            mtos_seg_free(node);
+            node->segmented = false;
+            node->ptr = ptr;
+        }
+        else {
+            retval = -2;
+        }
+    }
+    mtos_give(node);
+#endif
+    return retval;
+}
+
+char* mtos_strcat(char name[16], const char* src)
+{
+    // char * strcat ( char * destination, const char * source );
+    return (char*)mtos_strlib_wrap(name, (void*)src, 0, MTOS_STRCAT);
+}
+
+const char* mtos_strchr(char name[16], char const chr)
+{
+    // const char * strchr ( const char * str, int character );
+    return (const char*)mtos_strlib_wrap(name, (void*)(&chr), 0, MTOS_STRCHR);
+}
+
+int mtos_strcmp(char name[16], const char* src)
+{
+    // int strcmp ( const char * str1, const char * str2 );
+    return (int)mtos_strlib_wrap(name, (void*)src, 0, MTOS_STRCMP);
+}
+
+char* mtos_strcpy(char name[16], const char* src)
+{
+    // char * strcpy ( char * destination, const char * source );
+    return (char*)mtos_strlib_wrap(name, (void*)src, 0, MTOS_STRCPY);
+}
+
+size_t mtos_strlen(char name[16])
+{
+    // size_t strlen ( const char * str );
+    return (size_t)mtos_strlib_wrap(name, NULL, 0, MTOS_STRLEN);
+}
+
+char* mtos_strncat(char name[16], const char* src, size_t n)
+{
+    // char * strncat ( char * destination, const char * source, size_t num );
+    return (char*)mtos_strlib_wrap(name, (void*)src, n, MTOS_STRNCAT);
+}
+
+int mtos_strncmp(char name[16], const char* src, size_t n)
+{
+    // int strncmp ( const char * str1, const char * str2, size_t num );
+    return (int)mtos_strlib_wrap(name, (void*)src, n, MTOS_STRNCMP);
+}
+
+char* mtos_strncpy(char name[16], const char* src, size_t n)
+{
+    // char * strncpy ( char * destination, const char * source, size_t num );
+    return (char*)mtos_strlib_wrap(name, (void*)src, n, MTOS_STRNCPY);
+}
+
+const char * mtos_strpbrk(char name[16], const char* src)
+{
+    // const char * strpbrk ( const char * str1, const char * str2 );
+    return (const char *)mtos_strlib_wrap(name, (void*)src, 0, MTOS_STRPBRK);
+}
+
+const char * mtos_strrchr(char name[16], char const chr)
+{
+    // const char * strrchr ( const char * str, int character );
+    return (const char *)mtos_strlib_wrap(name, (void*)(&chr), 0,MTOS_STRRCHR);
+}
+
+const char * mtos_strstr(char name[16], const char* src)
+{
+    // const char * strstr ( const char * str1, const char * str2 );
+    return (const char * )mtos_strlib_wrap(name, (void*)src, 0,MTOS_STRSTR);
+}
+
+char * mtos_strtok(char name[16], const char* src)
+{
+    // char * strtok ( char * str, const char * delimiters );
+    return (char *)mtos_strlib_wrap(name, (void*)src, 0, MTOS_STRTOK);
+}
+
+void* mtos_memset(char name[16], char const chr, size_t n)
+{
+    //void * memset ( void * ptr, int value, size_t num );
+    return (void*)mtos_strlib_wrap(name, (void*)(&chr), n, MTOS_MEMSET);
+}
+
+void* mtos_memcpy(char name[16], const void* src, size_t n)
+{
+    // void * memcpy ( void * destination, const void * source, size_t num );
+    return (void*)mtos_strlib_wrap(name, (void*)src, n, MTOS_MEMCPY);
+}
+
+void* mtos_memmove(char name[16], const void* src, size_t n)
+{
+    //void * memmove ( void * destination, const void * source, size_t num );
+    return (void*)mtos_strlib_wrap(name, (void*)src, n, MTOS_MEMMOVE);
+}
+
+int mtos_get_length(char name[16])
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node != NULL) {
+        return node->length;
+    }
+    return -1;
+}
+
+int mtos_borrow_element(char name[16], void* element, size_t index)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node != NULL) {
+        if(!node->blob) {
+            size_t raw_idx = index*node->size;
+            if (raw_idx < node->length) {
+                mtos_take(node, portMAX_DELAY);
+                memcpy(element,node->ptr+raw_idx,node->size);
+                mtos_give(node);
+                return 0;
+            }
+            else {
+                return -3;
+            }
+        }
+        else {
+            return -2;
+        }
+    }
+    else {
+        return -1;
+    }
+}
+
+int mtos_return_element(char name[16], void* element, size_t index)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node != NULL) {
+        if(!node->blob) {
+            size_t raw_idx = index*node->size;
+            if (raw_idx < node->length) {
+                mtos_take_modify(node, portMAX_DELAY);
+                memcpy(node->ptr+raw_idx,element,node->size);
+                node->crc32.value = mtos_node_crc32(node);
+                node->crc_stale = false;
+                node->str_length = MTOS_STRLEN_UNKNOWN;
+                MTOS_REPL_MARK(node,raw_idx,node->size);
+                mtos_give_modified(node);
+                return 0;
+            }
+            else {
+                return -3;
+            }
+        }
+        else {
+            return -2;
+        }
+    }
+    else {
+        return -1;
+    }
+}
+
+// verifica que [first, first+stride*(count-1)] sean elementos validos del array; se llama con el semaforo
+// tomado, el largo puede cambiar mientras tanto por una transferencia o un resize
+static int mtos_elements_check(mtos_list_t* node, size_t first, size_t count, size_t stride)
+{
+    size_t n = node->length/node->size;
+    if ((stride == 0) || (first >= n && count) || (count && ((count-1) > (n-1-first)/stride))) {
+        return -3;
+    }
+    return 0;
+}
+
+int mtos_gather_elements(char name[16], void* dst, size_t first, size_t count, size_t stride)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node == NULL) {
+        return -1;
+    }
+    if (node->blob) {
+        return -2;
+    }
+    mtos_take(node, portMAX_DELAY);
+    int retval = mtos_elements_check(node,first,count,stride);
+    if ((retval == 0) && count) {
+        uint8_t* src = (uint8_t*)node->ptr+first*node->size;
+        if (stride == 1) {
+            memcpy(dst,src,count*node->size);
+        }
+        else {
+            for (size_t i = 0; i < count; i++) {
+                memcpy((uint8_t*)dst+i*node->size,src+i*stride*node->size,node->size);
+            }
+        }
+    }
+    mtos_give(node);
+    return retval;
+}
+
+int mtos_scatter_elements(char name[16], const void* src, size_t first, size_t count, size_t stride)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node == NULL) {
+        return -1;
+    }
+    if (node->blob) {
+        return -2;
+    }
+    mtos_take_modify(node, portMAX_DELAY);
+    int retval = mtos_elements_check(node,first,count,stride);
+    if ((retval == 0) && count) {
+        uint8_t* dst = (uint8_t*)node->ptr+first*node->size;
+        if (stride == 1) {
+            memcpy(dst,src,count*node->size);
+        }
+        else {
+            for (size_t i = 0; i < count; i++) {
+                memcpy(dst+i*stride*node->size,(const uint8_t*)src+i*node->size,node->size);
+            }
+        }
+        node->crc32.value = mtos_node_crc32(node);
+        node->crc_stale = false;
+        node->str_length = MTOS_STRLEN_UNKNOWN;
+        MTOS_REPL_MARK(node,first*node->size,((count-1)*stride+1)*node->size);
+        mtos_give_modified(node);
+    }
+    else {
+        mtos_give(node);
+    }
+    return retval;
+}
+
+int mtos_borrow_elements(char name[16], void* dst, size_t first, size_t count)
+{
+    return mtos_gather_elements(name,dst,first,count,1);
+}
+
+int mtos_return_elements(char name[16], const void* src, size_t first, size_t count)
+{
+    return mtos_scatter_elements(name,src,first,count,1);
+}
+
+int mtos_for_each_element(char name[16], size_t first, size_t count, mtos_element_cb_t cb, void* user_data)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node == NULL) {
+        return -1;
+    }
+    if (node->blob) {
+        return -2;
+    }
+    mtos_take(node, portMAX_DELAY);
+    int retval = mtos_elements_check(node,first,count,1);
+    bool modified = false;
+    size_t i = 0;
+    // mientras el slave envia desde el buffer del bloque, el callback trabaja sobre una copia del elemento;
+    // el bloque se copia recien con la primera modificacion, un recorrido de solo lectura no lo copia
+    uint8_t* scratch = NULL;
+    if ((retval == 0) && count && MTOS_SNAP_SHARED(node) && ((scratch = malloc(node->size)) == NULL)) {
+        retval = -4;
+    }
+    while ((retval == 0) && (i < count)) {
+        uint8_t* element = (uint8_t*)node->ptr+(first+i)*node->size;
+        if (scratch != NULL) {
+            memcpy(scratch,element,node->size);
+        }
+        int action = cb((scratch != NULL ? scratch : element),first+i,user_data);
+        i++;
+        if ((action & MTOS_EACH_MODIFIED) && (scratch != NULL)) {
+            if (!MTOS_SNAP_DETACH(node)) {
+                // sin memoria para copiar el bloque se descarta la modificacion, la primera del recorrido
+                retval = -4;
+                break;
+            }
+            memcpy((uint8_t*)node->ptr+(first+i-1)*node->size,scratch,node->size);
+            free(scratch);
+            scratch = NULL;
+        }
+        modified |= (action & MTOS_EACH_MODIFIED);
+        if (action & MTOS_EACH_STOP) {
+            break;
+        }
+    }
+    free(scratch);
+    if (modified) {
+        node->crc32.value = mtos_node_crc32(node);
+        node->crc_stale = false;
+        node->str_length = MTOS_STRLEN_UNKNOWN;
+        MTOS_REPL_MARK(node,first*node->size,i*node->size);
+        mtos_give_modified(node);
+    }
+    else {
+        mtos_give(node);
+    }
+    return (retval == 0 ? (int)i : retval);
+}
+
+int mtos_get_stats(char name[16], mtos_stats_t* stats)
+{
+#if CONFIG_MTOS_STATS
+    mtos_list_t* node = mtos_lookup(name);
+    if (node != NULL) {
+        mtos_stats_copy(stats,&node->stats);
+        return 0;
+    }
+    else {
+        return -1;
+    }
+#else
+    return -2;
+#endif
+}
+
+int mtos_get_link_stats(mtos_stats_t* stats)
+{
+#if CONFIG_MTOS_STATS
+    mtos_stats_copy(stats,&mtos_link_stats);
+    return 0;
+#else
+    return -2;
+#endif
+}
+
+int mtos_reset_stats(char name[16])
+{
+#if CONFIG_MTOS_STATS
+    mtos_stats_t* target = &mtos_link_stats;
+    if (name != NULL) {
+        mtos_list_t* node = mtos_lookup(name);
+        if (node == NULL) {
+            return -1;
+        }
+        target = &node->stats;
+    }
+    portENTER_CRITICAL(&mtos_stats_mux);
+    memset(target,0,sizeof(mtos_stats_t));
+    portEXIT_CRITICAL(&mtos_stats_mux);
+    return 0;
+#else
+    return -2;
+#endif
+}
+
+size_t mtos_trace_dump(void* dst, size_t size)
+{
+#if CONFIG_MTOS_TRACE
+    mtos_trace_header_t header = {
+        .magic = {'M','T','T','R'},
+        .version = 1,
+        .record_size = sizeof(mtos_trace_record_t),
+    };
+    for (mtos_instance_t* inst = mtos_instances; inst != NULL; inst = inst->next) {
+        for (mtos_list_t* node = inst->list_head; node != NULL; node = node->next) {
+            header.block_count++;
+        }
+    }
+    portENTER_CRITICAL(&mtos_trace_mux);
+    uint32_t head = mtos_trace_head;
+    portEXIT_CRITICAL(&mtos_trace_mux);
+    header.record_count = (head < CONFIG_MTOS_TRACE_DEPTH ? head : CONFIG_MTOS_TRACE_DEPTH);
+    size_t names_size = header.block_count*sizeof(((mtos_list_t*)0)->name);
+    size_t required = sizeof(mtos_trace_header_t)+names_size+header.record_count*sizeof(mtos_trace_record_t);
+    if (dst == NULL) {
+        return required;
+    }
+    if (size < sizeof(mtos_trace_header_t)+names_size) {
+        return 0;
+    }
+    if (size < required) {
+        // se conservan los registros mas recientes que entren en el destino
+        header.record_count = (size-sizeof(mtos_trace_header_t)-names_size)/sizeof(mtos_trace_record_t);
+    }
+    uint8_t* out = (uint8_t*)dst+sizeof(mtos_trace_header_t);
+    // el indice de cada bloque es unico entre todas las instancias
+    for (mtos_instance_t* inst = mtos_instances; inst != NULL; inst = inst->next) {
+        for (mtos_list_t* node = inst->list_head; node != NULL; node = node->next) {
+            if (node->index < header.block_count) memcpy(out+node->index*sizeof(((mtos_list_t*)0)->name),node->name,sizeof(((mtos_list_t*)0)->name));
+        }
+    }
+    out += names_size;
+    mtos_trace_record_t* records = (mtos_trace_record_t*)out;
+    portENTER_CRITICAL(&mtos_trace_mux);
+    head = mtos_trace_head;
+    for (uint32_t i = 0; i < header.record_count; i++) {
+        records[i] = mtos_trace_ring[(head-header.record_count+i)%CONFIG_MTOS_TRACE_DEPTH];
+    }
+    portEXIT_CRITICAL(&mtos_trace_mux);
+    header.dropped = head-header.record_count;
+    memcpy(dst,&header,sizeof(mtos_trace_header_t));
+    return sizeof(mtos_trace_header_t)+names_size+header.record_count*sizeof(mtos_trace_record_t);
+#else
+    return 0;
+#endif
+}
+
+void mtos_trace_clear(void)
+{
+#if CONFIG_MTOS_TRACE
+    portENTER_CRITICAL(&mtos_trace_mux);
+    mtos_trace_head = 0;
+    portEXIT_CRITICAL(&mtos_trace_mux);
+#endif
+}
+
+#define MILLIS(ini) (((uint32_t)(portTICK_PERIOD_MS*xTaskGetTickCount()))-ini)
+#define MTOS_PORT CONFIG_MTOS_UART_PORT
+#define MTOS_BUFFER_EFFECTIVE (((CONFIG_MTOS_BUFFER_SIZE)&(0xFFFFFF))+CONFIG_MTOS_BUFFER_LEGACY)
+#define MTOS_BUFFER_AVAILABLE ((CONFIG_MTOS_BUFFER_SIZE)&(0xFFFFFF))
+// un byte de codigo COBS cada 254 bytes: el chunk se achica para que la trama no supere a la de token
+#define MTOS_FRAME_CHUNK_MAX (MTOS_BUFFER_AVAILABLE-MTOS_BUFFER_AVAILABLE/254-2)
+#if CONFIG_MTOS_BUS
+// en un bus el slave escucha las transferencias de los demas equipos y tiene que descartarlas
+// al ritmo de la linea, no de a pocos bytes por lectura
+#define MTOS_BUFFER_SLAVE MTOS_BUFFER_EFFECTIVE
+#else
+#define MTOS_BUFFER_SLAVE (2*CONFIG_MTOS_BUFFER_LEGACY+CONFIG_MTOS_REMOTE_OP_MAX+sizeof(mtos_crc32_t)) // el trigger de una operacion remota lleva el operando
+#endif
+#define MTOS_REACTOR_TICKS ((CONFIG_MTOS_UART_STEP_MS/portTICK_PERIOD_MS) ? (CONFIG_MTOS_UART_STEP_MS/portTICK_PERIOD_MS) : 1) // espera del reactor cuando un paso no trae novedades
+#define MTOS_STALL_MS (10*CONFIG_MTOS_UART_STEP_MS) // espera minima sin bytes nuevos antes de pedir una retransmision
+// ni el master ni la linea recibieron bytes en ms milisegundos (la linea puede estar transmitiendo un chunk largo)
+#define MTOS_STALLED(inst,ts,ms) ((MILLIS(ts) > (ms)) && (MILLIS((inst)->uart_rx_ts) > (ms)))
+#define MTOS_RTO_MIN_MS (3*CONFIG_MTOS_UART_STEP_MS) // el reactor no distingue esperas de menos de unos pocos pasos
+#define MTOS_EVT_POST(inst,x,y,z) esp_event_post_to((inst)->loop_handle,MTOS_EVENTS,x,y,z,CONFIG_MTOS_UART_STEP_MS/portTICK_PERIOD_MS)
+#define MTOS_REACTOR_STACK 4096
+#define MTOS_POLL_STACK 2048
+
+#if CONFIG_MTOS_STATIC
+// todo lo que una instancia reservaria en el heap, con tamaño fijo
+typedef struct mtos_storage {
+    StaticQueue_t call_queue;
+    uint8_t call_queue_items[CONFIG_MTOS_CALL_QUEUE_LENGTH*sizeof(mtos_call_t)];
+    StaticTask_t reactor_tcb;
+    StackType_t reactor_stack[MTOS_REACTOR_STACK];
+    StaticTask_t poll_tcb;
+    StackType_t poll_stack[MTOS_POLL_STACK];
+    uint8_t master_buffer[MTOS_BUFFER_EFFECTIVE];
+    uint8_t slave_buffer[MTOS_BUFFER_SLAVE];
+    uint8_t acc[CONFIG_MTOS_STATIC_RX_SIZE]; // acumulador del master, acota el bloque remoto mas grande
+} mtos_storage_t;
+
+// la primera es de la instancia por defecto, el resto de las creadas con mtos_instance_create
+static mtos_storage_t mtos_storage[1+CONFIG_MTOS_STATIC_INSTANCES];
+static mtos_instance_t mtos_instance_pool[CONFIG_MTOS_STATIC_INSTANCES ? CONFIG_MTOS_STATIC_INSTANCES : 1];
+static size_t mtos_instance_pool_used = 0;
+#endif
+
+// el acumulador estatico no se adopta como memoria del bloque, 0/1 para usarlo en expresiones
+#if CONFIG_MTOS_STATIC
+#define MTOS_STATIC_ACC 1
+#else
+#define MTOS_STATIC_ACC 0
+#endif
+
+// acumulador de los chunks de una llamada
+static uint8_t* mtos_acc_alloc(mtos_instance_t* inst, size_t size)
+{
+#if CONFIG_MTOS_STATIC
+    return (size <= CONFIG_MTOS_STATIC_RX_SIZE ? inst->storage->acc : NULL);
+#else
+    return (uint8_t*)malloc(size ? size : 1);
+#endif
+}
+
+static void mtos_acc_free(uint8_t* acc)
+{
+#if !CONFIG_MTOS_STATIC
+    free(acc);
+#endif
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static int mtos_uart_write(void* ctx, const void* src, size_t len)
+{
+    return uart_write_bytes((uart_port_t)(intptr_t)ctx,src,len);
+}
+
+static int mtos_uart_read(void* ctx, void* dst, size_t len)
+{
+    return uart_read_bytes((uart_port_t)(intptr_t)ctx,dst,len,0);
+}
+
+static size_t mtos_uart_buffered(void* ctx)
+{
+    size_t len = 0;
+    uart_get_buffered_data_len((uart_port_t)(intptr_t)ctx,&len);
+    return len;
+}
+
+#endif
+
+static mtos_instance_t mtos_default = {
+#if !CONFIG_IDF_TARGET_LINUX
+    // por defecto se utiliza el driver de uart en el puerto configurado
+    .transport = {
+        .write = mtos_uart_write,
+        .read = mtos_uart_read,
+        .buffered = mtos_uart_buffered,
+        .ctx = (void*)MTOS_PORT,
+    },
+#endif
+    .slave_timeout = CONFIG_MTOS_DEFAULT_TIMEOUT,
+#if CONFIG_MTOS_BUS
+    .address = CONFIG_MTOS_BUS_ADDRESS,
+#endif
+};
+
+ESP_EVENT_DEFINE_BASE(MTOS_EVENTS);
+
+#if CONFIG_MTOS_BOND
+// enlace agregado: cada escritura se reparte en tramas numeradas entre varios transportes y
+// el receptor las vuelve a ordenar. Cada trama lleva los enlaces por los que su emisor recibe
+// bien, asi el remoto deja de usar un enlace con errores en su sentido de transmision
+// |MTOS_BOND_MAGIC|flags|seq:16|len:16|mask|crc8|payload|crc16|
+#define MTOS_BOND_MAGIC 0xB7
+#define MTOS_BOND_FLAG_SYNC 0x01 // el emisor (re)inicio la numeracion
+#define MTOS_BOND_HEADER 8
+#define MTOS_BOND_OVERHEAD (MTOS_BOND_HEADER+sizeof(uint16_t))
+#define MTOS_BOND_PAYLOAD_MAX 512
+#define MTOS_BOND_SPLIT_MIN 64 // las escrituras menores viajan en una sola trama
+#define MTOS_BOND_RX_SIZE (4*(MTOS_BOND_PAYLOAD_MAX+MTOS_BOND_OVERHEAD))
+#define MTOS_BOND_OUT_SIZE (2*CONFIG_MTOS_BOND_MAX_LINKS*MTOS_BOND_PAYLOAD_MAX)
+#define MTOS_BOND_GAP_MS (5*CONFIG_MTOS_UART_STEP_MS) // espera por una trama faltante antes de darla por perdida
+#define MTOS_BOND_HOLDOFF_MS 1000 // tiempo que un enlace con errores queda fuera del reparto
+
+typedef struct {
+    mtos_transport_t link;
+    uint8_t* rx; // bytes recibidos todavia sin procesar
+    size_t rx_len;
+    uint32_t rx_ts; // ultima vez que llegaron bytes
+    bool rx_bad; // hubo errores de recepcion en rx_bad_ts
+    uint32_t rx_bad_ts;
+    bool tx_bad; // fallo una escritura en tx_bad_ts
+    uint32_t tx_bad_ts;
+    bool down; // se informo MTOS_EVENT_LINK_DOWN
+} mtos_bond_link_t;
+
+// un enlace agregado por transporte, es el ctx de sus funciones
+typedef struct {
+    mtos_instance_t* inst; // instancia que usa el transporte, recibe MTOS_EVENT_LINK_DOWN y MTOS_EVENT_LINK_UP
+    mtos_bond_link_t links[CONFIG_MTOS_BOND_MAX_LINKS];
+    size_t count;
+    size_t next; // siguiente enlace del reparto
+    uint16_t tx_seq;
+    uint16_t rx_seq;
+    bool gap; // falta la trama rx_seq y ya llegaron posteriores
+    uint32_t gap_ts;
+    bool peer_seen; // ya llego una trama valida del remoto, se deja de marcar SYNC
+    uint8_t peer_mask; // enlaces por los que el remoto recibe bien
+    uint8_t* out; // bytes en orden listos para leer
+    size_t out_len;
+    uint8_t* frame;
+    SemaphoreHandle_t tx_lock;
+} mtos_bond_t;
+
+#if CONFIG_MTOS_STATIC
+// memoria de un enlace agregado, uno por instancia
+typedef struct {
+    uint8_t rx[CONFIG_MTOS_BOND_MAX_LINKS][MTOS_BOND_RX_SIZE];
+    uint8_t out[MTOS_BOND_OUT_SIZE];
+    uint8_t frame[MTOS_BOND_PAYLOAD_MAX+MTOS_BOND_OVERHEAD];
+    StaticSemaphore_t tx_lock;
+} mtos_bond_storage_t;
+
+static mtos_bond_t mtos_bond_pool[1+CONFIG_MTOS_STATIC_INSTANCES];
+static mtos_bond_storage_t mtos_bond_storage[1+CONFIG_MTOS_STATIC_INSTANCES];
+static size_t mtos_bond_pool_used = 0;
+#endif
+
+static void mtos_bond_fault(mtos_bond_t* bond, size_t i)
+{
+    mtos_bond_link_t* link = &bond->links[i];
+    link->rx_bad = true;
+    link->rx_bad_ts = MILLIS(0);
+    if (!link->down) {
+        uint8_t index = i;
+        link->down = true;
+        MTOS_EVT_POST(bond->inst,MTOS_EVENT_LINK_DOWN,&index,sizeof(index));
+    }
+}
+
+// enlaces por los que se recibe bien, se le informa al remoto en cada trama
+static uint8_t mtos_bond_rx_mask(mtos_bond_t* bond)
+{
+    uint8_t mask = 0;
+    for (size_t i = 0; i < bond->count; i++) {
+        if (!bond->links[i].rx_bad || (MILLIS(bond->links[i].rx_bad_ts) >= MTOS_BOND_HOLDOFF_MS)) {
+            mask |= 1 << i;
+        }
+    }
+    return mask;
+}
+
+// enlaces en los que se reparte la transmision, si ninguno esta sano se usan todos
+static uint8_t mtos_bond_tx_mask(mtos_bond_t* bond)
+{
+    uint8_t mask = 0;
+    for (size_t i = 0; i < bond->count; i++) {
+        if ((bond->peer_mask & (1 << i)) &&
+            (!bond->links[i].tx_bad || (MILLIS(bond->links[i].tx_bad_ts) >= MTOS_BOND_HOLDOFF_MS))) {
+            mask |= 1 << i;
+        }
+    }
+    return (mask ? mask : (1 << bond->count)-1);
+}
+
+static int mtos_bond_write(void* ctx, const void* src, size_t len)
+{
+    mtos_bond_t* bond = (mtos_bond_t*)ctx;
+    const uint8_t* data = (const uint8_t*)src;
+    size_t done = 0;
+    xSemaphoreTake(bond->tx_lock,portMAX_DELAY);
+    uint8_t usable = mtos_bond_tx_mask(bond);
+    uint8_t rx_mask = mtos_bond_rx_mask(bond);
+    size_t links = __builtin_popcount(usable);
+    // las escrituras grandes se dividen en partes iguales, una por enlace sano
+    size_t piece = (len < MTOS_BOND_SPLIT_MIN ? len : (len+links-1)/links);
+    if (piece > MTOS_BOND_PAYLOAD_MAX) {
+        piece = MTOS_BOND_PAYLOAD_MAX;
+    }
+    while (done < len) {
+        size_t i = bond->next;
+        while (!(usable & (1 << (i%bond->count)))) {
+            i++;
+        }
+        i %= bond->count;
+        bond->next = i+1;
+        size_t size = (len-done < piece ? len-done : piece);
+        uint8_t* frame = bond->frame;
+        frame[0] = MTOS_BOND_MAGIC;
+        frame[1] = (bond->peer_seen ? 0 : MTOS_BOND_FLAG_SYNC);
+        frame[2] = bond->tx_seq & 0xFF;
+        frame[3] = bond->tx_seq >> 8;
+        frame[4] = size & 0xFF;
+        frame[5] = size >> 8;
+        frame[6] = rx_mask;
+        frame[7] = esp_rom_crc8_be(0,frame,MTOS_BOND_HEADER-1);
+        memcpy(frame+MTOS_BOND_HEADER,data+done,size);
+        uint16_t crc = esp_rom_crc16_be(0,frame,MTOS_BOND_HEADER+size);
+        memcpy(frame+MTOS_BOND_HEADER+size,&crc,sizeof(crc));
+        mtos_bond_link_t* link = &bond->links[i];
+        if (link->link.write(link->link.ctx,frame,size+MTOS_BOND_OVERHEAD) != size+MTOS_BOND_OVERHEAD) {
+            // la trama se pierde, el receptor la saltea y el protocolo reenvia el chunk
+            link->tx_bad = true;
+            link->tx_bad_ts = MILLIS(0);
+        }
+        bond->tx_seq++;
+        done += size;
+    }
+    xSemaphoreGive(bond->tx_lock);
+    return done;
+}
+
+// descarta bytes hasta dejar una trama valida al frente de rx, devuelve su largo o 0 si no esta completa
+static size_t mtos_bond_head(mtos_bond_t* bond, size_t i)
+{
+    mtos_bond_link_t* link = &bond->links[i];
+    while (link->rx_len) {
+        size_t skip = 0;
+        if (link->rx[0] == MTOS_BOND_MAGIC) {
+            if (link->rx_len < MTOS_BOND_HEADER) {
+                return 0;
+            }
+            size_t size = link->rx[4] | (link->rx[5] << 8);
+            if ((size <= MTOS_BOND_PAYLOAD_MAX) &&
+                (esp_rom_crc8_be(0,link->rx,MTOS_BOND_HEADER-1) == link->rx[MTOS_BOND_HEADER-1])) {
+                if (link->rx_len < size+MTOS_BOND_OVERHEAD) {
+                    return 0;
+                }
+                bond->peer_seen = true;
+                bond->peer_mask = link->rx[6];
+                uint16_t crc = esp_rom_crc16_be(0,link->rx,MTOS_BOND_HEADER+size);
+                if (memcmp(&crc,link->rx+MTOS_BOND_HEADER+size,sizeof(crc)) != 0) {
+                    // el payload llego con errores, se entrega igual para no cortar el flujo de bytes:
+                    // el crc32 del chunk lo descarta y el master pide la retransmision enseguida
+                    mtos_bond_fault(bond,i);
+                }
+                else if (link->down && (MILLIS(link->rx_bad_ts) >= MTOS_BOND_HOLDOFF_MS)) {
+                    uint8_t index = i;
+                    link->down = false;
+                    link->rx_bad = false;
+                    MTOS_EVT_POST(bond->inst,MTOS_EVENT_LINK_UP,&index,sizeof(index));
+                }
+                return size+MTOS_BOND_OVERHEAD;
+            }
+            skip = 1;
+        }
+        // se busca el proximo inicio de trama
+        uint8_t* magic = memchr(link->rx+skip,MTOS_BOND_MAGIC,link->rx_len-skip);
+        skip = (magic ? magic-link->rx : link->rx_len);
+        memmove(link->rx,link->rx+skip,link->rx_len-skip);
+        link->rx_len -= skip;
+        mtos_bond_fault(bond,i);
+    }
+    return 0;
+}
+
+static void mtos_bond_consume(mtos_bond_t* bond, size_t i, size_t len)
+{
+    mtos_bond_link_t* link = &bond->links[i];
+    memmove(link->rx,link->rx+len,link->rx_len-len);
+    link->rx_len -= len;
+}
+
+// pasa a out las tramas en orden de secuencia, cada enlace las entrega en el orden en que se enviaron
+static void mtos_bond_deliver(mtos_bond_t* bond)
+{
+    size_t heads[CONFIG_MTOS_BOND_MAX_LINKS];
+    for (;;) {
+        size_t best = bond->count;
+        int16_t best_dist = INT16_MAX;
+        for (size_t i = 0; i < bond->count; i++) {
+            heads[i] = mtos_bond_head(bond,i);
+            if (heads[i]) {
+                uint8_t* rx = bond->links[i].rx;
+                uint16_t seq = rx[2] | (rx[3] << 8);
+                int16_t dist = (int16_t)(seq-bond->rx_seq);
+                if ((dist < 0) && (rx[1] & MTOS_BOND_FLAG_SYNC)) {
+                    // el remoto se reinicio, se adopta su numeracion
+                    bond->rx_seq = seq;
+                    dist = 0;
+                }
+                if (dist < best_dist) {
+                    best = i;
+                    best_dist = dist;
+                }
+            }
+        }
+        if (best == bond->count) {
+            return;
+        }
+        uint8_t* rx = bond->links[best].rx;
+        if (best_dist < 0) {
+            // llego tarde, su lugar ya se dio por perdido
+            mtos_bond_consume(bond,best,heads[best]);
+            continue;
+        }
+        if (best_dist > 0) {
+            if (!bond->gap) {
+                bond->gap = true;
+                bond->gap_ts = MILLIS(0);
+            }
+            if (MILLIS(bond->gap_ts) < MTOS_BOND_GAP_MS) {
+                return;
+            }
+            for (size_t i = 0; i < bond->count; i++) {
+                if (!heads[i] && (MILLIS(bond->links[i].rx_ts) < MTOS_BOND_GAP_MS)) {
+                    // la trama faltante puede estar llegando por un enlace que todavia recibe bytes
+                    return;
+                }
+            }
+            // la trama faltante no llego por ningun enlace, se sospecha de los que no entregaron nada
+            for (size_t i = 0; i < bond->count; i++) {
+                if (!heads[i]) {
+                    mtos_bond_fault(bond,i);
+                }
+            }
+            bond->rx_seq += best_dist;
+        }
+        size_t size = heads[best]-MTOS_BOND_OVERHEAD;
+        if (bond->out_len+size > MTOS_BOND_OUT_SIZE) {
+            return;
+        }
+        memcpy(bond->out+bond->out_len,rx+MTOS_BOND_HEADER,size);
+        bond->out_len += size;
+        mtos_bond_consume(bond,best,heads[best]);
+        bond->rx_seq++;
+        bond->gap = false;
+    }
+}
+
+static size_t mtos_bond_buffered(void* ctx)
+{
+    mtos_bond_t* bond = (mtos_bond_t*)ctx;
+    for (size_t i = 0; i < bond->count; i++) {
+        mtos_bond_link_t* link = &bond->links[i];
+        size_t len = link->link.buffered(link->link.ctx);
+        if (len > MTOS_BOND_RX_SIZE-link->rx_len) {
+            len = MTOS_BOND_RX_SIZE-link->rx_len; // el resto queda en el enlace
+        }
+        if (len) {
+            int result = link->link.read(link->link.ctx,link->rx+link->rx_len,len);
+            if (result > 0) {
+                link->rx_len += result;
+                link->rx_ts = MILLIS(0);
+            }
+        }
+    }
+    mtos_bond_deliver(bond);
+    return bond->out_len;
+}
+
+static int mtos_bond_read(void* ctx, void* dst, size_t len)
+{
+    mtos_bond_t* bond = (mtos_bond_t*)ctx;
+    if (len > bond->out_len) {
+        len = bond->out_len;
+    }
+    memcpy(dst,bond->out,len);
+    memmove(bond->out,bond->out+len,bond->out_len-len);
+    bond->out_len -= len;
+    return len;
+}
+#endif
+
+static int mtos_call_enqueue(mtos_list_t* node, size_t offset, size_t length, unsigned int timeout_ms, unsigned int max_chunk_size, TaskHandle_t notify, bool put)
+{
+    mtos_call_t call = {
+        .node = node,
+        .offset = offset,
+        .length = length,
+        .timeout_ms = timeout_ms,
+        .notify = notify,
+        .put = put,
+    };
+    ESP_LOGI(TAG,"found %s",node->name);
+    if ((max_chunk_size <= MTOS_BUFFER_AVAILABLE) && (max_chunk_size >= CONFIG_MTOS_BUFFER_LEGACY)) {
+        call.max_chunk_size = max_chunk_size;
+    }
+    else if (max_chunk_size < CONFIG_MTOS_BUFFER_LEGACY) {
+        call.max_chunk_size = CONFIG_MTOS_BUFFER_LEGACY;
+    }
+    else {
+        call.max_chunk_size = MTOS_BUFFER_AVAILABLE;
+    }
+    xQueueSend(node->inst->call_queue,&call,portMAX_DELAY);
+    return 0;
+}
+
+int mtos_call(char* name, unsigned int timeout_ms, unsigned int max_chunk_size)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node != NULL) {
+        if (!node->slave) {
+            return mtos_call_enqueue(node,0,0,timeout_ms,max_chunk_size,NULL,false);
+        }
+        else {
+            return -2;
+        }
+    }
+    else {
+        return -1;
+    }
+}
+
+int mtos_call_range(char* name, size_t offset, size_t length, unsigned int timeout_ms, unsigned int max_chunk_size)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node != NULL) {
+        if (!node->slave) {
+            if ((length == 0) || (offset > MTOS_EXT_MAX) || (length > MTOS_EXT_MAX)) {
+                return -3;
+            }
+            return mtos_call_enqueue(node,offset,length,timeout_ms,max_chunk_size,NULL,false);
+        }
+        else {
+            return -2;
+        }
+    }
+    else {
+        return -1;
+    }
+}
+
+int mtos_call_elements(char* name, size_t first, size_t count, unsigned int timeout_ms, unsigned int max_chunk_size)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node != NULL) {
+        if (!node->slave) {
+            if (node->blob) {
+                return -4;
+            }
+            // el producto por el tamanio del elemento no debe desbordar
+            if ((first > MTOS_EXT_MAX/node->size) || (count > MTOS_EXT_MAX/node->size)) {
+                return -3;
+            }
+            return mtos_call_range(name,first*node->size,count*node->size,timeout_ms,max_chunk_size);
+        }
+        else {
+            return -2;
+        }
+    }
+    else {
+        return -1;
+    }
+}
+
+int mtos_put(char* name, unsigned int timeout_ms, unsigned int max_chunk_size)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node != NULL) {
+        if (!node->slave) {
+            if (node->length > MTOS_EXT_MAX) {
+                return -3;
+            }
+            return mtos_call_enqueue(node,0,0,timeout_ms,max_chunk_size,NULL,true);
+        }
+        else {
+            return -2;
+        }
+    }
+    else {
+        return -1;
+    }
+}
+
+int mtos_replicate(char* name, bool enable, unsigned int timeout_ms, unsigned int max_chunk_size)
+{
+#if CONFIG_MTOS_REPLICATE
+    mtos_list_t* node = mtos_lookup(name);
+    if (node == NULL) {
+        return -1;
+    }
+    if (node->slave) {
+        return -2;
+    }
+    mtos_take(node, portMAX_DELAY);
+    node->repl = enable;
+    node->repl_timeout_ms = timeout_ms;
+    node->repl_max_chunk_size = max_chunk_size;
+    // se parte de un put, que no envia chunks si el slave ya tiene el bloque
+    node->repl_full = enable;
+    node->repl_lo = 0;
+    node->repl_hi = 0;
+    node->repl_length = node->length;
+    mtos_give_modified(node);
+    return 0;
+#else
+    return -3;
+#endif
+}
+
+// encola una operacion remota, un operando mas largo que CONFIG_MTOS_REMOTE_OP_MAX se envia en varias
+static int mtos_op_enqueue(mtos_list_t* node, mtos_op_t code, size_t offset, size_t count, const void* src, size_t n, unsigned int timeout_ms)
+{
+    if (node == NULL) {
+        return -1;
+    }
+    if (node->slave) {
+        return -2;
+    }
+    if ((offset > MTOS_EXT_MAX) || (count > MTOS_EXT_MAX) || (count && (n > CONFIG_MTOS_REMOTE_OP_MAX))) {
+        return -3;
+    }
+    const uint8_t* p = (const uint8_t*)src;
+    do {
+        mtos_call_t call = {
+            .node = node,
+            .offset = offset,
+            .timeout_ms = timeout_ms,
+            .max_chunk_size = CONFIG_MTOS_BUFFER_LEGACY,
+            .op = code,
+            .op_count = count,
+            .op_length = (n < CONFIG_MTOS_REMOTE_OP_MAX ? n : CONFIG_MTOS_REMOTE_OP_MAX),
+        };
+        memcpy(call.operand,p,call.op_length);
+        xQueueSend(node->inst->call_queue,&call,portMAX_DELAY);
+        p += call.op_length;
+        n -= call.op_length;
+        // cada parte sigue donde termino la anterior
+        if (code == MTOS_OP_WRITE) {
+            offset += call.op_length;
+        }
+        else if (code == MTOS_OP_STRCPY) {
+            code = MTOS_OP_STRCAT;
+        }
+    } while (n > 0);
+    return 0;
+}
+
+int mtos_remote_write_at(char name[16], const void* src, size_t offset, size_t n, unsigned int timeout_ms)
+{
+    return mtos_op_enqueue(mtos_lookup(name),MTOS_OP_WRITE,offset,0,src,n,timeout_ms);
+}
+
+int mtos_remote_append(char name[16], const void* src, size_t n, unsigned int timeout_ms)
+{
+    return mtos_op_enqueue(mtos_lookup(name),MTOS_OP_APPEND,0,0,src,n,timeout_ms);
+}
+
+int mtos_remote_memset(char name[16], char const chr, size_t n, unsigned int timeout_ms)
+{
+    if (n == 0) {
+        return -3;
+    }
+    return mtos_op_enqueue(mtos_lookup(name),MTOS_OP_MEMSET,0,n,&chr,1,timeout_ms);
+}
+
+int mtos_remote_strcpy(char name[16], const char* src, unsigned int timeout_ms)
+{
+    return mtos_op_enqueue(mtos_lookup(name),MTOS_OP_STRCPY,0,0,src,strlen(src),timeout_ms);
+}
+
+int mtos_remote_strncpy(char name[16], const char* src, size_t n, unsigned int timeout_ms)
+{
+    if (n == 0) {
+        return -3;
+    }
+    return mtos_op_enqueue(mtos_lookup(name),MTOS_OP_STRCPY,0,n,src,strnlen(src,n),timeout_ms);
+}
+
+int mtos_remote_strcat(char name[16], const char* src, unsigned int timeout_ms)
+{
+    return mtos_op_enqueue(mtos_lookup(name),MTOS_OP_STRCAT,0,0,src,strlen(src),timeout_ms);
+}
+
+int mtos_remote_return_element(char name[16], const void* element, size_t index, unsigned int timeout_ms)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if ((node != NULL) && node->blob) {
+        return -4;
+    }
+    if ((node != NULL) && !node->slave && (index > MTOS_EXT_MAX/node->size)) {
+        // index*size no entra en el offset de la extension, y en size_t podria desbordar
+        return -3;
+    }
+    return mtos_op_enqueue(node,MTOS_OP_WRITE,(node ? index*node->size : 0),0,element,(node ? node->size : 0),timeout_ms);
+}
+
+// encola una consulta, el resultado llega con MTOS_EVENT_MASTER_QUERY
+static int mtos_query_enqueue(mtos_list_t* node, mtos_query_t query, uint8_t type, size_t field, const void* pattern, size_t len,
+    size_t first, size_t count, unsigned int timeout_ms)
+{
+    if (node == NULL) {
+        return -1;
+    }
+    if (node->slave) {
+        return -2;
+    }
+    if ((first > MTOS_EXT_MAX) || (count > MTOS_EXT_MAX) || (field > UINT16_MAX) || (len > CONFIG_MTOS_REMOTE_OP_MAX-MTOS_QUERY_HEAD)) {
+        return -3;
+    }
+    mtos_call_t call = {
+        .node = node,
+        .offset = first,
+        .timeout_ms = timeout_ms,
+        .max_chunk_size = CONFIG_MTOS_BUFFER_LEGACY,
+        .op = MTOS_OP_QUERY+query,
+        .op_count = count,
+        .op_length = MTOS_QUERY_HEAD+len,
+        .operand = {type,field & 0xFF,field >> 8},
+    };
+    if (len) {
+        memcpy(call.operand+MTOS_QUERY_HEAD,pattern,len);
+    }
+    xQueueSend(node->inst->call_queue,&call,portMAX_DELAY);
+    return 0;
+}
+
+int mtos_remote_reduce(char name[16], mtos_query_t query, mtos_elem_type_t type, size_t field, size_t first, size_t count, unsigned int timeout_ms)
+{
+    if ((query > MTOS_QUERY_SUM) || (type > MTOS_TYPE_DOUBLE)) {
+        return -4;
+    }
+    return mtos_query_enqueue(mtos_lookup(name),query,type,field,NULL,0,first,count,timeout_ms);
+}
+
+int mtos_remote_count(char name[16], const void* pattern, size_t len, size_t field, size_t first, size_t count, unsigned int timeout_ms)
+{
+    if (len == 0) {
+        return -4;
+    }
+    return mtos_query_enqueue(mtos_lookup(name),MTOS_QUERY_COUNT,0,field,pattern,len,first,count,timeout_ms);
+}
+
+int mtos_remote_find(char name[16], const void* pattern, size_t len, size_t field, size_t first, size_t count, unsigned int timeout_ms)
+{
+    if (len == 0) {
+        return -4;
+    }
+    return mtos_query_enqueue(mtos_lookup(name),MTOS_QUERY_FIND,0,field,pattern,len,first,count,timeout_ms);
+}
+
+#define MTOS_POLL_IDLE_MS 100 // espera maxima del planificador, acota la demora en ver un bloque nuevo
+#define MTOS_WATCH_BACKOFF_MAX 8 // multiplo maximo del periodo de un bloque vigilado con el enlace saturado
+
+// planificador de mtos_poll: llama de a un bloque por vez, asi en un bus un solo slave transmite.
+// Entre los bloques vencidos elige el que menos tiempo de bus consumio, con lo que un bus saturado
+// se reparte en partes iguales y un bloque grande no posterga a los chicos
+static void mtos_poll_task(void* pvParameters)
+{
+    mtos_instance_t* inst = (mtos_instance_t*)pvParameters;
+    bool burst = false; // se esta llamando una tanda de bloques vencidos
+    for(;;) {
+        mtos_list_t* next = NULL;
+        uint32_t now = MILLIS(0);
+        uint32_t wait_ms = MTOS_POLL_IDLE_MS;
+        for (mtos_list_t* node = inst->list_head; node != NULL; node = node->next) {
+            if (node->poll_period_ms == 0) {
+                continue;
+            }
+            int32_t ahead = (int32_t)(node->poll_due-now);
+            // los bloques vigilados proximos a vencer se suman a la tanda en curso
+            if ((ahead <= 0) || (burst && (ahead <= (int32_t)node->poll_coalesce_ms))) {
+                if ((next == NULL) || (node->poll_vtime_us < next->poll_vtime_us)) {
+                    next = node;
+                }
+            }
+            else if ((uint32_t)ahead < wait_ms) {
+                wait_ms = ahead;
+            }
+        }
+        burst = (next != NULL);
+        if (next == NULL) {
+            vTaskDelay((wait_ms+portTICK_PERIOD_MS-1)/portTICK_PERIOD_MS);
+            continue;
+        }
+        int64_t ini = esp_timer_get_time();
+        uint32_t period_ms = next->poll_period_ms*next->poll_backoff;
+        mtos_call_enqueue(next,0,0,next->poll_timeout_ms,next->poll_max_chunk_size,xTaskGetCurrentTaskHandle(),false);
+        ulTaskNotifyTake(pdTRUE,portMAX_DELAY);
+        next->poll_vtime_us += esp_timer_get_time()-ini;
+        // un bloque llamado antes de tiempo adopta la fase de la tanda, asi la proxima vez vuelven a coincidir
+        next->poll_due = ((int32_t)(next->poll_due-now) > 0 ? now : next->poll_due)+period_ms;
+        bool saturated = next->call_timed_out || (uxQueueMessagesWaiting(inst->call_queue) > 0);
+        if ((int32_t)(MILLIS(0)-next->poll_due) > 0) {
+            // atrasado un periodo completo, no se acumulan sondeos pendientes
+            next->poll_due = MILLIS(0);
+            saturated = true;
+        }
+        // con el enlace saturado se espacian los bloques vigilados, y se recuperan de a poco
+        if (saturated && (next->poll_backoff < next->poll_max_backoff)) {
+            next->poll_backoff = (2*next->poll_backoff < next->poll_max_backoff ? 2*next->poll_backoff : next->poll_max_backoff);
+        }
+        else if (!saturated && (next->poll_backoff > 1)) {
+            next->poll_backoff /= 2;
+        }
+    }
+}
+
+static int mtos_poll_setup(char* name, unsigned int period_ms, unsigned int timeout_ms, unsigned int max_chunk_size,
+    unsigned int coalesce_ms, unsigned int max_backoff)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node == NULL) {
+        return -1;
+    }
+    if (node->slave) {
+        return -2;
+    }
+    mtos_instance_t* inst = node->inst;
+    if ((period_ms != 0) && (inst->poll_th == NULL)) {
+#if CONFIG_MTOS_STATIC
+        inst->poll_th = xTaskCreateStatic(mtos_poll_task, "mtos_poll", MTOS_POLL_STACK, inst, uxTaskPriorityGet(NULL),
+            inst->storage->poll_stack, &inst->storage->poll_tcb);
+        if (inst->poll_th == NULL) {
+            return -3;
+        }
+#else
+        if (xTaskCreate(mtos_poll_task, "mtos_poll", MTOS_POLL_STACK, inst, uxTaskPriorityGet(NULL), &inst->poll_th) != pdPASS) {
+            inst->poll_th = NULL;
+            return -3;
+        }
+#endif
+    }
+    if ((period_ms != 0) && (node->poll_period_ms == 0)) {
+        // un bloque nuevo arranca con el menor tiempo consumido, no con cero, para no acaparar el bus
+        uint64_t vtime_us = UINT64_MAX;
+        for (mtos_list_t* other = inst->list_head; other != NULL; other = other->next) {
+            if (other->poll_period_ms && (other->poll_vtime_us < vtime_us)) {
+                vtime_us = other->poll_vtime_us;
+            }
+        }
+        node->poll_vtime_us = (vtime_us == UINT64_MAX ? 0 : vtime_us);
+        node->poll_due = MILLIS(0);
+    }
+    node->poll_timeout_ms = timeout_ms;
+    node->poll_max_chunk_size = max_chunk_size;
+    node->poll_coalesce_ms = coalesce_ms;
+    node->poll_max_backoff = max_backoff;
+    node->poll_backoff = 1;
+    node->poll_period_ms = period_ms;
+    return 0;
+}
+
+int mtos_poll(char* name, unsigned int period_ms, unsigned int timeout_ms, unsigned int max_chunk_size)
+{
+    return mtos_poll_setup(name,period_ms,timeout_ms,max_chunk_size,0,1);
+}
+
+int mtos_watch(char* name, unsigned int period_ms, const mtos_watch_options_t* options)
+{
+    mtos_watch_options_t opt = {};
+    if (options != NULL) {
+        opt = *options;
+    }
+    return mtos_poll_setup(name,period_ms,
+        (opt.timeout_ms ? opt.timeout_ms : CONFIG_MTOS_DEFAULT_TIMEOUT),
+        (opt.max_chunk_size ? opt.max_chunk_size : MTOS_BUFFER_AVAILABLE),
+        (opt.coalesce_ms ? opt.coalesce_ms : period_ms/4),
+        (opt.max_backoff ? opt.max_backoff : MTOS_WATCH_BACKOFF_MAX));
+}
+
+// lee sin bloquear lo que el transporte ya recibio, hasta llenar el buffer; el resto queda en el driver
+static size_t mtos_read_bytes(mtos_instance_t* inst, void *buf, size_t *length, size_t size)
+{
+    char *TAG = "mtos_uart";
+    int64_t poll_ts = MTOS_TRACE_NOW();
+    size_t buffered_size = inst->transport.buffered(inst->transport.ctx);
+    mtos_trace_task_t role = inst->role;
+    inst->role = MTOS_TRACE_TASK_UART;
+    MTOS_TRACE_SPAN(MTOS_TRACE_UART_POLL,NULL,poll_ts,buffered_size);
+    inst->role = role;
+    if (buffered_size == 0) {
+        return *length;
+    }
+    inst->uart_rx_ts = MILLIS(0);
+    if (buffered_size > size-*length) {
+        buffered_size = size-*length;
+    }
+    size_t last_rx_bytes = *length;
+    int uart_result = inst->transport.read(inst->transport.ctx, (uint8_t*)buf+*length, buffered_size);
+    *length += (uart_result > 0 ? uart_result : 0);
+    if (*length != last_rx_bytes) {
+        ESP_LOGI(TAG,"rx_bytes pre: %zu >>>",last_rx_bytes);
+        ESP_LOG_BUFFER_HEXDUMP(TAG,buf,*length,ESP_LOG_INFO);
+        ESP_LOGI(TAG,"rx_bytes pos: %zu <<<",*length);
+    }
+    return *length;
+}
+
+static void mtos_send_bytes(mtos_instance_t* inst, char* token, mtos_header_t* header, mtos_ext_t* ext, void* chunk, size_t len)
+{
+    int64_t tx_ts = MTOS_TRACE_NOW();
+    size_t tx_bytes = 0;
+    // token, header y extension salen en una sola escritura: en un enlace agregado viajan en una trama,
+    // y una respuesta corta (p. ej. bloque sin cambios) no queda siempre partida sobre los mismos enlaces
+    uint8_t head[8+MTOS_ADDR_LEN+sizeof(mtos_header_t)+sizeof(mtos_ext_t)];
+    size_t head_len = 0;
+    if (token) {
+        head_len = strlen(token);
+        memcpy(head,token,head_len);
+    }
+    if (header) {
+        memcpy(head+head_len,header->raw,sizeof(((mtos_header_t*)0)->raw));
+        head_len += sizeof(((mtos_header_t*)0)->raw);
+    }
+    if (ext) {
+        memcpy(head+head_len,ext->raw,sizeof(((mtos_ext_t*)0)->raw));
+        head_len += sizeof(((mtos_ext_t*)0)->raw);
+    }
+    if (head_len) tx_bytes += inst->transport.write(inst->transport.ctx,head,head_len);
+    if (chunk) {
+        mtos_crc32_t block_crc = {};
+        int64_t crc_ts = MTOS_TRACE_NOW();
+        block_crc.value = esp_rom_crc32_be(0,chunk,len);
+        MTOS_TRACE_SPAN(MTOS_TRACE_CRC32,NULL,crc_ts,1);
+        ESP_LOGI(TAG,"sending chunk_response:{.chunk_size:%u,.crc8:%x,.block_crc32:%" PRIx32 "}",
+            header->chunk_response.size,
+            header->chunk_response.crc8,
+            block_crc.value);
+        tx_bytes += inst->transport.write(inst->transport.ctx,chunk,len);
+        tx_bytes += inst->transport.write(inst->transport.ctx,block_crc.raw,sizeof(mtos_crc32_t));
+    }
+    MTOS_TRACE_SPAN(MTOS_TRACE_FRAME_TX,NULL,tx_ts,tx_bytes);
+}
+
+// codificacion COBS por partes, el byte de codigo de cada grupo se completa al cerrarlo
+typedef struct {
+    mtos_instance_t* inst;
+    uint8_t out[320]; // se escribe de a varios grupos, una solicitud sale en una sola escritura
+    size_t len;
+    size_t code; // posicion del byte de codigo del grupo abierto
+    size_t tx_bytes;
+} mtos_cobs_t;
+
+static void mtos_cobs_put(mtos_cobs_t* cobs, const void* src, size_t n)
+{
+    const uint8_t* bytes = (const uint8_t*)src;
+    for (size_t i = 0; i < n; i++) {
+        if (bytes[i] != 0) {
+            cobs->out[cobs->len++] = bytes[i];
+        }
+        if ((bytes[i] == 0) || (cobs->len-cobs->code == 0xFF)) {
+            cobs->out[cobs->code] = cobs->len-cobs->code;
+            cobs->code = cobs->len++;
+        }
+        if (cobs->len >= sizeof(cobs->out)-1) {
+            // un byte puede agregar dos (el dato y el codigo del grupo que cierra): se escriben los grupos
+            // cerrados antes de llenar el buffer, el abierto pasa al comienzo
+            cobs->tx_bytes += cobs->inst->transport.write(cobs->inst->transport.ctx,cobs->out,cobs->code);
+            memmove(cobs->out,cobs->out+cobs->code,cobs->len-cobs->code);
+            cobs->len -= cobs->code;
+            cobs->code = 0;
+        }
+    }
+}
+
+// envia header y chunk en una trama delimitada, con el id del bloque en lugar del token
+static void mtos_send_frame(mtos_instance_t* inst, mtos_list_t* node, mtos_header_t* header, void* chunk, size_t len)
+{
+    int64_t tx_ts = MTOS_TRACE_NOW();
+    mtos_cobs_t cobs = {
+        .inst = inst,
+        .len = 1,
+    };
+    mtos_cobs_put(&cobs,&node->channel,sizeof(node->channel));
+    mtos_cobs_put(&cobs,header->raw,sizeof(((mtos_header_t*)0)->raw));
+    if (chunk) {
+        mtos_crc32_t block_crc = {};
+        int64_t crc_ts = MTOS_TRACE_NOW();
+        block_crc.value = esp_rom_crc32_be(0,chunk,len);
+        MTOS_TRACE_SPAN(MTOS_TRACE_CRC32,NULL,crc_ts,1);
+        ESP_LOGI(TAG,"sending framed chunk_response:{.chunk_size:%u,.crc8:%x,.block_crc32:%" PRIx32 "}",
+            header->chunk_response.size,
+            header->chunk_response.crc8,
+            block_crc.value);
+        mtos_cobs_put(&cobs,chunk,len);
+        mtos_cobs_put(&cobs,block_crc.raw,sizeof(mtos_crc32_t));
+    }
+    cobs.out[cobs.code] = cobs.len-cobs.code;
+    cobs.out[cobs.len++] = 0; // delimitador, entra siempre porque put deja lugar despues del grupo abierto
+    cobs.tx_bytes += inst->transport.write(inst->transport.ctx,cobs.out,cobs.len);
+    MTOS_TRACE_SPAN(MTOS_TRACE_FRAME_TX,node,tx_ts,cobs.tx_bytes);
+}
+
+// el buffer del slave elimino n bytes de su comienzo, SIZE_MAX si su contenido cambio
+static void mtos_slave_scan_shift(mtos_instance_t* inst, mtos_scan_t* pattern_scan, size_t n)
+{
+    for (mtos_list_t* node = inst->list_head; node != NULL; node = node->next) {
+        if (n == SIZE_MAX) {
+            node->trigger_scan.token = NULL;
+        }
+        else {
+            mtos_scan_shift(&node->trigger_scan,n);
+        }
+    }
+    if (n == SIZE_MAX) {
+        pattern_scan->token = NULL;
+    }
+    else {
+        mtos_scan_shift(pattern_scan,n);
+    }
+}
+
+// estado del slave, persiste entre los pasos del reactor
+typedef struct {
+    uint8_t *buffer; // bloque de datos donde se reciben los comandos del maestro
+    uint8_t *ptr; // puntero de posicion
+    size_t rx_bytes; // cantidad de bytes recibidos por uart
+    mtos_list_t* node; // puntero donde se cargara el nodo a procesar
+    size_t chunk_max; // max chunk size
+    mtos_header_t current_session;
+    mtos_header_t response;
+    mtos_ext_t session_ext;
+    mtos_scan_t pattern_scan; // busqueda del pattern durante MTOS_SLAVE_CHUNK
+    bool session_has_ext; // el master envio la extension junto al trigger
+    bool session_framed; // las solicitudes y los chunks de la sesion viajan en tramas delimitadas
+    bool request_pending; // sesion con tramas: el primer chunk_request es el header del trigger
+    mtos_header_t first_request;
+    bool push; // fase de chunks de un put local, el bloque sigue tomado por la llamada del master
+    bool pushed; // el put local termino con el ultimo chunk confirmado
+    bool put; // el master remoto envia el bloque, los chunks los recibe la maquina master
+    size_t put_length; // largo del bloque que envia el master remoto
+    uint8_t* put_acc; // acumulador reservado antes de aceptar el put
+    bool op_ready;
+    bool query_ready; // la respuesta al trigger lleva el resultado de una consulta
+    mtos_query_wire_t query; // el operando de la operacion remota llego completo y verificado
+    uint8_t operand[CONFIG_MTOS_REMOTE_OP_MAX];
+    bool trigger_wait; // trigger hallado al comienzo del buffer, se espera el resto de la extension
+    size_t bytes_confirmed;
+    size_t bytes_end; // byte siguiente al ultimo a enviar
+    size_t bytes_to_send;
+    uint8_t* snap; // los chunks salen de esta instantanea del bloque, el semaforo ya se libero
+    mtos_slave_status_t status;
+    mtos_slave_status_t last_status; // estado en el que transcurrio el ultimo paso
+    int64_t state_ts;
+    int64_t state_enter_ts;
+} mtos_slave_t;
+
+static void mtos_slave_reset(mtos_instance_t* inst, mtos_slave_t* slv)
+{
+    uint8_t* buffer = slv->buffer;
+    memset(slv,0,sizeof(mtos_slave_t));
+    slv->buffer = buffer;
+    slv->ptr = buffer;
+    slv->chunk_max = MTOS_BUFFER_AVAILABLE;
+    slv->status = MTOS_SLAVE_IDLE;
+    slv->last_status = slv->status;
+    slv->state_ts = esp_timer_get_time();
+    slv->state_enter_ts = MTOS_TRACE_NOW();
+    mtos_slave_scan_shift(inst,&slv->pattern_scan,SIZE_MAX); // no vale lo examinado antes de la llamada
+}
+
+// deja al slave esperando un trigger con el buffer vacio, como la tarea que se creaba despues de cada llamada
+static void mtos_slave_start(mtos_instance_t* inst, mtos_slave_t* slv)
+{
+    mtos_slave_reset(inst,slv);
+    MTOS_EVT_POST(inst,MTOS_EVENT_SLAVE_INITED,NULL,0);
+}
+
+// la fase de chunks de un put local: el slave remoto pide los chunks del bloque del master como si lo
+// hubiera llamado. El primero sale sin esperar solicitud, con el tamaño que se anuncio en el trigger
+static void mtos_slave_push(mtos_instance_t* inst, mtos_slave_t* slv, mtos_list_t* node, uint16_t max_size, bool framed)
+{
+    mtos_slave_reset(inst,slv);
+    slv->node = node;
+    slv->push = true;
+    slv->session_framed = framed;
+    slv->bytes_end = node->length;
+    slv->first_request.chunk_request.max_size = max_size;
+    slv->first_request.chunk_request.crc8 = esp_rom_crc8_be(0,slv->first_request.raw,sizeof(mtos_header_t)-1);
+    slv->request_pending = true;
+    slv->status = MTOS_SLAVE_CHUNK;
+    slv->last_status = slv->status;
+    inst->slave_to = MILLIS(0);
+}
+
+// el master va a llamar y el slave deja de atender hasta que termine, se libera el bloque de la sesion en curso
+static void mtos_slave_stop(mtos_instance_t* inst, mtos_slave_t* slv)
+{
+    if ((slv->status == MTOS_SLAVE_CHUNK) && slv->node) {
+#if CONFIG_MTOS_SLAVE_SNAPSHOT
+        if (slv->snap) {
+            mtos_snap_release(slv->node);
+        }
+        else
+#endif
+        mtos_give(slv->node);
+        MTOS_EVT_POST(inst,MTOS_EVENT_SLAVE_RELEASED,slv->node->name,sizeof(((mtos_list_t*)0)->name));
+    }
+}
+
+// un paso de la maquina slave, devuelve true si llegaron bytes o cambio de estado
+static bool mtos_slave_step(mtos_instance_t* inst, mtos_slave_t* slv)
+{
+    char *TAG = "mtos_slave";
+    size_t chunk_limit = MTOS_BUFFER_AVAILABLE;
+    MTOS_STATS_STATE(slv->node,slave_state_us,slv->last_status,slv->state_ts);
+    if (slv->status != slv->last_status) {
+        MTOS_TRACE_SPAN(MTOS_TRACE_SLAVE_STATE,slv->node,slv->state_enter_ts,slv->last_status);
+        slv->state_enter_ts = MTOS_TRACE_NOW();
+    }
+    slv->last_status = slv->status;
+    // if timeout abort
+    // durante un put local rige el timeout de la llamada, que controla el reactor
+    if ((MILLIS(inst->slave_to) > inst->slave_timeout)&&(slv->status != MTOS_SLAVE_IDLE)&&!slv->push) {
+        ESP_LOGI(TAG,"timeout expired");
+        slv->status = MTOS_SLAVE_ABORT;
+        MTOS_STATS_ADD(slv->node,timeouts,1);
+        MTOS_TRACE_MARK(MTOS_TRACE_TIMEOUT,slv->node,inst->slave_timeout);
+        MTOS_EVT_POST(inst,MTOS_EVENT_SLAVE_TIMEOUT,(slv->node?slv->node->name:NULL),(slv->node?sizeof(((mtos_list_t*)0)->name):0));
+    }
+    // si el puntero ptr avanzo
+    if (slv->buffer < slv->ptr) {
+        ESP_LOGI(TAG,"buffer < ptr, se elimina %zu bytes procesados",(size_t)(slv->ptr-slv->buffer));
+        ESP_LOG_BUFFER_HEXDUMP(TAG,slv->buffer,slv->ptr-slv->buffer,ESP_LOG_DEBUG);
+        memmove(slv->buffer,slv->ptr,MTOS_BUFFER_SLAVE-(slv->ptr-slv->buffer));
+        slv->rx_bytes -= (slv->ptr-slv->buffer); // se descartan los bytes usados
+        mtos_slave_scan_shift(inst,&slv->pattern_scan,slv->ptr-slv->buffer);
+    }
+    else if ((slv->rx_bytes > CONFIG_MTOS_BUFFER_LEGACY) && !slv->trigger_wait) {
+        ESP_LOGI(TAG,"rx_bytes > CONFIG_MTOS_BUFFER_LEGACY, se eliminan bytes sin informacion");
+        // si no se extrajo ningun dato y rx_bytes se hacerca al final del buffer
+        // se transfiere los bytes mas recientes al comienzo del buffer
+        memmove(slv->buffer,slv->buffer+(slv->rx_bytes-CONFIG_MTOS_BUFFER_LEGACY),CONFIG_MTOS_BUFFER_LEGACY);
+        mtos_slave_scan_shift(inst,&slv->pattern_scan,slv->rx_bytes-CONFIG_MTOS_BUFFER_LEGACY);
+        slv->rx_bytes = CONFIG_MTOS_BUFFER_LEGACY;
+    }
+
+    slv->ptr = slv->buffer;
+
+    // se lee lo que el transporte ya recibio, sin esperar
+    int64_t read_ts = MTOS_TRACE_NOW();
+    size_t last_rx_bytes = slv->rx_bytes;
+    mtos_read_bytes(inst,slv->buffer,&slv->rx_bytes,MTOS_BUFFER_SLAVE);
+    MTOS_TRACE_SPAN(MTOS_TRACE_UART_READ,slv->node,read_ts,slv->rx_bytes);
+    bool progress = (slv->rx_bytes != last_rx_bytes);
+
+    if ((slv->rx_bytes > sizeof(mtos_header_t)) || slv->request_pending) {
+        ESP_LOGI(TAG,"suficientes bytes para analizar");
+        switch (slv->status) {
+            case MTOS_SLAVE_IDLE: {
+                ESP_LOGI(TAG,"MTOS_SLAVE_IDLE");
+                slv->trigger_wait = false;
+                slv->node = inst->list_head;
+                slv->status = MTOS_SLAVE_ABORT;
+                ESP_LOGI(TAG,"buscando nodo");
+                while (slv->node != NULL) {
+                    ESP_LOGI(TAG,"node: %p | trigger: %s",slv->node,slv->node->trigger);
+                    ESP_LOG_BUFFER_HEXDUMP(TAG,slv->buffer,slv->rx_bytes,ESP_LOG_DEBUG);
+                    if (slv->node->slave) {
+                        slv->ptr = mtos_scan(&slv->node->trigger_scan,slv->node->trigger,slv->buffer,slv->rx_bytes);
+                        if ((slv->ptr != NULL) && (slv->ptr+strlen(slv->node->trigger)+sizeof(mtos_header_t) > slv->buffer+slv->rx_bytes)) {
+                            // el header todavia no llego, se reintenta en el proximo ciclo
+                            ESP_LOGI(TAG,"trigger incompleto");
+                            slv->status = MTOS_SLAVE_IDLE;
+                            break;
+                        }
+                        if (slv->ptr != NULL) {
+                            ESP_LOGI(TAG,"trigger found!");
+                            memcpy(&slv->current_session,slv->ptr+strlen(slv->node->trigger),sizeof(mtos_header_t));
+                            MTOS_TRACE_MARK(MTOS_TRACE_FRAME_RX,slv->node,slv->current_session.uint32);
+                            ESP_LOGI(TAG,"recieved crc8: %02X",slv->current_session.chunk_request.crc8);
+                            ESP_LOGI(TAG,"raw: %02X %02X %02X %02X",slv->current_session.raw[0],slv->current_session.raw[1],slv->current_session.raw[2],slv->current_session.raw[3]);
+                            if (mtos_header_check(slv->node,&slv->current_session)) {
+                                ESP_LOGI(TAG,"nodo encontrado");
+                                inst->slave_to = MILLIS(0);
+                                MTOS_STATS_ADD(slv->node,calls,1);
+                                MTOS_EVT_POST(inst,MTOS_EVENT_SLAVE_DEMANDED,slv->node->name,sizeof(((mtos_list_t*)0)->name));
+                                ESP_LOGI(TAG,"timeout reset");
+                                ESP_LOGI(TAG,"recieved trigger:{.max_size:%u,.resend:%u.crc8:%x}",
+                                slv->current_session.chunk_request.max_size,
+                                slv->current_session.chunk_request.resend,
+                                slv->current_session.chunk_request.crc8);
+                                slv->chunk_max = (slv->current_session.chunk_request.max_size < chunk_limit ?
+                                    slv->current_session.chunk_request.max_size : chunk_limit);
+                                slv->session_has_ext = (slv->current_session.chunk_request.resend & MTOS_TRIGGER_EXT);
+                                if (slv->current_session.chunk_request.resend & ~MTOS_TRIGGER_EXT) {
+                                    ESP_LOGI(TAG,"error: trigger con comando de resend => MTOS_SLAVE_ABORT");
+                                }
+                                else {
+                                    ESP_LOGI(TAG,">>>reacomodamiento inicial de buffer");
+                                    ESP_LOGI(TAG,"rx_bytes: %zu",slv->rx_bytes);
+                                    ESP_LOG_BUFFER_HEXDUMP(TAG,slv->buffer,slv->rx_bytes,ESP_LOG_DEBUG);
+                                    uint8_t* aux = slv->ptr;
+                                    if (aux && slv->session_has_ext) {
+                                        uint8_t* ext_ptr = aux+strlen(slv->node->trigger)+sizeof(mtos_header_t);
+                                        if (ext_ptr+sizeof(mtos_ext_t) > slv->buffer+slv->rx_bytes) {
+                                            // la extension todavia no llego, se reintenta en el proximo ciclo
+                                            ESP_LOGI(TAG,"extension incompleta");
+                                            slv->trigger_wait = true;
+                                            slv->status = MTOS_SLAVE_IDLE;
+                                            break;
+                                        }
+                                        memcpy(&slv->session_ext,ext_ptr,sizeof(mtos_ext_t));
+                                        if (!mtos_ext_check(slv->node,&slv->session_ext)) {
+                                            // sin una extension valida se comienza desde el byte cero
+                                            memset(&slv->session_ext,0,sizeof(mtos_ext_t));
+                                        }
+                                        size_t ext_len = sizeof(mtos_ext_t);
+                                        slv->op_ready = false;
+                                        if ((slv->session_ext.session.flags & MTOS_EXT_OP) && (slv->session_ext.op.length <= CONFIG_MTOS_REMOTE_OP_MAX)) {
+                                            // el operando y su crc32 siguen a la extension
+                                            uint8_t* op_ptr = ext_ptr+sizeof(mtos_ext_t);
+                                            size_t op_len = slv->session_ext.op.length;
+                                            mtos_crc32_t op_crc;
+                                            if (op_ptr+op_len+sizeof(mtos_crc32_t) > slv->buffer+slv->rx_bytes) {
+                                                ESP_LOGI(TAG,"operando incompleto");
+                                                slv->trigger_wait = true;
+                                                slv->status = MTOS_SLAVE_IDLE;
+                                                break;
+                                            }
+                                            memcpy(op_crc.raw,op_ptr+op_len,sizeof(mtos_crc32_t));
+                                            if (esp_rom_crc32_be(0,op_ptr,op_len) != op_crc.value) {
+                                                // operando corrompido, sin respuesta el master reenvia el trigger
+                                                ESP_LOGI(TAG,"fallo verif. crc32 del operando");
+                                                MTOS_STATS_ADD(slv->node,crc32_errors,1);
+                                                slv->node = NULL;
+                                                break;
+                                            }
+                                            memcpy(slv->operand,op_ptr,op_len);
+                                            slv->op_ready = true;
+                                            ext_len += op_len+sizeof(mtos_crc32_t);
+                                        }
+#if CONFIG_MTOS_FRAMED
+                                        slv->session_framed = (slv->session_ext.session.flags & MTOS_EXT_FRAMED);
+#endif
+                                        // se quita la extension del buffer, al header le sigue lo que venga detras
+                                        memmove(ext_ptr,ext_ptr+ext_len,slv->buffer+slv->rx_bytes-(ext_ptr+ext_len));
+                                        slv->rx_bytes -= ext_len;
+                                    }
+                                    if (aux && slv->session_framed) {
+                                        // el header del trigger es el primer chunk_request, sin los flags;
+                                        // los siguientes llegan en tramas y se quita el trigger del buffer
+                                        slv->first_request = slv->current_session;
+                                        slv->first_request.chunk_request.resend = 0;
+                                        slv->first_request.chunk_request.crc8 = esp_rom_crc8_be(0,slv->first_request.raw,sizeof(mtos_header_t)-1);
+                                        slv->request_pending = true;
+                                        size_t removed_header_length = aux+strlen(slv->node->trigger)+sizeof(mtos_header_t)-slv->buffer;
+                                        memmove(slv->buffer,slv->buffer+removed_header_length,slv->rx_bytes-removed_header_length);
+                                        slv->rx_bytes -= removed_header_length;
+                                        mtos_slave_scan_shift(inst,&slv->pattern_scan,SIZE_MAX);
+                                    }
+                                    else if (aux) {
+                                        size_t removed_header_length = aux+strlen(slv->node->trigger)-slv->buffer;
+                                        memmove(slv->buffer+strlen(slv->node->pattern),slv->buffer+removed_header_length,slv->rx_bytes-removed_header_length);
+                                        memcpy(slv->buffer,slv->node->pattern,strlen(slv->node->pattern));
+                                        // el buffer queda con el pattern en lugar del trigger y lo que le seguia
+                                        slv->rx_bytes += strlen(slv->node->pattern);
+                                        slv->rx_bytes -= removed_header_length;
+                                        if (slv->session_has_ext) {
+                                            // el header del trigger se procesa como primer chunk_request, sin los flags
+                                            mtos_header_t first = slv->current_session;
+                                            first.chunk_request.resend = 0;
+                                            first.chunk_request.crc8 = esp_rom_crc8_be(0,first.raw,sizeof(mtos_header_t)-1);
+                                            memcpy(slv->buffer+strlen(slv->node->pattern),first.raw,sizeof(mtos_header_t));
+                                        }
+                                        ESP_LOGI(TAG,"rx_bytes: %zu",slv->rx_bytes);
+                                        ESP_LOG_BUFFER_HEXDUMP(TAG,slv->buffer,slv->rx_bytes,ESP_LOG_DEBUG);
+                                        ESP_LOGI(TAG,"<<<");
+                                        mtos_slave_scan_shift(inst,&slv->pattern_scan,SIZE_MAX);
+                                    }
+                                    slv->status = MTOS_SLAVE_INIT;
+                                    slv->ptr = slv->buffer;
+                                }
+                                break; // sale de loop con node asignado
+                            }
+                            else {
+                                ESP_LOGI(TAG,"fallo verif. crc8");
+                                // trigger corrupto, se sigue buscando detras de el sin esperar a que se descarte
+                                mtos_scan_skip(&slv->node->trigger_scan,slv->buffer,slv->ptr);
+                            }
+                        }
+                        else {
+                            ESP_LOGI(TAG,"trigger not found.");
+                        }
+                    }
+                    slv->node = slv->node->next;
+                }
+                if (slv->node == NULL) {
+                    // se conservan los bytes que pueden ser el comienzo de un trigger cortado entre lecturas
+                    size_t keep_from = slv->rx_bytes;
+                    for (mtos_list_t* n = inst->list_head; n != NULL; n = n->next) {
+                        if (n->slave && (n->trigger_scan.token == n->trigger) && (n->trigger_scan.matched > 0) &&
+                            (n->trigger_scan.scanned-n->trigger_scan.matched < keep_from)) {
+                            keep_from = n->trigger_scan.scanned-n->trigger_scan.matched;
+                        }
+                    }
+                    if (keep_from < slv->rx_bytes) {
+                        ESP_LOGI(TAG,"trigger parcial, se espera el resto");
+                        slv->ptr = slv->buffer+keep_from;
+                        slv->status = MTOS_SLAVE_IDLE;
+                        break;
+                    }
+                    ESP_LOGI(TAG,"error: nodo no encontrado => MTOS_SLAVE_ABORT");
+                    break;
+                }
+            }
+            case MTOS_SLAVE_INIT: {
+                ESP_LOGI(TAG,"MTOS_SLAVE_INIT");
+                if (slv->status == MTOS_SLAVE_ABORT) {
+                    ESP_LOGI(TAG,"falltrough con status en MTOS_SLAVE_ABORT se aborta");
+                    break;
+                }
+                if (slv->status == MTOS_SLAVE_IDLE) {
+                    ESP_LOGI(TAG,"falltrough con status en MTOS_SLAVE_IDLE, trigger incompleto");
+                    break;
+                }
+                if (mtos_take(slv->node, (inst->slave_timeout)/portTICK_PERIOD_MS) != pdTRUE) {
+                    ESP_LOGI(TAG,"no se pudo tomar el semaforo a tiempo");
+                    slv->status = MTOS_SLAVE_ABORT;
+                    break;
+                }
+                else {
+                    // trigger response
+                    mtos_crc_sync(slv->node);
+                    ESP_LOGI(TAG,"semaforo tomado (%p), se prosesa la respuesta al trigger",slv->node->smphr);
+                    bool no_chunks = false; // el master ya tiene esta version o envia la suya, no se envian chunks
+                    slv->bytes_end = slv->node->length;
+                    slv->response.trigger_response.payload_length = slv->node->length;
+                    if (slv->session_has_ext) {
+                        uint8_t accepted = 0;
+                        if (slv->session_ext.session.flags & MTOS_EXT_OP) {
+                            // operacion remota: se aplica sobre el bloque y la respuesta lleva su nuevo crc32
+                            slv->response.trigger_response.payload_length = 0;
+                            no_chunks = true;
+                            if (slv->session_ext.op.code >= MTOS_OP_QUERY) {
+                                // consulta: se recorre el bloque con el semaforo tomado y solo viaja el resultado
+#if CONFIG_MTOS_REMOTE_QUERIES
+                                if (slv->op_ready && mtos_query_run(slv->node,slv->session_ext.op.code,slv->session_ext.op.offset,
+                                    slv->session_ext.op.count,slv->operand,slv->session_ext.op.length,&slv->query)) {
+                                    ESP_LOGI(TAG,"consulta %u sobre %" PRIu32 " elementos",slv->session_ext.op.code-MTOS_OP_QUERY,slv->query.count);
+                                    accepted = MTOS_EXT_OP;
+                                    slv->query_ready = true;
+                                }
+#endif
+                            }
+#if CONFIG_MTOS_REMOTE_OPS
+                            else if (slv->op_ready && slv->node->op_seq && (slv->session_ext.op.seq == slv->node->op_seq) &&
+                                (slv->node->crc32.value == slv->node->op_crc)) {
+                                // el master no recibio la respuesta y reenvio el trigger, ya se aplico
+                                ESP_LOGI(TAG,"operacion %u repetida",slv->session_ext.op.seq);
+                                accepted = MTOS_EXT_OP;
+                            }
+                            else if ((slv->session_ext.session.flags & MTOS_EXT_SEQ) && slv->node->op_seq &&
+                                (slv->session_ext.op.seq != MTOS_SEQ_NEXT(slv->node->op_seq))) {
+                                // falta una operacion de la replica, el master envia el bloque completo
+                                ESP_LOGI(TAG,"operacion %u fuera de secuencia, la ultima fue %u",slv->session_ext.op.seq,slv->node->op_seq);
+                            }
+                            else if (slv->op_ready && mtos_op_apply(slv->node,slv->session_ext.op.code,slv->session_ext.op.offset,
+                                slv->session_ext.op.count,slv->operand,slv->session_ext.op.length)) {
+                                ESP_LOGI(TAG,"operacion %u aplicada",slv->session_ext.op.code);
+                                mtos_crc_sync(slv->node);
+                                slv->node->op_seq = slv->session_ext.op.seq;
+                                slv->node->op_crc = slv->node->crc32.value;
+                                accepted = MTOS_EXT_OP;
+                                MTOS_EVT_POST(inst,MTOS_EVENT_SLAVE_WRITTEN,slv->node->name,sizeof(((mtos_list_t*)0)->name));
+                            }
+#endif
+                        }
+                        else if (slv->session_ext.session.flags & MTOS_EXT_PUT) {
+                            // el master envia su copia del bloque, que reemplaza a la del slave
+                            slv->response.trigger_response.payload_length = 0;
+                            no_chunks = true;
+#if CONFIG_MTOS_PUT
+                            if ((slv->session_ext.session.length == slv->node->length) &&
+                                (slv->session_ext.session.crc32 == slv->node->crc32.value)) {
+                                ESP_LOGI(TAG,"put sin cambios, se responde sin pedir chunks");
+                                slv->node->op_seq = 0; // la replica sigue desde este bloque, con cualquier numero
+                                accepted = MTOS_EXT_PUT|MTOS_EXT_UNCHANGED;
+                                MTOS_STATS_ADD(slv->node,unchanged,1);
+                            }
+                            else if (slv->node->external && (slv->session_ext.session.length > slv->node->capacity)) {
+                                // el buffer de la aplicacion no crece, se rechaza antes de recibir los chunks
+                                ESP_LOGI(TAG,"put de %u bytes no entra en %zu",slv->session_ext.session.length,slv->node->capacity);
+                                MTOS_EVT_POST(inst,MTOS_EVENT_SLAVE_ALLOC_ERROR,slv->node->name,sizeof(((mtos_list_t*)0)->name));
+                            }
+                            else if ((slv->put_acc = mtos_acc_alloc(inst,slv->session_ext.session.length)) != NULL) {
+                                ESP_LOGI(TAG,"put aceptado, %u bytes alocados",slv->session_ext.session.length);
+                                accepted = MTOS_EXT_PUT;
+                                slv->put = true;
+                                slv->put_length = slv->session_ext.session.length;
+                            }
+                            else {
+                                MTOS_EVT_POST(inst,MTOS_EVENT_SLAVE_ALLOC_ERROR,slv->node->name,sizeof(((mtos_list_t*)0)->name));
+                            }
+#endif
+                        }
+                        else if (slv->session_ext.session.flags & MTOS_EXT_RANGE) {
+                            // solo se envia la porcion solicitada, recortada al largo del bloque
+                            slv->bytes_confirmed = (slv->session_ext.session.offset < slv->node->length ? slv->session_ext.session.offset : slv->node->length);
+                            slv->bytes_end = (slv->session_ext.session.length < slv->node->length-slv->bytes_confirmed ?
+                                slv->bytes_confirmed+slv->session_ext.session.length : slv->node->length);
+                            slv->response.trigger_response.payload_length = slv->bytes_end-slv->bytes_confirmed;
+                            accepted = MTOS_EXT_RANGE;
+                        }
+#if CONFIG_MTOS_RESUME
+                        // se retoma desde donde quedo el master si el bloque no cambio desde entonces
+                        else if ((slv->session_ext.session.flags & MTOS_EXT_RESUME) &&
+                            (slv->session_ext.session.offset > 0) && (slv->session_ext.session.offset < slv->node->length) &&
+                            (slv->session_ext.session.crc32 == slv->node->crc32.value)) {
+                            ESP_LOGI(TAG,"transferencia retomada desde el byte %u",slv->session_ext.session.offset);
+                            slv->bytes_confirmed = slv->session_ext.session.offset;
+                            accepted = MTOS_EXT_RESUME;
+                            MTOS_STATS_ADD(slv->node,resumes,1);
+                            MTOS_EVT_POST(inst,MTOS_EVENT_SLAVE_RESUMED,slv->node->name,sizeof(((mtos_list_t*)0)->name));
+                        }
+#endif
+#if CONFIG_MTOS_CONDITIONAL
+                        else if ((slv->session_ext.session.flags & MTOS_EXT_UNCHANGED) &&
+                            (slv->session_ext.session.length == slv->node->length) &&
+                            (slv->session_ext.session.crc32 == slv->node->crc32.value)) {
+                            ESP_LOGI(TAG,"bloque sin cambios, se responde sin payload");
+                            slv->response.trigger_response.payload_length = 0;
+                            accepted = MTOS_EXT_UNCHANGED;
+                            no_chunks = true;
+                            MTOS_STATS_ADD(slv->node,unchanged,1);
+                        }
+#endif
+                        if (slv->session_framed) {
+                            accepted |= MTOS_EXT_FRAMED;
+                        }
+                        memset(&slv->session_ext,0,sizeof(mtos_ext_t));
+                        slv->session_ext.session.flags = accepted;
+                        slv->session_ext.session.offset = slv->bytes_confirmed;
+                        slv->session_ext.session.length = slv->node->length;
+                        slv->session_ext.session.crc32 = slv->node->crc32.value;
+                        slv->session_ext.session.crc8 = esp_rom_crc8_be(0,slv->session_ext.raw,sizeof(mtos_ext_t)-1);
+                    }
+                    slv->response.trigger_response.crc8 = esp_rom_crc8_be(0,slv->response.raw,sizeof(mtos_header_t)-1);
+                    ESP_LOGI(TAG,"sending trigger_response:{.payload_length:%u,.crc8:%x}",
+                        slv->response.trigger_response.payload_length,
+                        slv->response.trigger_response.crc8);
+                    mtos_send_bytes(inst,slv->node->trigger,&slv->response,(slv->session_has_ext ? &slv->session_ext : NULL),
+                        (slv->query_ready ? &slv->query : NULL),sizeof(mtos_query_wire_t));
+                    slv->query_ready = false;
+                    memset(&slv->response,'\0',sizeof(mtos_header_t));
+                    if (slv->put) {
+                        // el reactor pasa la sesion a la maquina master, que se queda con el bloque tomado
+                        break;
+                    }
+                    if (no_chunks) {
+                        // el master no pide chunks, se consume el primer chunk_request y se libera el bloque
+                        slv->ptr = (slv->session_framed ? slv->buffer : slv->buffer+strlen(slv->node->pattern)+sizeof(mtos_header_t));
+                        slv->status = MTOS_SLAVE_ENDING;
+                        break;
+                    }
+#if CONFIG_MTOS_SLAVE_SNAPSHOT
+                    if (!MTOS_SEGMENTED(slv->node) && !slv->node->external) {
+                        // los chunks salen del buffer actual y los escritores locales siguen sobre una copia
+                        slv->snap = mtos_snap_begin(slv->node);
+                        mtos_give(slv->node);
+                        ESP_LOGI(TAG,"semaforo liberado, se envia la instantanea %p",slv->snap);
+                    }
+#endif
+                    slv->status = MTOS_SLAVE_CHUNK;
+                }
+            }
+            case MTOS_SLAVE_CHUNK: {
+                // chunk response
+                ESP_LOGI(TAG,"MTOS_SLAVE_CHUNK");
+                slv->status = MTOS_SLAVE_ABORT;
+                if (slv->node != NULL) {
+                    if (slv->node->slave || slv->push) {
+                        slv->status = MTOS_SLAVE_CHUNK;
+                        uint8_t* request = NULL; // header del chunk_request hallado
+                        uint8_t* request_end = NULL; // byte siguiente al chunk_request
+                        uint8_t frame[MTOS_FRAME_HEAD]; // chunk_request decodificado de una trama
+                        uint8_t* trigger_at = NULL;
+                        slv->ptr = slv->buffer;
+                        if (slv->request_pending) {
+                            request = slv->first_request.raw;
+                            request_end = slv->buffer; // ya se quito del buffer junto al trigger
+                            slv->request_pending = false;
+                        }
+                        else if (slv->session_framed) {
+                            uint8_t* delim = mtos_frame_scan(&slv->pattern_scan,slv->buffer,slv->rx_bytes);
+                            if (delim != NULL) {
+                                if (mtos_frame_open(slv->node,slv->buffer,delim-slv->buffer,frame,sizeof(frame)) == sizeof(frame)) {
+                                    request = frame+sizeof(uint16_t);
+                                    request_end = delim+1;
+                                }
+                                else {
+                                    // trama mal formada o de otro bloque, se descarta hasta el delimitador
+                                    ESP_LOGI(TAG,"trama invalida");
+                                    slv->ptr = delim+1;
+                                }
+                            }
+                        }
+                        else {
+                            uint8_t* at = mtos_scan(&slv->pattern_scan,slv->node->pattern,slv->buffer,slv->rx_bytes);
+                            if ((at != NULL) && (at+strlen(slv->node->pattern)+sizeof(mtos_header_t) > slv->buffer+slv->rx_bytes)) {
+                                // el header todavia no llego, se conserva desde el pattern
+                                ESP_LOGI(TAG,"chunk_request incompleto");
+                                slv->ptr = at;
+                            }
+                            else if (at != NULL) {
+                                request = at+strlen(slv->node->pattern);
+                                request_end = request+sizeof(mtos_header_t);
+                            }
+                        }
+                        if (request != NULL) {
+                            ESP_LOGI(TAG,"pattern found!");
+                            memcpy(&slv->current_session,request,sizeof(mtos_header_t));
+                            MTOS_TRACE_MARK(MTOS_TRACE_FRAME_RX,slv->node,slv->current_session.uint32);
+                            ESP_LOGI(TAG,"recieved crc8: %02X",slv->current_session.chunk_request.crc8);
+                            ESP_LOGI(TAG,"raw: %02X %02X %02X %02X",slv->current_session.raw[0],slv->current_session.raw[1],slv->current_session.raw[2],slv->current_session.raw[3]);
+                            if (mtos_header_check(slv->node,&slv->current_session)) {
+                                inst->slave_to = MILLIS(0);
+                                if (slv->push) {
+                                    inst->master_to = MILLIS(0);
+                                }
+                                ESP_LOGI(TAG,"timeout reset");
+                                ESP_LOGI(TAG,"recieved chunk_request:{.max_size:%u,.resend:%u.crc8:%x}",
+                                    slv->current_session.chunk_request.max_size,
+                                    slv->current_session.chunk_request.resend,
+                                    slv->current_session.chunk_request.crc8);
+                                slv->chunk_max = (slv->current_session.chunk_request.max_size < chunk_limit ?
+                                    slv->current_session.chunk_request.max_size : chunk_limit);
+                                if (slv->session_framed && (slv->chunk_max > MTOS_FRAME_CHUNK_MAX)) {
+                                    slv->chunk_max = MTOS_FRAME_CHUNK_MAX;
+                                }
+                                // el loop de eventos copia los datos del evento, alcanza con una variable local
+                                mtos_event_chunk_t evt = {};
+                                evt.chunk_rq.max_size = slv->current_session.chunk_request.max_size;
+                                evt.chunk_rq.tx_size = slv->chunk_max;
+                                evt.chunk_rq.resend = slv->current_session.chunk_request.resend;
+                                evt.chunk_rq.name = slv->node->name;
+                                MTOS_EVT_POST(inst,MTOS_EVENT_SLAVE_CHUNK_RQ,&evt,sizeof(mtos_event_chunk_t));
+                                if (slv->current_session.chunk_request.resend == 0) {
+                                    slv->bytes_confirmed += slv->bytes_to_send;
+                                    slv->bytes_to_send = slv->bytes_confirmed + slv->chunk_max > slv->bytes_end ? slv->bytes_end - slv->bytes_confirmed : slv->chunk_max;
+                                    slv->response.chunk_response.count++;
+                                    if (slv->bytes_confirmed == slv->bytes_end) {
+                                        MTOS_EVT_POST(inst,MTOS_EVENT_SLAVE_FINISHED,slv->node->name,sizeof(((mtos_list_t*)0)->name));
+                                        slv->ptr = request_end; // se consume la ultima solicitud
+                                        slv->status = MTOS_SLAVE_ENDING;
+                                        break;
+                                    }
+                                    // en un blob segmentado el chunk no cruza el final del segmento; se recorta despues
+                                    // de ver el final, un blob vacio o multiplo del segmento no tiene segmento en bytes_end
+                                    mtos_block_at(slv->node,slv->bytes_confirmed,&slv->bytes_to_send);
+                                }
+                                uint8_t* send_ptr = (slv->snap ? slv->snap+slv->bytes_confirmed :
+                                    mtos_block_at(slv->node,slv->bytes_confirmed,&slv->bytes_to_send));
+                                slv->response.chunk_response.size = slv->bytes_to_send;
+                                slv->response.chunk_response.crc8 = esp_rom_crc8_be(0,slv->response.raw,sizeof(mtos_header_t)-1);
+                                if (slv->session_framed) {
+                                    mtos_send_frame(inst,slv->node,&slv->response,send_ptr,slv->bytes_to_send);
+                                }
+                                else {
+                                    mtos_send_bytes(inst,slv->node->pattern,&slv->response,NULL,send_ptr,slv->bytes_to_send);
+                                }
+                                if (slv->current_session.chunk_request.resend) {
+                                    MTOS_STATS_ADD(slv->node,resends,1);
+                                }
+                                else {
+                                    MTOS_STATS_ADD(slv->node,bytes,slv->bytes_to_send);
+                                    MTOS_STATS_ADD(slv->node,chunks,1);
+                                }
+                            }
+                            slv->ptr = request_end;
+                        }
+                        else if (!slv->push && ((trigger_at = mtos_scan(&slv->node->trigger_scan,slv->node->trigger,slv->buffer,slv->rx_bytes)) != NULL)) {
+                            // el master no recibio la respuesta al trigger y lo reenvio, se reinicia
+                            // la sesion conservando el trigger para procesarlo en MTOS_SLAVE_IDLE
+                            ESP_LOGI(TAG,"trigger repetido, se reinicia la sesion");
+                            slv->ptr = trigger_at;
+                            slv->status = MTOS_SLAVE_ENDING;
+                        }
+                        else {
+                            ESP_LOGI(TAG,"pattern not found!");
+                        }
+                    }
+                }
+                if (slv->status == MTOS_SLAVE_ABORT) {
+                    ESP_LOGI(TAG,"error en node seleccionado => MTOS_SLAVE_ABORT");
+                }
+            }
+            default: break;
+        }
+    }
+
+    if ((slv->status == MTOS_SLAVE_ABORT)||(slv->status == MTOS_SLAVE_ENDING)) {
+        // luego de la finalizacion o el aborto, se reinicia el estado
+        ESP_LOGI(TAG,"MTOS_SLAVE_ABORT/MTOS_SLAVE_ENDING");
+        if (slv->push) {
+            // el bloque lo libera la llamada put al cerrarse en la maquina master
+            slv->pushed = (slv->status == MTOS_SLAVE_ENDING);
+            slv->push = false;
+        }
+        else {
+#if CONFIG_MTOS_SLAVE_SNAPSHOT
+            if (slv->node && slv->snap) {
+                // el semaforo se libero despues del trigger, solo queda soltar la instantanea
+                mtos_snap_release(slv->node);
+            }
+            else
+#endif
+            if (slv->node) {
+                ESP_LOGI(TAG,"smphr: %p",slv->node->smphr);
+                mtos_give(slv->node);
+                ESP_LOGI(TAG,"semaforo liberado");
+            }
+            MTOS_EVT_POST(inst,MTOS_EVENT_SLAVE_RELEASED,(slv->node?slv->node->name:NULL),(slv->node?sizeof(((mtos_list_t*)0)->name):0));
+        }
+        if (slv->status == MTOS_SLAVE_ABORT) {
+            slv->rx_bytes = 0;
+            slv->ptr = slv->buffer;
+            mtos_slave_scan_shift(inst,&slv->pattern_scan,SIZE_MAX);
+        }
+        slv->pattern_scan.token = NULL; // la proxima sesion puede ser de otro bloque
+        // al finalizar se conserva lo recibido despues de la ultima solicitud, puede ser el proximo trigger
+        slv->bytes_confirmed = 0;
+        slv->bytes_to_send = 0;
+        slv->snap = NULL;
+        slv->session_has_ext = false;
+        slv->session_framed = false;
+        slv->request_pending = false;
+        slv->node = NULL;
+        slv->status = MTOS_SLAVE_IDLE;
+    }
+    return (progress || (slv->status != slv->last_status));
+}
+
+// estado del master, persiste entre los pasos del reactor y entre llamadas
+typedef struct {
+    uint8_t *buffer; // bloque de datos donde se reciben los bloques enviados por uart
+    uint8_t *ptr; // puntero a una posicion dentro del bloque reservado
+    uint8_t *acc;  // acumulador de chunks
+    size_t rx_bytes; // cantidad de bytes recibidos por uart
+    size_t payload_size; // cantidad de bytes totales a recibir
+    size_t payload_count; // canidad de bytes recibidos
+    mtos_list_t* node; // puntero donde se cargara el nodo a procesar
+    mtos_call_t call; // solicitud en curso
+    bool busy; // hay una llamada en curso
+    bool push; // fase de chunks de un put, la maquina slave envia el bloque
+    bool incoming; // put del master remoto, se reciben los chunks sobre un bloque del slave
+    size_t remote_length; // largo del bloque completo en el slave
+    mtos_master_status_t status; // estado de la maquina de estado
+    mtos_header_t extracted; // variable auxiliar donde se volcaran los headers que se vayan recibiendo
+    mtos_header_t outgoing; // headers que se utilizan en los mensajes de request
+    mtos_ext_t ext; // extension del trigger y de su respuesta
+#if CONFIG_MTOS_RESUME
+    uint32_t payload_crc; // version del bloque remoto que se esta recibiendo
+#endif
+    char* token; // puntero donde se asigna el string que se desea buscar en el buffer de datos recibidos
+    size_t token_len; // largo del string que se desea buscar en el buffer de datos recibidos
+    mtos_scan_t scan; // busqueda de token, no vuelve a examinar lo ya recibido
+    bool framed; // el slave acepto tramas delimitadas para los chunks de esta sesion
+    int64_t rq_ts; // instante del ultimo request enviado, para la medicion de rtt
+    uint32_t stall_ts; // ultima vez que llegaron bytes o se envio un request
+    uint32_t stall_ms; // espera sin bytes antes de pedir una retransmision, se duplica en cada intento
+    uint8_t retries; // retransmisiones por demora seguidas sin respuesta
+    bool stalled; // se pidio una retransmision por demora despues del ultimo request
+    bool plain; // el trigger se envia sin extension, como lo entiende un slave anterior a ella
+    uint8_t chunk_seq; // count del ultimo chunk aceptado
+    mtos_master_status_t last_status; // estado en el que transcurrio el ultimo paso
+    int64_t state_ts;
+    int64_t state_enter_ts;
+} mtos_master_t;
+
+// estimador de rtt del RFC 6298 (ganancias 1/8 y 1/4), alimentado con la espera de cada respuesta
+static void mtos_rto_sample(mtos_list_t* node, uint32_t rtt_us)
+{
+    rtt_us = (rtt_us ? rtt_us : 1); // srtt_us en cero indica que no hay muestras
+    if (node->srtt_us == 0) {
+        node->srtt_us = rtt_us;
+        node->rttvar_us = rtt_us/2;
+    }
+    else {
+        uint32_t err = (rtt_us > node->srtt_us ? rtt_us-node->srtt_us : node->srtt_us-rtt_us);
+        node->rttvar_us = node->rttvar_us-node->rttvar_us/4+err/4;
+        node->srtt_us = node->srtt_us-node->srtt_us/8+rtt_us/8;
+    }
+}
+
+// espera sin respuesta antes de retransmitir un request, MTOS_STALL_MS hasta la primera muestra
+static uint32_t mtos_rto_ms(mtos_list_t* node)
+{
+    if (node->srtt_us == 0) {
+        return MTOS_STALL_MS;
+    }
+    uint32_t rto = (node->srtt_us+4*node->rttvar_us+999)/1000;
+    return (rto > MTOS_RTO_MIN_MS ? rto : MTOS_RTO_MIN_MS);
+}
+
+// retransmision por demora: la espera se duplica, sin pasar el timeout de la llamada, hasta la proxima respuesta
+static void mtos_master_backoff(mtos_master_t* mst)
+{
+    mst->stall_ts = MILLIS(0);
+    if (mst->stall_ms < mst->call.timeout_ms) {
+        mst->stall_ms *= 2;
+    }
+    if (mst->retries < UINT8_MAX) {
+        mst->retries++;
+    }
+}
+
+#if CONFIG_MTOS_REPLICATE
+// arma la proxima parte de la replicacion con el semaforo tomado: el cambio de largo, luego los bytes
+// modificados de a operandos completos, o un put si conviene enviar el bloque entero
+static void mtos_repl_slice(mtos_master_t* mst)
+{
+    mtos_list_t* node = mst->node;
+    if (!node->repl || !mtos_repl_dirty(node) || (node->length > MTOS_EXT_MAX)) {
+        // nada que enviar, la llamada se cierra sin tocar el enlace
+        node->repl_queued = false;
+        mst->call.repl = false;
+        mst->status = MTOS_MASTER_ABORT;
+        return;
+    }
+    if (node->repl_hi > node->length) {
+        node->repl_hi = node->length;
+    }
+    if (node->repl_lo >= node->repl_hi) {
+        node->repl_lo = 0;
+        node->repl_hi = 0;
+    }
+    size_t dirty = node->repl_hi-node->repl_lo;
+    if (node->repl_full || ((dirty > CONFIG_MTOS_REMOTE_OP_MAX) && (dirty > node->length/2))) {
+        mst->call.put = true;
+        node->repl_full = false;
+        node->repl_lo = 0;
+        node->repl_hi = 0;
+        node->repl_length = node->length;
+    }
+    else if (node->repl_length != node->length) {
+        mst->call.op = MTOS_OP_RESIZE;
+        mst->call.op_count = node->length;
+        node->repl_length = node->length;
+    }
+    else {
+        mst->call.op = MTOS_OP_WRITE;
+        mst->call.offset = node->repl_lo;
+        mst->call.op_length = (dirty < CONFIG_MTOS_REMOTE_OP_MAX ? dirty : CONFIG_MTOS_REMOTE_OP_MAX);
+        mtos_block_copy(node,node->repl_lo,mst->call.operand,mst->call.op_length,false);
+        node->repl_lo += mst->call.op_length;
+    }
+}
+
+// fin de una parte de la replicacion, antes de devolver el semaforo
+static void mtos_repl_close(mtos_instance_t* inst, mtos_master_t* mst)
+{
+    mtos_list_t* node = mst->node;
+    if (mst->status == MTOS_MASTER_ABORT) {
+        // sin respuesta la parte pudo aplicarse o no, la proxima modificacion envia el bloque completo
+        node->repl_full = true;
+        node->repl_queued = false;
+    }
+    else if (mtos_repl_dirty(node)) {
+        node->repl_more = true;
+        inst->repl_more = true;
+    }
+    else {
+        node->repl_queued = false;
+        MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_REPLICATED,node->name,sizeof(((mtos_list_t*)0)->name));
+    }
+}
+
+// proximo bloque con una replicacion a medias, el reactor la continua cuando no hay otras llamadas
+static bool mtos_repl_next(mtos_instance_t* inst, mtos_call_t* call)
+{
+    for (mtos_list_t* node = inst->list_head; node != NULL; node = node->next) {
+        if (node->repl_more) {
+            node->repl_more = false;
+            memset(call,0,sizeof(mtos_call_t));
+            call->node = node;
+            call->timeout_ms = node->repl_timeout_ms;
+            call->max_chunk_size = node->repl_max_chunk_size;
+            call->repl = true;
+            return true;
+        }
+    }
+    inst->repl_more = false;
+    return false;
+}
+#endif
+
+// comienza la llamada mst->call, el bloque queda tomado hasta que termine
+static void mtos_master_begin(mtos_instance_t* inst, mtos_master_t* mst)
+{
+    char *TAG = "mtos_master";
+    mst->node = mst->call.node;
+    MTOS_STATS_STATE(NULL,master_state_us,MTOS_MASTER_IDLE,mst->state_ts);
+    MTOS_STATS_ADD(mst->node,calls,1);
+    MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_CALL,mst->node->name,sizeof(((mtos_list_t*)0)->name));
+    ESP_LOGI(TAG,"node recibido por queue");
+    inst->master_to = MILLIS(0);
+    ESP_LOGI(TAG,"timeout reset");
+    mtos_take(mst->node, (mst->call.timeout_ms+10)/portTICK_PERIOD_MS);
+    ESP_LOGI(TAG,"node smphr taken");
+#if CONFIG_MTOS_REPLICATE
+    if (mst->call.repl) {
+        mtos_repl_slice(mst);
+    }
+#endif
+    if (mst->call.op && (mst->call.op < MTOS_OP_QUERY)) {
+        // las operaciones se numeran al salir de la cola, en el orden en que las recibe el slave
+        if (mst->node->op_seq == 0) {
+            // numeracion distinta en cada arranque, el slave puede recordar una operacion de antes del reinicio
+            mst->node->op_seq = (uint16_t)esp_timer_get_time();
+        }
+        mst->node->op_seq = MTOS_SEQ_NEXT(mst->node->op_seq);
+        mst->call.op_seq = mst->node->op_seq;
+    }
+    mst->node->call_timed_out = false;
+    mst->plain = mst->node->legacy && MTOS_CALL_PLAIN(&mst->call);
+    mst->stall_ts = MILLIS(0);
+    mst->stall_ms = mtos_rto_ms(mst->node);
+    mst->retries = 0;
+    mst->stalled = false;
+    mst->chunk_seq = 0;
+    mst->busy = true;
+}
+
+// put del master remoto: el slave ya tomo el bloque al responder el trigger y la maquina master recibe
+// los chunks sobre el, pidiendolos como en una llamada propia
+static void mtos_master_accept(mtos_instance_t* inst, mtos_master_t* mst, mtos_slave_t* slv)
+{
+    MTOS_STATS_STATE(NULL,master_state_us,MTOS_MASTER_IDLE,mst->state_ts);
+    memset(&mst->call,0,sizeof(mtos_call_t));
+    mst->call.node = slv->node;
+    mst->call.timeout_ms = inst->slave_timeout;
+    mst->call.max_chunk_size = slv->chunk_max;
+    mst->node = slv->node;
+    mst->incoming = true;
+    mst->acc = slv->put_acc;
+    mst->payload_size = slv->put_length;
+    mst->payload_count = 0;
+    mst->remote_length = slv->put_length;
+    mst->framed = slv->session_framed;
+    mst->extracted.uint32 = 0;
+    mst->outgoing.chunk_request.max_size = mst->call.max_chunk_size;
+    // lo que quedo de la llamada anterior no sirve, el primer chunk todavia no se envio
+    mst->rx_bytes = 0;
+    mst->ptr = mst->buffer;
+    mtos_scan_init(&mst->scan,mst->node->pattern);
+    mst->token = mst->node->pattern;
+    mst->token_len = strlen(mst->node->pattern);
+    inst->master_to = MILLIS(0);
+    mst->rq_ts = 0;
+    mst->stall_ts = MILLIS(0);
+    mst->stall_ms = mtos_rto_ms(mst->node);
+    mst->retries = 0;
+    mst->stalled = false;
+    mst->chunk_seq = 0;
+    mst->status = (mst->payload_size ? MTOS_MASTER_CHUNK : MTOS_MASTER_ENDING);
+    mst->busy = true;
+    slv->put = false;
+    slv->put_acc = NULL;
+}
+
+// un paso de la llamada en curso, devuelve true si llegaron bytes o cambio de estado
+static bool mtos_master_step(mtos_instance_t* inst, mtos_master_t* mst)
+{
+    char *TAG = "mtos_master";
+    uint8_t* frame_end = NULL; // byte siguiente al delimitador de la trama decodificada en este paso
+    MTOS_STATS_STATE(mst->node,master_state_us,mst->last_status,mst->state_ts);
+    if (mst->status != mst->last_status) {
+        MTOS_TRACE_SPAN(MTOS_TRACE_MASTER_STATE,mst->node,mst->state_enter_ts,mst->last_status);
+        mst->state_enter_ts = MTOS_TRACE_NOW();
+    }
+    mst->last_status = mst->status;
+    // if timeout abort
+    // tambien se aborta si la ultima de CONFIG_MTOS_MAX_RETRIES retransmisiones seguidas quedo sin respuesta:
+    // el slave no contesta y no tiene sentido esperar el timeout completo
+    bool gave_up = CONFIG_MTOS_MAX_RETRIES && (mst->retries >= CONFIG_MTOS_MAX_RETRIES) &&
+        MTOS_STALLED(inst,mst->stall_ts,mst->stall_ms);
+    if ((MILLIS(inst->master_to) > mst->call.timeout_ms) || gave_up) {
+        if (gave_up) {
+            ESP_LOGI(TAG,"sin respuesta luego de %u retransmisiones",mst->retries);
+        }
+        else {
+            ESP_LOGI(TAG,"timeout expired");
+        }
+        mst->status = MTOS_MASTER_ABORT;
+        mst->node->call_timed_out = !mst->incoming;
+        MTOS_STATS_ADD(mst->node,timeouts,1);
+        MTOS_TRACE_MARK(MTOS_TRACE_TIMEOUT,mst->node,mst->call.timeout_ms);
+        MTOS_EVT_POST(inst,(mst->incoming ? MTOS_EVENT_SLAVE_TIMEOUT : MTOS_EVENT_MASTER_TIMEOUT),mst->node->name,sizeof(((mtos_list_t*)0)->name));
+    }
+    // si el puntero ptr avanzo
+    if (mst->buffer < mst->ptr) {
+        ESP_LOGI(TAG,"buffer < ptr, se elimina %zu bytes procesados",(size_t)(mst->ptr-mst->buffer));
+        ESP_LOG_BUFFER_HEXDUMP(TAG,mst->buffer,mst->ptr-mst->buffer,ESP_LOG_DEBUG);
+        // se transfieren los datos que faltan analizar, a partir de ptr, hacia el comienzo del buffer
+        memmove(mst->buffer,mst->ptr,MTOS_BUFFER_EFFECTIVE-(mst->ptr-mst->buffer));
+        mst->rx_bytes -= (mst->ptr-mst->buffer); // se descartan los bytes usados
+        mtos_scan_shift(&mst->scan,mst->ptr-mst->buffer);
+    }
+    else if ((mst->rx_bytes >= MTOS_BUFFER_EFFECTIVE) && (mst->extracted.uint32 == 0)) {
+        ESP_LOGI(TAG,"buffer lleno sin header, se eliminan bytes sin informacion");
+        // el buffer se lleno sin que se encontrara un token (ej. token corrompido)
+        // se conservan los bytes mas recientes, donde podria comenzar el proximo header
+        memmove(mst->buffer,mst->buffer+(mst->rx_bytes-CONFIG_MTOS_BUFFER_LEGACY),CONFIG_MTOS_BUFFER_LEGACY);
+        mtos_scan_shift(&mst->scan,mst->rx_bytes-CONFIG_MTOS_BUFFER_LEGACY);
+        mst->rx_bytes = CONFIG_MTOS_BUFFER_LEGACY;
+    }
+    /* else if (rx_bytes > CONFIG_MTOS_BUFFER_LEGACY) {
+        ESP_LOGI(TAG,"rx_bytes > CONFIG_MTOS_BUFFER_LEGACY, se eliminan bytes sin informacion");
+        // si no se extrajo ningun dato y rx_bytes se hacerca al final del buffer
+        // se transfiere los bytes mas recientes al comienzo del buffer
+        memmove(buffer,buffer+(rx_bytes-CONFIG_MTOS_BUFFER_LEGACY),CONFIG_MTOS_BUFFER_LEGACY);
+        rx_bytes = CONFIG_MTOS_BUFFER_LEGACY;
+    }*/
+
+    mst->ptr = mst->buffer;
+
+    // se lee lo que el transporte ya recibio, sin esperar
+    int64_t read_ts = MTOS_TRACE_NOW();
+    size_t last_rx_bytes = mst->rx_bytes;
+    mtos_read_bytes(inst,mst->buffer,&mst->rx_bytes,MTOS_BUFFER_EFFECTIVE);
+    MTOS_TRACE_SPAN(MTOS_TRACE_UART_READ,mst->node,read_ts,mst->rx_bytes);
+    bool progress = (mst->rx_bytes != last_rx_bytes);
+    if (progress) {
+        mst->stall_ts = MILLIS(0);
+    }
+
+    uint8_t* header_at = NULL; // header hallado en este ciclo
+    if ((mst->extracted.uint32 == 0) && mst->framed && (mst->token == mst->node->pattern)) {
+        // los chunks llegan en tramas delimitadas, se busca el delimitador en lugar del token
+        uint8_t* delim = mtos_frame_scan(&mst->scan,mst->buffer,mst->rx_bytes);
+        mst->ptr = mst->buffer;
+        if (delim != NULL) {
+            // se decodifica en el lugar, el chunk queda a continuacion del header como en el formato de token
+            size_t len = mtos_frame_open(mst->node,mst->buffer,delim-mst->buffer,mst->buffer,delim-mst->buffer);
+            mtos_header_t header = {};
+            if (len) {
+                memcpy(&header,mst->buffer+sizeof(uint16_t),sizeof(mtos_header_t));
+            }
+            bool header_ok = (esp_rom_crc8_be(0,header.raw,sizeof(mtos_header_t)-1) == header.raw[sizeof(mtos_header_t)-1]);
+            frame_end = delim+1;
+            if (len && (!header_ok || (len == MTOS_FRAME_HEAD+header.chunk_response.size+sizeof(mtos_crc32_t)))) {
+                ESP_LOGI(TAG,"trama hallada");
+                header_at = mst->buffer+sizeof(uint16_t);
+            }
+            else {
+                // mal formada, de otro bloque o con un largo distinto al del header: se saltea entera
+                // y si era el chunk esperado se pide de nuevo por demora
+                ESP_LOGI(TAG,"trama invalida, se descarta");
+            }
+        }
+    }
+    else if ((mst->rx_bytes >= mst->token_len+sizeof(mtos_header_t)) && (mst->extracted.uint32 == 0) && (mst->token != NULL)) {
+        // cuando se recibieron suficientes bytes por uart para extraer un header
+        // busco el string alojado en token en el buffer de datos recibidos
+        ESP_LOGI(TAG,"suficientes bytes recibidos para procesar, token asignado: %.*s",(int)mst->token_len,mst->token);
+        mst->ptr = mtos_scan(&mst->scan,mst->token,mst->buffer,mst->rx_bytes);
+        if ((mst->ptr != NULL) && (mst->ptr+mst->token_len+sizeof(mtos_header_t) > mst->buffer+mst->rx_bytes)) {
+            // el header todavia no termino de llegar, se conserva a partir del token
+            ESP_LOGI(TAG,"token hallado, header incompleto");
+        }
+        else if (mst->ptr != NULL) {
+            ESP_LOGI(TAG,"token hallado");
+            // al encontrarlo avanzo el puntero hacia el primer byte luego del token encontrado
+            header_at = mst->ptr+mst->token_len;
+        }
+        else {
+            ESP_LOGI(TAG,"Token no encontrado en %zu bytes",mst->rx_bytes);
+            ESP_LOG_BUFFER_HEXDUMP(TAG,mst->buffer,mst->rx_bytes,ESP_LOG_DEBUG);
+            mst->ptr = mst->buffer;
+        }
+    }
+    if (header_at != NULL) {
+        if (mst->rq_ts) {
+            // primer header recibido luego del ultimo request
+            uint32_t rtt_us = esp_timer_get_time()-mst->rq_ts;
+            mtos_stats_rtt(mst->node,rtt_us);
+            if (mst->retries == 0) {
+                // la respuesta a un request retransmitido puede ser la del anterior, no se mide (Karn)
+                mtos_rto_sample(mst->node,rtt_us);
+            }
+            mst->rq_ts = 0;
+        }
+        mst->retries = 0;
+        mst->stall_ms = mtos_rto_ms(mst->node);
+        // restablecimiento de contador timeout
+        inst->master_to = MILLIS(0);
         ESP_LOGI(TAG,"timeout reset");
-        xSemaphoreTake(node->smphr, (uart_master_timeout+10)/portTICK_PERIOD_MS);
-        ESP_LOGI(TAG,"node smphr taken");
-        for(;;) {
-            // if timeout abort
-            if (MILLIS(to) > uart_master_timeout) {
-                ESP_LOGI(TAG,"timeout expired");
-                status = MTOS_MASTER_ABORT;
-                MTOS_EVT_POST(MTOS_EVENT_MASTER_TIMEOUT,node->name,sizeof(((mtos_list_t*)0)->name));
-            }
-            // si el puntero ptr avanzo
-            if (buffer < ptr) {
-                ESP_LOGI(TAG,"buffer < ptr, se elimina %u bytes procesados",ptr-buffer);
-                ESP_LOG_BUFFER_HEXDUMP(TAG,buffer,ptr-buffer,ESP_LOG_DEBUG);
-                // se transfieren los datos que faltan analizar, a partir de ptr, hacia el comienzo del buffer
-                memmove(buffer,ptr,MTOS_BUFFER_EFFECTIVE-(ptr-buffer));
-                rx_bytes -= (ptr-buffer); // se descartan los bytes usados
-            }
-            /* else if (rx_bytes > CONFIG_MTOS_BUFFER_LEGACY) {
-                ESP_LOGI(TAG,"rx_bytes > CONFIG_MTOS_BUFFER_LEGACY, se eliminan bytes sin informacion");
-                // si no se extrajo ningun dato y rx_bytes se hacerca al final del buffer
-                // se transfiere los bytes mas recientes al comienzo del buffer
-                memmove(buffer,buffer+(rx_bytes-CONFIG_MTOS_BUFFER_LEGACY),CONFIG_MTOS_BUFFER_LEGACY);
-                rx_bytes = CONFIG_MTOS_BUFFER_LEGACY;
-            }*/
-
-            ptr = buffer;
-
-            // se leen mas datos de uart para que esten disponibles en el proximo ciclo
-            mtos_read_bytes(buffer,&rx_bytes,ptr);
-
-            if ((rx_bytes >= token_len+sizeof(mtos_header_t)) && (extracted.uint32 == 0) && (token != NULL)) {
-                // cuando se recibieron suficientes bytes por uart para extraer un header
-                // busco el string alojado en token en el buffer de datos recibidos
-                ESP_LOGI(TAG,"suficientes bytes recibidos para procesar, token asignado: %.*s",token_len,token);
-                ptr = memmem(buffer,rx_bytes,token,token_len);
-                if (ptr != NULL) {
-                    ESP_LOGI(TAG,"token hallado");
-                    // restablecimiento de contador timeout
-                    to = MILLIS(0);
-                    ESP_LOGI(TAG,"timeout reset");
-                    // al encontrarlo avanzo el puntero hacia el primer byte luego del token encontrado
-                    ptr += token_len;
-                    // como se trata de un header, se copia a la variable correspondiente
-                    memcpy(&extracted,ptr,sizeof(mtos_header_t));
-                    ptr += sizeof(mtos_header_t);
+        // como se trata de un header, se copia a la variable correspondiente
+        memcpy(&mst->extracted,header_at,sizeof(mtos_header_t));
+        MTOS_TRACE_MARK(MTOS_TRACE_FRAME_RX,mst->node,mst->extracted.uint32);
+        mst->ptr = header_at+sizeof(mtos_header_t);
+    }
+
+    // maquina de estados
+    switch (mst->status) {
+        case MTOS_MASTER_ABORT: {
+            ESP_LOGI(TAG,"MTOS_MASTER_ABORT inicial");
+            // se descartan los datos recibidos hasta ahora
+            // se reinician las variables al estado inicial
+            if (mst->acc) {
+#if CONFIG_MTOS_RESUME && !CONFIG_MTOS_STATIC
+                if (mst->payload_count && !mst->call.length && !mst->incoming) {
+                    // se conserva lo recibido para retomar la transferencia en la proxima llamada
+                    ESP_LOGI(TAG,"se conservan %zu bytes para retomar",mst->payload_count);
+                    mst->node->partial = mst->acc;
+                    mst->node->partial_count = mst->payload_count;
+                    mst->node->partial_length = mst->payload_size;
+                    mst->node->partial_crc = mst->payload_crc;
                 }
                 else {
-                    ESP_LOGI(TAG,"Token no encontrado en %u bytes",rx_bytes);
-                    ESP_LOG_BUFFER_HEXDUMP(TAG,buffer,rx_bytes,ESP_LOG_DEBUG);
+                    mtos_acc_free(mst->acc);
                 }
+#else
+                mtos_acc_free(mst->acc);
+#endif
+                mst->acc = NULL;
             }
-
-            // maquina de estados
-            switch (status) {
-                case MTOS_MASTER_ABORT: {
-                    ESP_LOGI(TAG,"MTOS_MASTER_ABORT inicial");
-                    // se descartan los datos recibidos hasta ahora
-                    // se reinician las variables al estado inicial
-                    if (acc) {
-                        free(acc);
-                        acc = NULL;
-                    }
-                    ptr = buffer+rx_bytes;
-                    payload_size = 0;
-                    payload_count = 0;
-                    token = NULL;
-                    token_len = 0;
-                    break;
+            mst->ptr = mst->buffer+mst->rx_bytes;
+            mst->payload_size = 0;
+            mst->payload_count = 0;
+            mst->token = NULL;
+            mst->token_len = 0;
+            break;
+        }
+        case MTOS_MASTER_IDLE: {
+            ESP_LOGI(TAG,"MTOS_MASTER_IDLE");
+            // se envia el string almacenado en trigger
+            // esto indica al equipo remoto que comience la transferencia de datos
+            mst->outgoing.chunk_request.max_size = mst->call.max_chunk_size;
+            mst->outgoing.chunk_request.resend = (mst->plain ? 0 : MTOS_TRIGGER_EXT);
+            mst->outgoing.chunk_request.crc8 = esp_rom_crc8_be(0,mst->outgoing.raw,sizeof(mtos_header_t)-1);
+            ESP_LOGI(TAG,"sending trigger:{.max_size:%u,.resend:%u,.crc8:%x}",
+            mst->outgoing.chunk_request.max_size,
+            mst->outgoing.chunk_request.resend,
+            mst->outgoing.chunk_request.crc8);
+            ESP_LOGI(TAG,"raw: %02X %02X %02X %02X",mst->outgoing.raw[0],mst->outgoing.raw[1],mst->outgoing.raw[2],mst->outgoing.raw[3]);
+            // en la extension se informa la transferencia interrumpida que se desea retomar
+            memset(&mst->ext,0,sizeof(mtos_ext_t));
+            if (mst->call.op) {
+                // la operacion y su operando viajan con el trigger, no hay fase de chunks
+                mst->ext.op.flags = (mst->call.repl ? MTOS_EXT_OP|MTOS_EXT_SEQ : MTOS_EXT_OP);
+                mst->ext.op.offset = mst->call.offset;
+                mst->ext.op.count = mst->call.op_count;
+                mst->ext.op.code = mst->call.op;
+                mst->ext.op.length = mst->call.op_length;
+                mst->ext.op.seq = mst->call.op_seq;
+            }
+            else if (mst->call.put) {
+                // se anuncia la version del bloque que se va a enviar, el slave la rechaza si ya la tiene
+                mtos_crc_sync(mst->node);
+                mst->ext.session.flags = MTOS_EXT_PUT;
+                mst->ext.session.length = mst->node->length;
+                mst->ext.session.crc32 = mst->node->crc32.value;
+            }
+            else if (mst->call.length) {
+                mst->ext.session.flags = MTOS_EXT_RANGE;
+                mst->ext.session.offset = mst->call.offset;
+                mst->ext.session.length = mst->call.length;
+            }
+#if CONFIG_MTOS_RESUME
+            else if (mst->node->partial) {
+                mst->ext.session.flags = MTOS_EXT_RESUME;
+                mst->ext.session.offset = mst->node->partial_count;
+                mst->ext.session.crc32 = mst->node->partial_crc;
+            }
+#endif
+#if CONFIG_MTOS_CONDITIONAL
+            else if (mst->node->length <= MTOS_EXT_MAX) {
+                // se informa la version de la copia local, si el slave tiene la misma no envia el bloque
+                mtos_crc_sync(mst->node);
+                mst->ext.session.flags = MTOS_EXT_UNCHANGED;
+                mst->ext.session.length = mst->node->length;
+                mst->ext.session.crc32 = mst->node->crc32.value;
+            }
+#endif
+#if CONFIG_MTOS_FRAMED
+            mst->ext.session.flags |= MTOS_EXT_FRAMED;
+#endif
+            mst->framed = false; // hasta que el slave lo acepte
+            mst->ext.session.crc8 = esp_rom_crc8_be(0,mst->ext.raw,sizeof(mtos_ext_t)-1);
+            if (mst->plain) {
+                // trigger original: sin resume, sin condicional y con chunks en formato de token
+                memset(&mst->ext,0,sizeof(mtos_ext_t));
+                mtos_send_bytes(inst,mst->node->trigger,&mst->outgoing,NULL,NULL,0);
+            }
+            else {
+                mtos_send_bytes(inst,mst->node->trigger,&mst->outgoing,&mst->ext,(mst->call.op ? mst->call.operand : NULL),mst->call.op_length);
+            }
+            mst->rq_ts = esp_timer_get_time();
+            mst->status++;
+            break;
+        }
+        case MTOS_MASTER_INIT: {
+            if (mst->token == NULL) ESP_LOGI(TAG,"MTOS_MASTER_INIT");
+            // en esta fase se espera la respuesta al envio del trigger enviado en el estado anterior
+            if (mst->extracted.uint32) {
+                // se pudo hallar un header en los datos recibidos por uart
+                // se verifica la integridad del header recibido
+                bool ext_ok = false;
+                if (mst->plain) {
+                    // respuesta sin extension: solo el largo del bloque, que el slave envia completo
+                    ext_ok = mtos_header_check(mst->node,&mst->extracted);
+                    memset(&mst->ext,0,sizeof(mtos_ext_t));
+                    mst->ext.session.length = mst->extracted.trigger_response.payload_length;
+                    mst->node->legacy = ext_ok;
                 }
-                case MTOS_MASTER_IDLE: {
-                    ESP_LOGI(TAG,"MTOS_MASTER_IDLE");
-                    // se envia el string almacenado en trigger
-                    // esto indica al equipo remoto que comience la transferencia de datos
-                    outgoing.chunk_request.max_size = chunk_current_max;
-                    outgoing.chunk_request.resend = false;
-                    outgoing.chunk_request.crc8 = crc8_be(0,outgoing.raw,sizeof(mtos_header_t)-1);
-                    ESP_LOGI(TAG,"sending trigger:{.max_size:%u,.resend:%u,.crc8:%x}",
-                    outgoing.chunk_request.max_size,
-                    outgoing.chunk_request.resend,
-                    outgoing.chunk_request.crc8);
-                    ESP_LOGI(TAG,"raw: %02X %02X %02X %02X",outgoing.raw[0],outgoing.raw[1],outgoing.raw[2],outgoing.raw[3]);
-                    mtos_send_bytes(node->trigger,&outgoing,NULL,0);
-                    status++;
-                    break;
+                else if (mtos_header_check(mst->node,&mst->extracted)) {
+                    if (mst->rx_bytes-(mst->ptr-mst->buffer) < sizeof(mtos_ext_t)) {
+                        // la extension todavia no llego, se conserva el header para el proximo ciclo
+                        ESP_LOGI(TAG,"extension incompleta");
+                        break;
+                    }
+                    memcpy(&mst->ext,mst->ptr,sizeof(mtos_ext_t));
+                    mst->ptr += sizeof(mtos_ext_t);
+                    ext_ok = mtos_ext_check(mst->node,&mst->ext);
+                    if (ext_ok) {
+                        mst->node->legacy = false;
+                    }
                 }
-                case MTOS_MASTER_INIT: {
-                    if (token == NULL) ESP_LOGI(TAG,"MTOS_MASTER_INIT");
-                    // en esta fase se espera la respuesta al envio del trigger enviado en el estado anterior
-                    if (extracted.uint32) {
-                        // se pudo hallar un header en los datos recibidos por uart
-                        // se verifica la integridad del header recibido
-                        if (crc8_be(0,extracted.raw,sizeof(mtos_header_t)-1)
-                             == extracted.trigger_response.crc8) {
-                                ESP_LOGI(TAG,"crc8 verificado ok");
-                                ESP_LOGI(TAG,"recieved trigger_response:{.payload_length:%u,.crc8:%x}",
-                                extracted.trigger_response.payload_length,
-                                extracted.trigger_response.crc8);
-                            // crc verificado ok
-                            // como se trata de la respuesta al trigger se reserva el bloque de memoria para el acumulador
-                            acc = (uint8_t*)malloc(extracted.trigger_response.payload_length);
-                            if (acc) {
-                                // se pudo reservar el bloque donde se iran acumulando los bytes recibidos
-                                ESP_LOGI(TAG,"%u bytes alocados",extracted.trigger_response.payload_length);
-                                payload_size = extracted.trigger_response.payload_length;
-                                payload_count = 0;
-                                extracted.uint32 = 0;
-                                status++;
-                                MTOS_EVT_POST(MTOS_EVENT_MASTER_ANSWERED,node->name,sizeof(((mtos_list_t*)0)->name));
-                            }
+                if (ext_ok) {
+                        ESP_LOGI(TAG,"crc8 verificado ok");
+                        ESP_LOGI(TAG,"recieved trigger_response:{.payload_length:%u,.crc8:%x,.offset:%u,.crc32:%" PRIx32 "}",
+                        mst->extracted.trigger_response.payload_length,
+                        mst->extracted.trigger_response.crc8,
+                        mst->ext.session.offset,
+                        (uint32_t)mst->ext.session.crc32);
+                    // crc verificado ok
+                    if ((mst->call.op >= MTOS_OP_QUERY) && (mst->ext.session.flags & MTOS_EXT_OP)) {
+                        // el resultado de la consulta y su crc32 siguen a la extension
+                        mtos_query_wire_t wire;
+                        mtos_crc32_t wire_crc;
+                        if (mst->rx_bytes-(mst->ptr-mst->buffer) < sizeof(mtos_query_wire_t)+sizeof(mtos_crc32_t)) {
+                            ESP_LOGI(TAG,"resultado incompleto");
+                            mst->ptr -= sizeof(mtos_ext_t);
+                            break;
                         }
-                        if (!acc) {
-                            ESP_LOGI(TAG,"error, fallback por alocacion fallida");
-                            // no se pudo asignar los bytes necesarios
-                            // o no se pudo verificar el crc del header
-                            status--;
-                            MTOS_EVT_POST(MTOS_EVENT_MASTER_ALLOC_ERROR,node->name,sizeof(((mtos_list_t*)0)->name));
+                        memcpy(&wire,mst->ptr,sizeof(mtos_query_wire_t));
+                        memcpy(wire_crc.raw,mst->ptr+sizeof(mtos_query_wire_t),sizeof(mtos_crc32_t));
+                        mst->ptr += sizeof(mtos_query_wire_t)+sizeof(mtos_crc32_t);
+                        mst->extracted.uint32 = 0;
+                        if (esp_rom_crc32_be(0,(uint8_t*)&wire,sizeof(mtos_query_wire_t)) != wire_crc.value) {
+                            // la consulta no modifica el bloque, se repite
+                            ESP_LOGI(TAG,"fallo verif. crc32 del resultado => MTOS_MASTER_IDLE");
+                            MTOS_STATS_ADD(mst->node,crc32_errors,1);
+                            mst->status = MTOS_MASTER_IDLE;
                             break;
                         }
+                        mtos_query_result_t result = {
+                            .query = mst->call.op-MTOS_OP_QUERY,
+                            .type = mst->call.operand[0],
+                            .index = wire.index,
+                            .count = wire.count,
+                        };
+                        memcpy(result.name,mst->node->name,sizeof(result.name));
+                        memcpy(&result.value,&wire.value,sizeof(result.value));
+                        mst->ptr = mst->buffer+mst->rx_bytes;
+                        mst->token = NULL;
+                        mst->token_len = 0;
+                        MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_QUERY,&result,sizeof(mtos_query_result_t));
+                        mst->status = MTOS_MASTER_ENDING;
+                        break;
                     }
-                    else {
-                        // no se ha detectado la respuesta al trigger
-                        // se asigna a token el patron a detectar en la respuesta esperada
-                        if ((token ? strcmp(token,node->trigger) : false)) ESP_LOGI(TAG,"setup para token: %.*s",token_len,token);
-                        token = node->trigger;
-                        token_len = strlen(node->trigger);
+                    if (mst->call.op) {
+                        mst->extracted.uint32 = 0;
+                        mst->ptr = mst->buffer+mst->rx_bytes;
+                        mst->token = NULL;
+                        mst->token_len = 0;
+#if CONFIG_MTOS_REPLICATE
+                        if (mst->call.repl) {
+                            // la copia local ya tiene el cambio; si el slave salteo una parte, no la acepto o quedo
+                            // distinto al final de la tanda, la proxima parte le envia el bloque completo
+                            mtos_crc_sync(mst->node);
+                            if (!(mst->ext.session.flags & MTOS_EXT_OP) || (!mtos_repl_dirty(mst->node) &&
+                                ((mst->node->length != mst->ext.session.length) || (mst->node->crc32.value != mst->ext.session.crc32)))) {
+                                ESP_LOGI(TAG,"replica desfasada, se envia el bloque completo");
+                                mst->node->repl_full = true;
+                            }
+                            mst->status = MTOS_MASTER_ENDING;
+                            break;
+                        }
+#endif
+                        if (!(mst->ext.session.flags & MTOS_EXT_OP)) {
+                            // el slave no acepta operaciones o la operacion no entra en su bloque
+                            ESP_LOGI(TAG,"operacion rechazada => MTOS_MASTER_ABORT");
+                            MTOS_EVT_POST(inst,(mst->call.op >= MTOS_OP_QUERY ? MTOS_EVENT_MASTER_QUERY_REFUSED : MTOS_EVENT_MASTER_OP_REFUSED),
+                                mst->node->name,sizeof(((mtos_list_t*)0)->name));
+                            mst->status = MTOS_MASTER_ABORT;
+                        }
+                        else {
+                            // se aplica lo mismo a la copia local, sigue en sincronia si queda con el crc32 del slave
+                            bool synced = mtos_op_apply(mst->node,mst->call.op,mst->call.offset,mst->call.op_count,mst->call.operand,mst->call.op_length);
+                            mtos_crc_sync(mst->node);
+                            synced = synced && (mst->node->length == mst->ext.session.length) && (mst->node->crc32.value == mst->ext.session.crc32);
+                            ESP_LOGI(TAG,"operacion aplicada, copia local %s",(synced ? "sincronizada" : "distinta"));
+                            MTOS_EVT_POST(inst,(synced ? MTOS_EVENT_MASTER_OP : MTOS_EVENT_MASTER_OP_DIVERGED),mst->node->name,sizeof(((mtos_list_t*)0)->name));
+                            mst->status = MTOS_MASTER_ENDING;
+                        }
+                        break;
+                    }
+                    if (mst->call.put) {
+                        mst->extracted.uint32 = 0;
+                        mst->ptr = mst->buffer+mst->rx_bytes;
+                        mst->token = NULL;
+                        mst->token_len = 0;
+                        if (!(mst->ext.session.flags & MTOS_EXT_PUT)) {
+                            // el slave no acepta puts o no pudo reservar el bloque
+                            ESP_LOGI(TAG,"put rechazado => MTOS_MASTER_ABORT");
+#if CONFIG_MTOS_REPLICATE
+                            // sin puts no hay como recuperar una replica desfasada
+                            mst->node->repl = false;
+#endif
+                            MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_PUT_REFUSED,mst->node->name,sizeof(((mtos_list_t*)0)->name));
+                            mst->status = MTOS_MASTER_ABORT;
+                        }
+                        else if (mst->ext.session.flags & MTOS_EXT_UNCHANGED) {
+                            ESP_LOGI(TAG,"el slave ya tiene el bloque => MTOS_MASTER_ENDING");
+                            MTOS_STATS_ADD(mst->node,unchanged,1);
+                            MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_UNCHANGED,mst->node->name,sizeof(((mtos_list_t*)0)->name));
+                            mst->status = MTOS_MASTER_ENDING;
+                        }
+                        else {
+                            // el slave pide los chunks y el reactor los envia con la maquina slave
+                            ESP_LOGI(TAG,"put aceptado => MTOS_MASTER_CHUNK");
+                            mst->framed = (mst->ext.session.flags & MTOS_EXT_FRAMED);
+                            mst->push = true;
+                            mst->status = MTOS_MASTER_CHUNK;
+                            MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_ANSWERED,mst->node->name,sizeof(((mtos_list_t*)0)->name));
+                        }
                         break;
                     }
+#if CONFIG_MTOS_CONDITIONAL
+                    if (mst->ext.session.flags & MTOS_EXT_UNCHANGED) {
+                        // la copia local ya es la version del slave, se termina sin recibir chunks
+                        ESP_LOGI(TAG,"bloque sin cambios => MTOS_MASTER_ENDING");
+                        MTOS_STATS_ADD(mst->node,unchanged,1);
+                        MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_UNCHANGED,mst->node->name,sizeof(((mtos_list_t*)0)->name));
+                        mst->extracted.uint32 = 0;
+                        mst->ptr = mst->buffer+mst->rx_bytes;
+                        mst->token = NULL;
+                        mst->token_len = 0;
+                        mst->status = MTOS_MASTER_ENDING;
+                        break;
+                    }
+#endif
+                    mst->payload_size = mst->extracted.trigger_response.payload_length;
+                    mst->payload_count = 0;
+                    mst->remote_length = mst->ext.session.length;
+                    mst->framed = (mst->ext.session.flags & MTOS_EXT_FRAMED);
+#if CONFIG_MTOS_RESUME
+                    mst->payload_crc = mst->ext.session.crc32;
+                    if (mst->node->partial && !mst->call.length) {
+                        if ((mst->ext.session.flags & MTOS_EXT_RESUME) && (mst->ext.session.offset == mst->node->partial_count) &&
+                            (mst->node->partial_length == mst->payload_size) && (mst->node->partial_crc == mst->payload_crc)) {
+                            // el slave acepto retomar, se continua acumulando sobre lo ya recibido
+                            ESP_LOGI(TAG,"transferencia retomada desde el byte %u",mst->ext.session.offset);
+                            mst->acc = mst->node->partial;
+                            mst->payload_count = mst->node->partial_count;
+                            MTOS_STATS_ADD(mst->node,resumes,1);
+                        }
+                        else {
+                            free(mst->node->partial);
+                        }
+                        mst->node->partial = NULL;
+                    }
+#endif
+                    // como se trata de la respuesta al trigger se reserva el bloque de memoria para el acumulador
+                    if (!mst->acc) {
+                        mst->acc = mtos_acc_alloc(inst,mst->payload_size);
+                    }
+                    if (mst->acc) {
+                        // se pudo reservar el bloque donde se iran acumulando los bytes recibidos
+                        ESP_LOGI(TAG,"%zu bytes alocados",mst->payload_size);
+                        mst->extracted.uint32 = 0;
+                        mst->status++;
+                        if (mst->call.length && !(mst->ext.session.flags & MTOS_EXT_RANGE)) {
+                            // el slave no acepto la porcion solicitada y envia el bloque completo
+                            mst->call.length = 0;
+                        }
+                        else if (mst->call.length) {
+                            // offset efectivo, el slave lo recorta al largo de su bloque
+                            mst->call.offset = mst->ext.session.offset;
+                        }
+                        if (mst->payload_count >= mst->payload_size) {
+                            // porcion vacia, no se espera ningun chunk
+                            mst->status = MTOS_MASTER_ENDING;
+                        }
+                        MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_ANSWERED,mst->node->name,sizeof(((mtos_list_t*)0)->name));
+                        if (mst->payload_count) {
+                            MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_RESUMED,mst->node->name,sizeof(((mtos_list_t*)0)->name));
+                        }
+                    }
                 }
-                case MTOS_MASTER_CHUNK: {
-                    if (!strcmp(token,node->trigger)) ESP_LOGI(TAG,"MTOS_MASTER_CHUNK");
-                    // fase de recepcion de chunks
-                    if (extracted.uint32) {
-                        // se verifica la integridad del header recibido
-                        if (crc8_be(0,extracted.raw,sizeof(mtos_header_t)-1)
-                             == extracted.chunk_response.crc8) {
-                                ESP_LOGI(TAG,"crc8 verificado ok");
-                                // crc verificado ok
-                                // el header de un chunk contiene el tamaño de la porcion del bloque que se envio
-                                // se verifica que la cantidad de bytes recibidos por uart sea la sufuiciente para
-                                // albergar la cantidad de bytes que indica el header
-                            if (extracted.chunk_response.size+sizeof(mtos_crc32_t) <= rx_bytes) {
-                                // cantidad de bytes recibidos es suficiente
-                                ESP_LOGI(TAG,"suficiente cantidad de bytes para procesar");
-                                mtos_chunk_vessel_t new = {
-                                    .chunk = ptr,
-                                    .size = extracted.chunk_response.size,
-                                };
-                                // se verifica el crc32 de los bytes del chunk sin contar el header
-                                memcpy(new.crc32.raw,new.chunk+new.size,sizeof(mtos_crc32_t));
-                                ESP_LOGI(TAG,"recieved chunk_response:{.size:%u,.count:%u,.crc8:%x,.payload_crc32:%x}",
-                                extracted.chunk_response.size,
-                                extracted.chunk_response.count,
-                                extracted.chunk_response.crc8,
-                                new.crc32.value);
-                                if (crc32_be(0,new.chunk,new.size) == new.crc32.value) {
-                                    // la verificacion  es correcta se agregan los bytes al acumulador
-                                    memcpy(acc+payload_count,new.chunk,new.size);
-                                    mtos_event_chunk_t* evt = (mtos_event_chunk_t*)calloc(1,sizeof(mtos_event_chunk_t));
-                                    if (evt) {
-                                        evt->chunk_rx.chunk = acc+payload_count;
-                                        evt->chunk_rx.size = new.size;
-                                        evt->chunk_rx.name = node->name;
-                                        payload_count += new.size;
-                                        evt->chunk_rx.count = payload_count;
-                                        evt->chunk_rx.pending = payload_size - payload_count;
-                                        MTOS_EVT_POST(MTOS_EVENT_MASTER_CHUNK_RX,evt,sizeof(mtos_event_chunk_t));
-                                    }
-                                    else {
-                                        payload_count += new.size;
-                                        MTOS_EVT_POST(MTOS_EVENT_MASTER_ALLOC_ERROR,node->name,sizeof(((mtos_list_t*)0)->name));
-                                    }
-                                    ptr += new.size+sizeof(mtos_crc32_t); // se adelanta el puntero
-                                    outgoing.chunk_request.resend = false;
-                                    ESP_LOGI(TAG,"payload_size: %u | payload_count: %u",payload_size,payload_count);
-                                    if (payload_count >= payload_size) {
-                                        // ya se recibio la totalidad de bytes del payload
-                                        ESP_LOGI(TAG,"ya se recibio la totalidad de bytes del payload => MTOS_MASTER_ENDING");
-                                        status++;
-                                    }
-                                }
-                                else {
-                                    ESP_LOGI(TAG,"validacion de crc32 del bloque fallida");
-                                    // no se verifico correctamente crc32
-                                    // se solicita retransmision
-                                    outgoing.chunk_request.resend = true;
-                                }
-                            }
-                            else {
-                                ESP_LOGI(TAG,"insuficiente cantidad de bytes para procesar");
-                                ESP_LOGI(TAG,"extracted.chunk_response.size+sizeof(mtos_crc32_t) [%u] <= rx_bytes [%u]",
-                                extracted.chunk_response.size+sizeof(mtos_crc32_t),rx_bytes);
-                                // en caso que no haya suficientes datos recibidos por uart
-                                // se debe preservar el header para el siguiente ciclo
-                                // se setea el byte de resend en un valor especifico
-                                // que luego permitira saltar la transmicion de un chunk_request
-                                outgoing.chunk_request.resend = 0xFF;
+                if (!mst->acc) {
+                    ESP_LOGI(TAG,"error, fallback por alocacion fallida");
+                    // no se pudo asignar los bytes necesarios
+                    // o no se pudo verificar el crc del header
+                    mst->extracted.uint32 = 0;
+                    if (ext_ok) {
+                        // el bloque remoto no entra en la memoria disponible, reenviar el trigger no cambia nada
+                        mst->status = MTOS_MASTER_ABORT;
+                    }
+                    else {
+                        mst->status--;
+                    }
+                    MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_ALLOC_ERROR,mst->node->name,sizeof(((mtos_list_t*)0)->name));
+                    break;
+                }
+            }
+            else if ((mst->token == mst->node->trigger) && MTOS_STALLED(inst,mst->stall_ts,mst->stall_ms)) {
+                // la respuesta al trigger se perdio, se descarta lo recibido y se reenvia el trigger
+                ESP_LOGI(TAG,"sin respuesta al trigger, se reenvia");
+                mst->ptr = mst->buffer+mst->rx_bytes;
+                mtos_master_backoff(mst);
+                if (MTOS_CALL_PLAIN(&mst->call)) {
+                    // un slave anterior a la extension descarta el trigger extendido sin responder,
+                    // los reenvios alternan entre ambos formatos
+                    mst->plain = !mst->plain;
+                }
+                mst->chunk_seq = 0;
+                mst->status = MTOS_MASTER_IDLE;
+                MTOS_STATS_ADD(mst->node,resends,1);
+                break;
+            }
+            else {
+                // no se ha detectado la respuesta al trigger
+                // se asigna a token el patron a detectar en la respuesta esperada
+                if ((mst->token ? strcmp(mst->token,mst->node->trigger) : false)) ESP_LOGI(TAG,"setup para token: %.*s",(int)mst->token_len,mst->token);
+                mst->token = mst->node->trigger;
+                mst->token_len = strlen(mst->node->trigger);
+                break;
+            }
+        }
+        case MTOS_MASTER_CHUNK: {
+            if (!strcmp(mst->token,mst->node->trigger)) ESP_LOGI(TAG,"MTOS_MASTER_CHUNK");
+            // fase de recepcion de chunks
+            if (mst->extracted.uint32) {
+                // se verifica la integridad del header recibido
+                if (mtos_header_check(mst->node,&mst->extracted)) {
+                        ESP_LOGI(TAG,"crc8 verificado ok");
+                        // crc verificado ok
+                        // el header de un chunk contiene el tamaño de la porcion del bloque que se envio
+                        // se verifica que la cantidad de bytes recibidos por uart sea la sufuiciente para
+                        // albergar la cantidad de bytes que indica el header
+                    bool complete = (mst->extracted.chunk_response.size+sizeof(mtos_crc32_t) <= mst->rx_bytes-(mst->ptr-mst->buffer));
+                    if ((mst->extracted.chunk_response.count == mst->chunk_seq) && complete) {
+                        // el chunk ya se habia aceptado, llega repetido porque se pidio su retransmision
+                        // por demora. Si la pedida fue posterior al ultimo request, ese request se perdio
+                        // y se vuelve a enviar; si no, ya esta en camino y se descarta sin responder
+                        ESP_LOGI(TAG,"chunk %u repetido, se descarta",mst->chunk_seq);
+                        mst->ptr += mst->extracted.chunk_response.size+sizeof(mtos_crc32_t);
+                        mst->extracted.uint32 = 0;
+                        mst->outgoing.chunk_request.resend = (mst->stalled ? false : 0xFF);
+                    }
+                    else if (mst->extracted.chunk_response.size > mst->payload_size-mst->payload_count) {
+                        // un header con crc8 valido pero con un tamaño que no entra en el acumulador
+                        ESP_LOGI(TAG,"chunk mayor a los bytes pendientes, se solicita retransmision");
+                        mst->outgoing.chunk_request.resend = true;
+                        MTOS_STATS_ADD(mst->node,crc32_errors,1);
+                    }
+                    else if (complete) {
+                        // cantidad de bytes recibidos es suficiente
+                        ESP_LOGI(TAG,"suficiente cantidad de bytes para procesar");
+                        mtos_chunk_vessel_t new = {
+                            .chunk = mst->ptr,
+                            .size = mst->extracted.chunk_response.size,
+                        };
+                        // se verifica el crc32 de los bytes del chunk sin contar el header
+                        memcpy(new.crc32.raw,new.chunk+new.size,sizeof(mtos_crc32_t));
+                        ESP_LOGI(TAG,"recieved chunk_response:{.size:%u,.count:%u,.crc8:%x,.payload_crc32:%" PRIx32 "}",
+                        mst->extracted.chunk_response.size,
+                        mst->extracted.chunk_response.count,
+                        mst->extracted.chunk_response.crc8,
+                        new.crc32.value);
+                        int64_t crc_ts = MTOS_TRACE_NOW();
+                        bool crc_ok = (esp_rom_crc32_be(0,new.chunk,new.size) == new.crc32.value);
+                        MTOS_TRACE_SPAN(MTOS_TRACE_CRC32,mst->node,crc_ts,crc_ok);
+                        if (crc_ok) {
+                            // la verificacion  es correcta se agregan los bytes al acumulador
+                            memcpy(mst->acc+mst->payload_count,new.chunk,new.size);
+                            mst->chunk_seq = mst->extracted.chunk_response.count;
+                            MTOS_STATS_ADD(mst->node,bytes,new.size);
+                            MTOS_STATS_ADD(mst->node,chunks,1);
+                            // el loop de eventos copia los datos del evento, alcanza con una variable local
+                            mtos_event_chunk_t evt = {};
+                            evt.chunk_rx.chunk = mst->acc+mst->payload_count;
+                            evt.chunk_rx.size = new.size;
+                            evt.chunk_rx.name = mst->node->name;
+                            mst->payload_count += new.size;
+                            evt.chunk_rx.count = mst->payload_count;
+                            evt.chunk_rx.pending = mst->payload_size - mst->payload_count;
+                            MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_CHUNK_RX,&evt,sizeof(mtos_event_chunk_t));
+                            mst->ptr += new.size+sizeof(mtos_crc32_t); // se adelanta el puntero
+                            mst->outgoing.chunk_request.resend = false;
+                            ESP_LOGI(TAG,"payload_size: %zu | payload_count: %zu",mst->payload_size,mst->payload_count);
+                            if (mst->payload_count >= mst->payload_size) {
+                                // ya se recibio la totalidad de bytes del payload
+                                ESP_LOGI(TAG,"ya se recibio la totalidad de bytes del payload => MTOS_MASTER_ENDING");
+                                mst->status++;
                             }
                         }
-                        if (outgoing.chunk_request.resend != 0xFF) {
-                            // enviar solicitud de chunk
-                            // la maxima cantidad de bytes que puede recibir en el proximo chunk
-                            outgoing.chunk_request.crc8 = crc8_be(0,outgoing.raw,sizeof(mtos_header_t)-1);
-                            ESP_LOGI(TAG,"sending chunk_request:{.max_size:%u,.resend:%u,.crc8:%x}",
-                            outgoing.chunk_request.max_size,
-                            outgoing.chunk_request.resend,
-                            outgoing.chunk_request.crc8);
-                            mtos_send_bytes(node->pattern,&outgoing,NULL,0);
-                            extracted.uint32 = 0;
+                        else {
+                            ESP_LOGI(TAG,"validacion de crc32 del bloque fallida");
+                            // no se verifico correctamente crc32
+                            // se solicita retransmision
+                            mst->outgoing.chunk_request.resend = true;
+                            MTOS_STATS_ADD(mst->node,crc32_errors,1);
                         }
                     }
+                    else if (MTOS_STALLED(inst,mst->stall_ts,mst->stall_ms)) {
+                        // dejaron de llegar bytes con el chunk incompleto, el resto se perdio
+                        // (p. ej. una trama de un enlace agregado), se descarta y se pide de nuevo
+                        ESP_LOGI(TAG,"chunk incompleto sin actividad, se solicita retransmision");
+                        mst->ptr = mst->buffer+mst->rx_bytes;
+                        mst->outgoing.chunk_request.resend = true;
+                        mtos_master_backoff(mst);
+                        mst->stalled = true;
+                    }
                     else {
-                        // no se ha detectado la respuesta al pattern
-                        // se asigna a token el patron a detectar en la respuesta esperada
-                        
-                        if (token ? strcmp(token,node->pattern) : false) ESP_LOGI(TAG,"setup para token: %.*s",token_len,token);
-                        token = node->pattern;
-                        token_len = strlen(node->pattern);
+                        ESP_LOGI(TAG,"insuficiente cantidad de bytes para procesar");
+                        ESP_LOGI(TAG,"extracted.chunk_response.size+sizeof(mtos_crc32_t) [%zu] <= rx_bytes [%zu]",
+                        mst->extracted.chunk_response.size+sizeof(mtos_crc32_t),mst->rx_bytes-(size_t)(mst->ptr-mst->buffer));
+                        // en caso que no haya suficientes datos recibidos por uart
+                        // se debe preservar el header para el siguiente ciclo
+                        // se setea el byte de resend en un valor especifico
+                        // que luego permitira saltar la transmicion de un chunk_request
+                        mst->outgoing.chunk_request.resend = 0xFF;
                     }
-                    break;
                 }
-                case MTOS_MASTER_ENDING: {
-                    ESP_LOGI(TAG,"MTOS_MASTER_ENDING inicial");
-                    // librar la memoria del miembro ptr del nodo
-                    free(node->ptr);
-                    // asignarle el puntero donde se estuvieron acumulando los datos
-                    node->ptr = acc;
-                    // tambien se actualiza el miembro length del nodo
-                    node->length = payload_size;
-                    // calcular el nuevo crc
-                    node->crc32.value = crc32_be(0,node->ptr,node->length);
-                    // enviar evento
-                    MTOS_EVT_POST(MTOS_EVENT_MASTER_UPDATED,node->name,sizeof(((mtos_list_t*)0)->name));
-                    // reiniciar variables
-                    ptr = buffer+rx_bytes;
-                    acc = NULL;
-                    payload_size = 0;
-                    payload_count = 0;
-                    token = NULL;
-                    token_len = 0;
-                    break;
+                else {
+                    // header corrompido, se solicita la retransmision del ultimo chunk
+                    mst->outgoing.chunk_request.resend = true;
+                }
+                if (mst->outgoing.chunk_request.resend != 0xFF) {
+                    // enviar solicitud de chunk
+                    // la maxima cantidad de bytes que puede recibir en el proximo chunk
+                    mst->outgoing.chunk_request.crc8 = esp_rom_crc8_be(0,mst->outgoing.raw,sizeof(mtos_header_t)-1);
+                    ESP_LOGI(TAG,"sending chunk_request:{.max_size:%u,.resend:%u,.crc8:%x}",
+                    mst->outgoing.chunk_request.max_size,
+                    mst->outgoing.chunk_request.resend,
+                    mst->outgoing.chunk_request.crc8);
+                    if (mst->framed) {
+                        mtos_send_frame(inst,mst->node,&mst->outgoing,NULL,0);
+                    }
+                    else {
+                        mtos_send_bytes(inst,mst->node->pattern,&mst->outgoing,NULL,NULL,0);
+                    }
+                    mst->rq_ts = esp_timer_get_time();
+                    mst->stall_ts = MILLIS(0);
+                    if (mst->outgoing.chunk_request.resend) {
+                        MTOS_STATS_ADD(mst->node,resends,1);
+                    }
+                    else {
+                        mst->stalled = false;
+                    }
+                    mst->extracted.uint32 = 0;
                 }
             }
-
-            if ((status == MTOS_MASTER_ABORT)||(status == MTOS_MASTER_ENDING)) {
-                ESP_LOGI(TAG,"MTOS_MASTER_ABORT/MTOS_MASTER_ENDING final");
-                if (acc == NULL) {
-                    ESP_LOGI(TAG,"cierre habilitado por acc = NULL");
-                    // luego de la finalizacion o el aborto, se reinicia el estado
-                    status = MTOS_MASTER_IDLE;
-                    // se sale de la maquina de estado para esperar el proximo elemento de la cola
-                    break;
+            else if ((mst->token == mst->node->pattern) && MTOS_STALLED(inst,mst->stall_ts,mst->stall_ms)) {
+                // no llego respuesta al ultimo request (o al trigger), se pide la retransmision del chunk
+                ESP_LOGI(TAG,"sin respuesta del slave, se solicita retransmision");
+                mst->ptr = mst->buffer+mst->rx_bytes;
+                mst->outgoing.chunk_request.resend = true;
+                mst->outgoing.chunk_request.crc8 = esp_rom_crc8_be(0,mst->outgoing.raw,sizeof(mtos_header_t)-1);
+                if (mst->framed) {
+                    mtos_send_frame(inst,mst->node,&mst->outgoing,NULL,0);
+                }
+                else {
+                    mtos_send_bytes(inst,mst->node->pattern,&mst->outgoing,NULL,NULL,0);
+                }
+                mst->rq_ts = esp_timer_get_time();
+                mtos_master_backoff(mst);
+                mst->stalled = true;
+                MTOS_STATS_ADD(mst->node,resends,1);
+            }
+            else {
+                // no se ha detectado la respuesta al pattern
+                // se asigna a token el patron a detectar en la respuesta esperada
+                
+                if (mst->token ? strcmp(mst->token,mst->node->pattern) : false) ESP_LOGI(TAG,"setup para token: %.*s",(int)mst->token_len,mst->token);
+                mst->token = mst->node->pattern;
+                mst->token_len = strlen(mst->node->pattern);
+            }
+            break;
+        }
+        case MTOS_MASTER_ENDING: {
+            ESP_LOGI(TAG,"MTOS_MASTER_ENDING inicial");
+            if (mst->call.put) {
+                // el slave confirmo el ultimo chunk, ya tiene el bloque completo
+                MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_PUT,mst->node->name,sizeof(((mtos_list_t*)0)->name));
+                mst->ptr = mst->buffer+mst->rx_bytes;
+                mst->token = NULL;
+                mst->token_len = 0;
+                break;
+            }
+            // version anterior de la copia local, si la transferencia la deja igual no se informa un cambio
+            mtos_crc_sync(mst->node);
+            uint32_t previous_crc = mst->node->crc32.value;
+            size_t previous_length = mst->node->length;
+            // la porcion no se pudo aplicar sobre la copia local
+            bool failed = false;
+            if (mst->call.length) {
+                // la porcion recibida se copia sobre la copia local, que adopta el largo del bloque remoto
+                size_t length = mst->node->length;
+                if ((mst->call.offset+mst->payload_size <= mst->remote_length) &&
+                    ((length == mst->remote_length) || mtos_block_resize(mst->node,mst->remote_length))) {
+                    if (mst->remote_length > length) {
+                        mtos_block_copy(mst->node,length,NULL,mst->remote_length-length,true);
+                    }
+                    mtos_block_copy(mst->node,mst->call.offset,mst->acc,mst->payload_size,true);
+                }
+                else {
+                    MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_ALLOC_ERROR,mst->node->name,sizeof(((mtos_list_t*)0)->name));
+                    failed = true;
                 }
+                mtos_acc_free(mst->acc);
+            }
+            else if (MTOS_SEGMENTED(mst->node) || mst->node->external || MTOS_STATIC_ACC) {
+                // el blob segmentado conserva su forma, los datos se reparten en los segmentos;
+                // el buffer de la aplicacion y el acumulador estatico tampoco se adoptan, se copia sobre el bloque
+                if (mtos_block_resize(mst->node,mst->payload_size)) {
+                    mtos_block_copy(mst->node,0,mst->acc,mst->payload_size,true);
+                }
+                else {
+                    MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_ALLOC_ERROR,mst->node->name,sizeof(((mtos_list_t*)0)->name));
+                    failed = true;
+                }
+                mtos_acc_free(mst->acc);
+            }
+            else {
+                // librar la memoria del miembro ptr del nodo
+                free(mst->node->ptr);
+                // asignarle el puntero donde se estuvieron acumulando los datos
+                mst->node->ptr = mst->acc;
+                // tambien se actualiza el miembro length del nodo
+                mst->node->length = mst->payload_size;
+            }
+            // calcular el nuevo crc
+            mst->node->crc32.value = mtos_node_crc32(mst->node);
+            mst->node->crc_stale = false;
+            mst->node->str_length = MTOS_STRLEN_UNKNOWN;
+            if (mst->incoming) {
+                // una replica sigue desde este bloque, con cualquier numero de operacion
+                mst->node->op_seq = 0;
+            }
+            // enviar evento
+            if (failed) {
+                // ya se envio MTOS_EVENT_MASTER_ALLOC_ERROR, la copia local quedo como estaba
+            }
+            else if ((mst->node->length != previous_length) || (mst->node->crc32.value != previous_crc)) {
+                if (mst->incoming) {
+                    // el bloque del slave se reemplazo de una vez, bajo el semaforo que tomo al responder el trigger
+                    MTOS_EVT_POST(inst,MTOS_EVENT_SLAVE_WRITTEN,mst->node->name,sizeof(((mtos_list_t*)0)->name));
+                }
+                else {
+#if CONFIG_MTOS_CACHE
+                    mtos_cache_save(mst->node);
+#endif
+                    MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_UPDATED,mst->node->name,sizeof(((mtos_list_t*)0)->name));
+                }
+            }
+            else if (mst->incoming) {
+                MTOS_STATS_ADD(mst->node,unchanged,1);
+            }
+            else {
+                MTOS_STATS_ADD(mst->node,unchanged,1);
+                MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_UNCHANGED,mst->node->name,sizeof(((mtos_list_t*)0)->name));
+            }
+            // reiniciar variables
+            mst->ptr = mst->buffer+mst->rx_bytes;
+            mst->acc = NULL;
+            mst->payload_size = 0;
+            mst->payload_count = 0;
+            mst->token = NULL;
+            mst->token_len = 0;
+            break;
+        }
+    }
+
+    if (frame_end != NULL) {
+        // la trama se consume entera aunque el chunk se haya rechazado, el resto es la proxima
+        if (mst->ptr < frame_end) {
+            mst->ptr = frame_end;
+        }
+        frame_end = NULL;
+    }
+
+    if ((mst->status == MTOS_MASTER_ABORT)||(mst->status == MTOS_MASTER_ENDING)) {
+        ESP_LOGI(TAG,"MTOS_MASTER_ABORT/MTOS_MASTER_ENDING final");
+        if (mst->acc == NULL) {
+            ESP_LOGI(TAG,"cierre habilitado por acc = NULL");
+            // luego de la finalizacion o el aborto, se reinicia el estado
+            mst->status = MTOS_MASTER_IDLE;
+            // termina la llamada, el reactor vuelve a atender al slave
+            mst->rq_ts = 0;
+#if CONFIG_MTOS_REPLICATE
+            if (mst->call.repl) {
+                mtos_repl_close(inst,mst);
             }
+#endif
+            mtos_give(mst->node);
+            if (mst->call.notify) {
+                xTaskNotifyGive(mst->call.notify);
+            }
+            mst->busy = false;
+            if (mst->incoming) {
+                mst->incoming = false;
+                MTOS_EVT_POST(inst,MTOS_EVENT_SLAVE_RELEASED,mst->node->name,sizeof(((mtos_list_t*)0)->name));
+            }
+            else {
+                MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_IDLE,mst->node->name,sizeof(((mtos_list_t*)0)->name));
+            }
+            return true;
         }
-        xSemaphoreGive(node->smphr);
     }
+    return (progress || (mst->status != mst->last_status));
 }
 
-mtos_event_handler_t mtos_usr_cb = NULL;
+// unica tarea de la instancia: es duena del transporte y ejecuta de a pasos la maquina slave o, durante una
+// llamada, la maquina master. Cuando un paso no trae novedades espera en la cola de llamadas
+static void mtos_reactor_task(void* pvParameters)
+{
+    mtos_instance_t* inst = (mtos_instance_t*)pvParameters;
+    mtos_master_t mst = {};
+    mtos_slave_t slv = {};
+#if CONFIG_MTOS_STATIC
+    mst.buffer = inst->storage->master_buffer;
+    slv.buffer = inst->storage->slave_buffer;
+#else
+    mst.buffer = (uint8_t*)malloc(MTOS_BUFFER_EFFECTIVE);
+    slv.buffer = (uint8_t*)malloc(MTOS_BUFFER_SLAVE);
+#endif
+    assert(mst.buffer && slv.buffer);
+    mst.ptr = mst.buffer;
+    mst.status = MTOS_MASTER_IDLE;
+    mst.last_status = mst.status;
+    mst.state_ts = esp_timer_get_time();
+    mst.state_enter_ts = MTOS_TRACE_NOW();
+    inst->reactor_th = xTaskGetCurrentTaskHandle();
+    inst->role = MTOS_TRACE_TASK_SLAVE;
+    mtos_slave_start(inst,&slv);
+    MTOS_EVT_POST(inst,MTOS_EVENT_MASTER_IDLE,NULL,0);
+    for(;;) {
+        if (mst.busy) {
+            inst->role = MTOS_TRACE_TASK_MASTER;
+            bool progress;
+            if (mst.push) {
+                // fase de chunks de un put: el slave remoto pide los chunks y la maquina slave los envia
+                progress = mtos_slave_step(inst,&slv);
+                if (!slv.push || (MILLIS(inst->master_to) > mst.call.timeout_ms)) {
+                    // la maquina master cierra la llamada, un timeout lo informa en su proximo paso
+                    mst.status = (slv.pushed ? MTOS_MASTER_ENDING : MTOS_MASTER_ABORT);
+                    mst.push = false;
+                    progress = true;
+                }
+            }
+            else {
+                progress = mtos_master_step(inst,&mst);
+                if (mst.push) {
+                    mtos_slave_push(inst,&slv,mst.node,mst.call.max_chunk_size,mst.framed);
+                }
+            }
+            if (!mst.busy) {
+                inst->role = MTOS_TRACE_TASK_SLAVE;
+                mtos_slave_start(inst,&slv);
+            }
+            else if (!progress) {
+                vTaskDelay(MTOS_REACTOR_TICKS);
+            }
+        }
+        else {
+            inst->role = MTOS_TRACE_TASK_SLAVE;
+            bool progress = mtos_slave_step(inst,&slv);
+            if (slv.put) {
+                // el master remoto envia un bloque, la maquina master recibe los chunks
+                inst->role = MTOS_TRACE_TASK_MASTER;
+                mtos_master_accept(inst,&mst,&slv);
+            }
+            // una llamada despierta al reactor enseguida, sin esperar al proximo paso
+            else if (xQueueReceive(inst->call_queue,&mst.call,((progress || inst->repl_more) ? 0 : MTOS_REACTOR_TICKS)) == pdTRUE) {
+                // porque no puede recibir un bloque mientras esta enviando otro
+                mtos_slave_stop(inst,&slv);
+                inst->role = MTOS_TRACE_TASK_MASTER;
+                mtos_master_begin(inst,&mst);
+            }
+#if CONFIG_MTOS_REPLICATE
+            else if (inst->repl_more && mtos_repl_next(inst,&mst.call)) {
+                // las partes siguientes de una replicacion no ocupan la cola, se intercalan con las llamadas
+                mtos_slave_stop(inst,&slv);
+                inst->role = MTOS_TRACE_TASK_MASTER;
+                mtos_master_begin(inst,&mst);
+            }
+#endif
+        }
+    }
+}
 
 static void mtos_cb_handler_intern(void* handler_args, esp_event_base_t base, int32_t id, void* event_data)
 {
-    if (mtos_usr_cb) {
-        mtos_usr_cb(id,event_data,handler_args);
+    mtos_instance_t* inst = (mtos_instance_t*)handler_args;
+    if (inst->usr_cb) {
+        inst->usr_cb(id,event_data,inst->usr_data);
     }
 }
 
-void mtos_init(mtos_event_handler_t evt_callback, void* usr_data) {
-    mtos_usr_cb = evt_callback;
-    esp_event_loop_args_t mtos_loop_args = {
-        .queue_size = CONFIG_MTOS_EVT_QUEUE_SIZE,
-        .task_name = "mtos_evt_task", // task will be created
-        .task_priority = uxTaskPriorityGet(NULL),
-        .task_stack_size = 4096,
-        .task_core_id = tskNO_AFFINITY
-    };
-    ESP_ERROR_CHECK(esp_event_loop_create(&mtos_loop_args, &mtos_loop_handle));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register_with(mtos_loop_handle, MTOS_EVENTS, ESP_EVENT_ANY_ID, mtos_cb_handler_intern, usr_data, NULL)); //puntero a los datos
-
-    mtos_call_queue = xQueueCreate(CONFIG_MTOS_CALL_QUEUE_LENGTH,sizeof(mtos_list_t*));
-    mtos_uart_queue = xQueueCreate(CONFIG_MTOS_CALL_QUEUE_LENGTH,sizeof(mtos_uart_vessel_t));
+#if !CONFIG_IDF_TARGET_LINUX
+static esp_err_t mtos_uart_setup(uart_port_t port, int tx_pin, int rx_pin, int tx_buffer_size)
+{
     uart_config_t uart_config = {
         .baud_rate = CONFIG_MTOS_UART_BAUD_RATE,
         .data_bits = UART_DATA_8_BITS,
@@ -1312,10 +4897,276 @@ void mtos_init(mtos_event_handler_t evt_callback, void* usr_data) {
         .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
         .source_clk = UART_SCLK_APB,
     };
-    ESP_ERROR_CHECK(uart_driver_install(MTOS_PORT, MTOS_BUFFER_EFFECTIVE, 0, 0, NULL, 0));
-    ESP_ERROR_CHECK(uart_param_config(MTOS_PORT, &uart_config));
-    ESP_ERROR_CHECK(uart_set_pin(MTOS_PORT, CONFIG_MTOS_UART_TX_PIN, CONFIG_MTOS_UART_RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
-    
-    xTaskCreate(mtos_master_task, "mtos_mst", 4096, NULL, uxTaskPriorityGet(NULL), NULL);
-    xTaskCreate(mtos_main_uart, "mtos_uart",4096, NULL, uxTaskPriorityGet(NULL), NULL);
-}
\ No newline at end of file
+    esp_err_t err = uart_driver_install(port, MTOS_BUFFER_EFFECTIVE, tx_buffer_size, 0, NULL, 0);
+    if (err == ESP_OK) {
+        err = uart_param_config(port, &uart_config);
+    }
+    if (err == ESP_OK) {
+        err = uart_set_pin(port, tx_pin, rx_pin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    }
+    return err;
+}
+
+static void mtos_uart_install(void)
+{
+    ESP_ERROR_CHECK(mtos_uart_setup(MTOS_PORT, CONFIG_MTOS_UART_TX_PIN, CONFIG_MTOS_UART_RX_PIN, 0));
+#if CONFIG_MTOS_UART_RS485
+    // el driver maneja el enable del transceptor con RTS mientras transmite
+    ESP_ERROR_CHECK(uart_set_pin(MTOS_PORT, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, CONFIG_MTOS_UART_RTS_PIN, UART_PIN_NO_CHANGE));
+    ESP_ERROR_CHECK(uart_set_mode(MTOS_PORT, UART_MODE_RS485_HALF_DUPLEX));
+#endif
+}
+
+int mtos_uart_link(int port, int tx_pin, int rx_pin, mtos_transport_t* link)
+{
+    // con buffer de transmision la escritura no espera a que salga el ultimo byte,
+    // asi las tramas de un enlace agregado se transmiten en paralelo
+    if (mtos_uart_setup((uart_port_t)port, tx_pin, rx_pin, MTOS_BUFFER_EFFECTIVE) != ESP_OK) {
+        return -1;
+    }
+    link->write = mtos_uart_write;
+    link->read = mtos_uart_read;
+    link->buffered = mtos_uart_buffered;
+    link->ctx = (void*)(intptr_t)port;
+    return 0;
+}
+#endif
+
+int mtos_instance_set_address(mtos_instance_t* inst, uint8_t address)
+{
+#if CONFIG_MTOS_BUS
+    if (address == 0) {
+        return -1;
+    }
+    if (inst == NULL) {
+        inst = &mtos_default;
+    }
+    inst->address = address;
+    for (mtos_list_t* node = inst->list_head; node != NULL; node = node->next) {
+        if (node->slave) {
+            mtos_node_address(node,address);
+        }
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int mtos_set_address(uint8_t address)
+{
+    return mtos_instance_set_address(NULL,address);
+}
+
+int mtos_set_remote(char* name, uint8_t address)
+{
+    mtos_list_t* node = mtos_lookup(name);
+    if (node == NULL) {
+        return -1;
+    }
+    if (node->slave) {
+        return -2;
+    }
+#if CONFIG_MTOS_BUS
+    if (address == 0) {
+        return -3;
+    }
+    mtos_take(node,portMAX_DELAY);
+    mtos_node_address(node,address);
+    mtos_give(node);
+    return 0;
+#else
+    return -3;
+#endif
+}
+
+void mtos_set_transport(const mtos_transport_t* transport)
+{
+    mtos_default.transport = *transport;
+    mtos_default.transport_custom = true;
+}
+
+int mtos_bonded_transport(const mtos_transport_t* links, size_t count, mtos_transport_t* transport)
+{
+#if CONFIG_MTOS_BOND
+    if ((count == 0) || (count > CONFIG_MTOS_BOND_MAX_LINKS)) {
+        return -1;
+    }
+#if CONFIG_MTOS_STATIC
+    if (mtos_bond_pool_used >= 1+CONFIG_MTOS_STATIC_INSTANCES) {
+        return -2;
+    }
+    mtos_bond_t* bond = &mtos_bond_pool[mtos_bond_pool_used];
+    mtos_bond_storage_t* storage = &mtos_bond_storage[mtos_bond_pool_used];
+    for (size_t i = 0; i < count; i++) {
+        bond->links[i].link = links[i];
+        bond->links[i].rx = storage->rx[i];
+    }
+    bond->out = storage->out;
+    bond->frame = storage->frame;
+    bond->tx_lock = xSemaphoreCreateMutexStatic(&storage->tx_lock);
+    mtos_bond_pool_used++;
+#else
+    mtos_bond_t* bond = (mtos_bond_t*)calloc(1,sizeof(mtos_bond_t));
+    if (bond == NULL) {
+        return -2;
+    }
+    for (size_t i = 0; i < count; i++) {
+        bond->links[i].link = links[i];
+        bond->links[i].rx = (uint8_t*)malloc(MTOS_BOND_RX_SIZE);
+        if (bond->links[i].rx == NULL) {
+            while (i--) {
+                free(bond->links[i].rx);
+            }
+            free(bond);
+            return -2;
+        }
+    }
+    bond->out = (uint8_t*)malloc(MTOS_BOND_OUT_SIZE);
+    bond->frame = (uint8_t*)malloc(MTOS_BOND_PAYLOAD_MAX+MTOS_BOND_OVERHEAD);
+    bond->tx_lock = xSemaphoreCreateMutex();
+    if (!bond->out || !bond->frame || !bond->tx_lock) {
+        for (size_t i = 0; i < count; i++) {
+            free(bond->links[i].rx);
+        }
+        free(bond->out);
+        free(bond->frame);
+        if (bond->tx_lock) {
+            vSemaphoreDelete(bond->tx_lock);
+        }
+        free(bond);
+        return -2;
+    }
+#endif
+    bond->count = count;
+    bond->peer_mask = 0xFF;
+    transport->write = mtos_bond_write;
+    transport->read = mtos_bond_read;
+    transport->buffered = mtos_bond_buffered;
+    transport->ctx = bond;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int mtos_set_bonded_transport(const mtos_transport_t* links, size_t count)
+{
+#if CONFIG_MTOS_BOND
+    if (mtos_default.transport_custom && (mtos_default.transport.write == mtos_bond_write)) {
+        return -1;
+    }
+#endif
+    mtos_transport_t transport;
+    int result = mtos_bonded_transport(links,count,&transport);
+    if (result == 0) {
+        mtos_set_transport(&transport);
+    }
+    return result;
+}
+
+// crea el loop de eventos, las colas y las tareas de la instancia
+static esp_err_t mtos_instance_start(mtos_instance_t* inst, mtos_event_handler_t evt_callback, void* usr_data)
+{
+    inst->usr_cb = evt_callback;
+    inst->usr_data = usr_data;
+#if CONFIG_MTOS_BOND
+    if (inst->transport.write == mtos_bond_write) {
+        // los eventos de los enlaces van a la instancia que usa el transporte
+        ((mtos_bond_t*)inst->transport.ctx)->inst = inst;
+    }
+#endif
+    esp_event_loop_args_t mtos_loop_args = {
+        .queue_size = CONFIG_MTOS_EVT_QUEUE_SIZE,
+        .task_name = "mtos_evt_task", // task will be created
+        .task_priority = uxTaskPriorityGet(NULL),
+        .task_stack_size = 4096,
+        .task_core_id = tskNO_AFFINITY
+    };
+    esp_err_t err = esp_event_loop_create(&mtos_loop_args, &inst->loop_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = esp_event_handler_instance_register_with(inst->loop_handle, MTOS_EVENTS, ESP_EVENT_ANY_ID, mtos_cb_handler_intern, inst, NULL);
+
+#if CONFIG_MTOS_STATIC
+    inst->call_queue = xQueueCreateStatic(CONFIG_MTOS_CALL_QUEUE_LENGTH,sizeof(mtos_call_t),
+        inst->storage->call_queue_items,&inst->storage->call_queue);
+#else
+    inst->call_queue = xQueueCreate(CONFIG_MTOS_CALL_QUEUE_LENGTH,sizeof(mtos_call_t));
+#endif
+    if ((err == ESP_OK) && !inst->call_queue) {
+        err = ESP_ERR_NO_MEM;
+    }
+#if CONFIG_MTOS_STATIC
+    if ((err == ESP_OK) && (xTaskCreateStatic(mtos_reactor_task, "mtos_reactor", MTOS_REACTOR_STACK, inst, uxTaskPriorityGet(NULL),
+        inst->storage->reactor_stack, &inst->storage->reactor_tcb) == NULL)) {
+        err = ESP_ERR_NO_MEM;
+    }
+#else
+    if ((err == ESP_OK) && (xTaskCreate(mtos_reactor_task, "mtos_reactor", MTOS_REACTOR_STACK, inst, uxTaskPriorityGet(NULL), NULL) != pdPASS)) {
+        err = ESP_ERR_NO_MEM;
+    }
+#endif
+    if (err != ESP_OK) {
+        if (inst->call_queue) {
+            vQueueDelete(inst->call_queue);
+        }
+        esp_event_loop_delete(inst->loop_handle);
+    }
+    return err;
+}
+
+mtos_instance_t* mtos_instance_create(const mtos_transport_t* transport, mtos_event_handler_t evt_callback, void* usr_data)
+{
+#if CONFIG_MTOS_STATIC
+    if (mtos_instance_pool_used >= CONFIG_MTOS_STATIC_INSTANCES) {
+        return NULL;
+    }
+    mtos_instance_t* inst = &mtos_instance_pool[mtos_instance_pool_used];
+    memset(inst,0,sizeof(mtos_instance_t));
+    inst->storage = &mtos_storage[1+mtos_instance_pool_used];
+#else
+    mtos_instance_t* inst = (mtos_instance_t*)calloc(1,sizeof(mtos_instance_t));
+    if (inst == NULL) {
+        return NULL;
+    }
+#endif
+    inst->transport = *transport;
+    inst->transport_custom = true;
+    inst->slave_timeout = CONFIG_MTOS_DEFAULT_TIMEOUT;
+#if CONFIG_MTOS_BUS
+    inst->address = CONFIG_MTOS_BUS_ADDRESS;
+#endif
+    if (mtos_instance_start(inst,evt_callback,usr_data) != ESP_OK) {
+#if !CONFIG_MTOS_STATIC
+        free(inst);
+#endif
+        return NULL;
+    }
+#if CONFIG_MTOS_STATIC
+    mtos_instance_pool_used++;
+#endif
+    // se agrega al final, las busquedas por nombre recorren la cadena sin tomar ningun semaforo
+    mtos_instance_t* last = mtos_instances;
+    while (last->next != NULL) {
+        last = last->next;
+    }
+    last->next = inst;
+    return inst;
+}
+
+void mtos_init(mtos_event_handler_t evt_callback, void* usr_data) {
+    if (!mtos_default.transport_custom) {
+#if !CONFIG_IDF_TARGET_LINUX
+        mtos_uart_install();
+#else
+        ESP_LOGE(TAG,"no transport set, call mtos_set_transport before mtos_init");
+        abort();
+#endif
+    }
+#if CONFIG_MTOS_STATIC
+    mtos_default.storage = &mtos_storage[0];
+#endif
+    ESP_ERROR_CHECK(mtos_instance_start(&mtos_default,evt_callback,usr_data));
+}
@@ -1,7 +1,13 @@
+#pragma once
+
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "typedefs.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
  * @brief Initialize the MTOS module.
  *
@@ -13,6 +19,124 @@
  */
 void mtos_init(mtos_event_handler_t evt_callback, void* usr_data);
 
+/**
+ * @brief Creates an independent MTOS instance on its own transport.
+ *
+ * Each instance has its own block registry, reactor task, call queue, event loop and timeouts, so a
+ * device can serve several remote peers at the same time. mtos_init sets up the default instance, on the UART
+ * configured in menuconfig. Blocks are created in an instance with mtos_instance_new_blob and the related functions.
+ * Block names are unique across all instances, so every function that takes a name works on any instance.
+ * mtos_uart_link describes an additional UART port as a transport.
+ *
+ * @param transport    Pointer to the transport of the instance, it is copied.
+ * @param evt_callback Pointer to the event handler callback function of the instance.
+ * @param usr_data     Pointer to the user data to be passed to the event handler.
+ * @return The new instance, or NULL on allocation failure.
+ */
+mtos_instance_t* mtos_instance_create(const mtos_transport_t* transport, mtos_event_handler_t evt_callback, void* usr_data);
+
+/**
+ * @brief Replaces the UART driver as the medium used to exchange bytes with the remote device.
+ *
+ * This function must be called before mtos_init. When a transport is set, mtos_init does not install the UART driver.
+ * It is mandatory on the linux target, where there is no UART driver.
+ *
+ * @param transport Pointer to the transport description, it is copied.
+ */
+void mtos_set_transport(const mtos_transport_t* transport);
+
+/**
+ * @brief Uses several links at once as the medium to exchange bytes with the remote device.
+ *
+ * This function must be called before mtos_init and is an alternative to mtos_set_transport. Writes are split
+ * into numbered frames with a CRC16 and striped across the links, the receiver puts them back in order.
+ * Each frame reports the links its sender is receiving correctly, so a link with errors in one direction
+ * stops being used in that direction. MTOS_EVENT_LINK_DOWN and MTOS_EVENT_LINK_UP report the link index.
+ * Both devices must bond the same number of links, wired in the same order. This sets the bond of the default
+ * instance, mtos_bonded_transport makes one for an instance created with mtos_instance_create. Requires CONFIG_MTOS_BOND.
+ *
+ * @param links Array of transports, one per link, it is copied.
+ * @param count Number of links, up to CONFIG_MTOS_BOND_MAX_LINKS.
+ * @return 0 on success, -1 if count is invalid, the default instance already has a bond or bonding is disabled,
+ *         -2 on allocation failure.
+ */
+int mtos_set_bonded_transport(const mtos_transport_t* links, size_t count);
+
+/**
+ * @brief Bonds several links into one transport, for mtos_instance_create or mtos_set_transport.
+ *
+ * Same bond as mtos_set_bonded_transport, with its own frame numbering and link state. MTOS_EVENT_LINK_DOWN and
+ * MTOS_EVENT_LINK_UP go to the instance that uses the transport, so each bond serves a single instance.
+ * With CONFIG_MTOS_STATIC there is room for one bond per instance. Requires CONFIG_MTOS_BOND.
+ *
+ * @param links     Array of transports, one per link, it is copied.
+ * @param count     Number of links, up to CONFIG_MTOS_BOND_MAX_LINKS.
+ * @param transport Transport filled on success.
+ * @return 0 on success, -1 if count is invalid or bonding is disabled, -2 on allocation failure.
+ */
+int mtos_bonded_transport(const mtos_transport_t* links, size_t count, mtos_transport_t* transport);
+
+#if !CONFIG_IDF_TARGET_LINUX
+/**
+ * @brief Installs the UART driver on an additional port and describes it as a transport.
+ *
+ * Intended for mtos_set_bonded_transport, mtos_bonded_transport and mtos_instance_create. The driver is installed with a TX buffer, so writes to different
+ * links go out in parallel. When a bond is set mtos_init installs no driver, so every bonded port,
+ * including the one configured in menuconfig, is installed with this function.
+ *
+ * @param port   UART port number.
+ * @param tx_pin GPIO used for TX.
+ * @param rx_pin GPIO used for RX.
+ * @param link   Transport filled on success.
+ * @return 0 on success, -1 if the driver could not be installed.
+ */
+int mtos_uart_link(int port, int tx_pin, int rx_pin, mtos_transport_t* link);
+#endif
+
+/**
+ * @brief Sets the bus address answered by the slave blocks of this device.
+ *
+ * With CONFIG_MTOS_BUS every trigger and pattern is sent followed by the address of the slave that serves the
+ * block, so several slaves can share one bus. A slave ignores the frames addressed to other devices. Slave
+ * blocks created before and after the call use the new address. The default is CONFIG_MTOS_BUS_ADDRESS.
+ *
+ * @param address Address of this device, 1 to 255.
+ * @return 0 on success, -1 if the address is 0 or bus addressing is disabled.
+ */
+int mtos_set_address(uint8_t address);
+
+/**
+ * @brief Sets the bus address answered by the slave blocks of an instance.
+ *
+ * Same as mtos_set_address, which uses the default instance. NULL also selects the default instance.
+ */
+int mtos_instance_set_address(mtos_instance_t* inst, uint8_t address);
+
+/**
+ * @brief Sets the directory of the persistent block cache.
+ *
+ * With CONFIG_MTOS_CACHE every master block is saved as <path>/<name>.mtc each time a call changes it, and is
+ * restored from that file when the block is created again. Local changes made with the other functions are not
+ * saved until the next call that updates the block. Must be called before the master blocks are created.
+ * The default is CONFIG_MTOS_CACHE_PATH.
+ *
+ * @param path Directory on a mounted filesystem, up to 63 characters.
+ * @return 0 on success, -1 if the path is too long or the cache is disabled.
+ */
+int mtos_set_cache_path(const char* path);
+
+/**
+ * @brief Sets the bus address of the slave that serves a master memory block.
+ *
+ * Master blocks call address 1 until this function is used. Waits for a call in progress on the block to end.
+ *
+ * @param name    The name of the memory block (up to 16 characters).
+ * @param address Address of the remote slave, 1 to 255.
+ * @return 0 on success, -1 if the memory block is not found, -2 if the memory block is a slave, or -3 if the
+ *         address is 0 or bus addressing is disabled.
+ */
+int mtos_set_remote(char* name, uint8_t address);
+
 /**
  * @brief Creates a new blob in the MTOS list.
  *
@@ -31,6 +155,85 @@ void mtos_init(mtos_event_handler_t evt_callback, void* usr_data);
  */
 int mtos_new_blob(char name[16], size_t length, uint8_t slave, char trigger[8], char pattern[8]);
 
+/**
+ * @brief Creates a new blob in the registry of an instance.
+ *
+ * Same as mtos_new_blob, which uses the default instance. NULL also selects the default instance.
+ */
+int mtos_instance_new_blob(mtos_instance_t* inst, char name[16], size_t length, uint8_t slave, char trigger[8], char pattern[8]);
+
+/**
+ * @brief Creates a new segmented blob in the MTOS list.
+ *
+ * Same as mtos_new_blob, but the blob is stored as a list of CONFIG_MTOS_SEGMENT_SIZE byte segments. Appending and
+ * resizing only allocate or free tail segments, and the slave serves chunks straight from the segments. The blob is
+ * accessed with mtos_append, mtos_read_at and mtos_write_at; mtos_grab_mb and the string and memory operations need
+ * a contiguous block and fail until mtos_flatten is called. With CONFIG_MTOS_SEGMENTS disabled a contiguous blob is
+ * created instead.
+ *
+ * @param name     The name of the blob (up to 16 characters).
+ * @param length   The initial length of the blob.
+ * @param slave    The slave identifier.
+ * @param trigger  The trigger value (up to 8 characters).
+ * @param pattern  The pattern value (up to 8 characters).
+ *
+ * @return  0 for success.
+ *         -1 if node allocation fails.
+ *         -2 if segment allocation fails.
+ *         -3 if the name already exists in the list.
+ */
+int mtos_new_segmented_blob(char name[16], size_t length, uint8_t slave, char trigger[8], char pattern[8]);
+
+/**
+ * @brief Creates a new segmented blob in the registry of an instance.
+ *
+ * Same as mtos_new_segmented_blob, which uses the default instance. NULL also selects the default instance.
+ */
+int mtos_instance_new_segmented_blob(mtos_instance_t* inst, char name[16], size_t length, uint8_t slave, char trigger[8], char pattern[8]);
+
+/**
+ * @brief Creates a new blob on a buffer owned by the application.
+ *
+ * Same as mtos_new_blob, but the blob lives in buffer instead of the heap, and its initial content is the content of
+ * the buffer. The blob starts with a length of capacity bytes. mtos_resize, mtos_append and the string operations
+ * can shorten it or grow it back, but never beyond capacity. A master call to a remote block larger than capacity
+ * ends with MTOS_EVENT_MASTER_ALLOC_ERROR. The buffer must outlive the blob and is only accessed under its semaphore.
+ *
+ * @param name     The name of the blob (up to 16 characters).
+ * @param buffer   Storage of the blob, at least capacity bytes.
+ * @param capacity Size of buffer in bytes.
+ * @param slave    The slave identifier.
+ * @param trigger  The trigger value (up to 8 characters).
+ * @param pattern  The pattern value (up to 8 characters).
+ *
+ * @return  0 for success.
+ *         -1 if node allocation fails.
+ *         -2 if buffer is NULL or capacity is 0.
+ *         -3 if the name already exists in the list.
+ */
+int mtos_new_static_blob(char name[16], void* buffer, size_t capacity, uint8_t slave, char trigger[8], char pattern[8]);
+
+/**
+ * @brief Creates a new blob on a buffer owned by the application, in the registry of an instance.
+ *
+ * Same as mtos_new_static_blob, which uses the default instance. NULL also selects the default instance.
+ */
+int mtos_instance_new_static_blob(mtos_instance_t* inst, char name[16], void* buffer, size_t capacity, uint8_t slave, char trigger[8], char pattern[8]);
+
+/**
+ * @brief Turns a segmented blob into a contiguous one.
+ *
+ * The segments are copied into a single allocation and freed. Afterwards the blob behaves as one created with
+ * mtos_new_blob. Does nothing on blocks that are already contiguous.
+ *
+ * @param name     The name of the blob (up to 16 characters).
+ *
+ * @return  0 for success.
+ *         -1 if the memory block with the specified name does not exist.
+ *         -2 if the contiguous allocation fails, the blob stays segmented.
+ */
+int mtos_flatten(char name[16]);
+
 /**
  * @brief Creates a new array in the MTOS list.
  *
@@ -50,10 +253,48 @@ int mtos_new_blob(char name[16], size_t length, uint8_t slave, char trigger[8],
  */
 int mtos_new_array(char name[16], size_t n, size_t size, uint8_t slave, char trigger[8], char pattern[8]);
 
+/**
+ * @brief Creates a new array in the registry of an instance.
+ *
+ * Same as mtos_new_array, which uses the default instance. NULL also selects the default instance.
+ */
+int mtos_instance_new_array(mtos_instance_t* inst, char name[16], size_t n, size_t size, uint8_t slave, char trigger[8], char pattern[8]);
+
+/**
+ * @brief Creates a new array on a buffer owned by the application.
+ *
+ * Same as mtos_new_array, but the elements live in buffer, which usually is a static array of the application, and
+ * keep its content instead of starting at zero. The array never grows beyond n elements. The buffer must outlive the
+ * array and is only accessed under its semaphore.
+ *
+ * @param name     The name of the array (up to 16 characters).
+ * @param buffer   Storage of the array, at least n*size bytes.
+ * @param n        The number of elements in the array.
+ * @param size     The size of each element in the array.
+ * @param slave    The slave identifier.
+ * @param trigger  The trigger value (up to 8 characters).
+ * @param pattern  The pattern value (up to 8 characters).
+ *
+ * @return  0 for success.
+ *         -1 if node allocation fails.
+ *         -2 if buffer is NULL or the array is empty.
+ *         -3 if the name already exists in the list.
+ */
+int mtos_new_static_array(char name[16], void* buffer, size_t n, size_t size, uint8_t slave, char trigger[8], char pattern[8]);
+
+/**
+ * @brief Creates a new array on a buffer owned by the application, in the registry of an instance.
+ *
+ * Same as mtos_new_static_array, which uses the default instance. NULL also selects the default instance.
+ */
+int mtos_instance_new_static_array(mtos_instance_t* inst, char name[16], void* buffer, size_t n, size_t size, uint8_t slave, char trigger[8], char pattern[8]);
+
 /**
  * @brief Grabs a memory block from the MTOS list.
  *
  * This function grabs a memory block from the MTOS list with the specified name.
+ * With CONFIG_MTOS_SLAVE_SNAPSHOT, grabbing a slave block while its chunks are being sent first copies the block,
+ * and the returned pointer refers to the copy. The peer receives the contents the block had when the call began.
  *
  * @param name     The name of the memory block to grab (up to 16 characters).
  * @param ticks    The maximum amount of time to wait for the memory block to become available.
@@ -63,9 +304,28 @@ int mtos_new_array(char name[16], size_t n, size_t size, uint8_t slave, char tri
  * @return  0 for success.
  *         -1 if the memory block with the specified name does not exist.
  *         -2 if failed to acquire the semaphore within the given time limit.
+ *         -3 if the block is a segmented blob, which has no contiguous view until mtos_flatten is called.
  */
 int mtos_grab_mb(char name[16], TickType_t ticks, void** ptr, size_t* length);
 
+/**
+ * @brief Grabs a memory block only for reading.
+ *
+ * Same as mtos_grab_mb, but the block must not be modified and is given back with mtos_release_mb. A slave block
+ * whose chunks are being sent is not copied, the pointer refers to the buffer the peer is receiving.
+ *
+ * @param name     The name of the memory block to grab (up to 16 characters).
+ * @param ticks    The maximum amount of time to wait for the memory block to become available.
+ * @param ptr      Pointer to store the grabbed memory block.
+ * @param length   Pointer to store the length of the grabbed memory block.
+ *
+ * @return  0 for success.
+ *         -1 if the memory block with the specified name does not exist.
+ *         -2 if failed to acquire the semaphore within the given time limit.
+ *         -3 if the block is a segmented blob, which has no contiguous view until mtos_flatten is called.
+ */
+int mtos_grab_mb_ro(char name[16], TickType_t ticks, const void** ptr, size_t* length);
+
 /**
  * @brief Returns a memory block to the MTOS list.
  *
@@ -79,6 +339,36 @@ int mtos_grab_mb(char name[16], TickType_t ticks, void** ptr, size_t* length);
  */
 int mtos_return_mb(char name[16]);
 
+/**
+ * @brief Returns a memory block to the MTOS list, declaring the only bytes that were modified.
+ *
+ * Same as mtos_return_mb, but a block replicated with mtos_replicate only sends the declared range to the slave instead of the whole block.
+ *
+ * @param name     The name of the memory block to return (up to 16 characters).
+ * @param offset   Offset of the first modified byte.
+ * @param n        Number of modified bytes.
+ *
+ * @return  0 for success.
+ *         -1 if the memory block with the specified name does not exist.
+ *         -2 if failed to release the semaphore.
+ *         -3 if the range falls outside the block, which is returned anyway as modified entirely.
+ */
+int mtos_return_mb_range(char name[16], size_t offset, size_t n);
+
+/**
+ * @brief Releases a memory block grabbed only for reading.
+ *
+ * Same as mtos_return_mb but the checksum is not recomputed, so the block must not have been modified. It gives back
+ * blocks taken with mtos_grab_mb_ro.
+ *
+ * @param name     The name of the memory block to release (up to 16 characters).
+ *
+ * @return  0 for success.
+ *         -1 if the memory block with the specified name does not exist.
+ *         -2 if failed to release the semaphore.
+ */
+int mtos_release_mb(char name[16]);
+
 /**
  * @brief Resizes a memory block in the MTOS list.
  *
@@ -89,19 +379,64 @@ int mtos_return_mb(char name[16]);
  *
  * @return  0 for success.
  *         -1 if the memory block with the specified name does not exist.
- *         -2 if memory reallocation fails.
+ *         -2 if memory reallocation fails, or n exceeds the buffer of a static blob.
  */
 int mtos_resize(char name[16], size_t n);
 
+/**
+ * @brief Appends bytes at the end of a memory block, growing it by n.
+ *
+ * A segmented blob only allocates the tail segments it needs. The CRC32 of the block is computed when it is next
+ * served, so an append costs only the bytes appended.
+ *
+ * @param name     The name of the memory block (up to 16 characters).
+ * @param src      Pointer to the bytes to append.
+ * @param n        Number of bytes to append.
+ *
+ * @return  0 for success.
+ *         -1 if the memory block with the specified name does not exist.
+ *         -2 if memory allocation fails or the buffer of a static blob is full, the block is left unchanged.
+ */
+int mtos_append(char name[16], const void* src, size_t n);
+
+/**
+ * @brief Copies n bytes starting at offset out of a memory block.
+ *
+ * @param name     The name of the memory block (up to 16 characters).
+ * @param dst      Destination buffer, at least n bytes.
+ * @param offset   Offset of the first byte in the block.
+ * @param n        Number of bytes to copy.
+ *
+ * @return  0 for success.
+ *         -1 if the memory block with the specified name does not exist.
+ *         -3 if the range falls outside the block.
+ */
+int mtos_read_at(char name[16], void* dst, size_t offset, size_t n);
+
+/**
+ * @brief Copies n bytes into a memory block starting at offset.
+ *
+ * @param name     The name of the memory block (up to 16 characters).
+ * @param src      Source buffer, at least n bytes.
+ * @param offset   Offset of the first byte in the block.
+ * @param n        Number of bytes to copy.
+ *
+ * @return  0 for success.
+ *         -1 if the memory block with the specified name does not exist.
+ *         -3 if the range falls outside the block, use mtos_append or mtos_resize to grow it.
+ */
+int mtos_write_at(char name[16], const void* src, size_t offset, size_t n);
+
 /**
  * @brief Concatenates a string to the memory block identified by the given name.
  *
  * This function concatenates the string pointed to by 'src' to the memory block identified by the specified name.
+ * The copy starts at the cached string length, so appending costs only the length of 'src'.
  *
  * @param name The name of the memory block (up to 16 characters).
  * @param src  Pointer to the source string.
  *
- * @return Pointer to the resulting string in the memory block.
+ * @return Pointer to the resulting string in the memory block, or NULL if the result and its terminator do not fit in the block.
  */
 char* mtos_strcat(char name[16], const char* src);
 
@@ -145,6 +480,8 @@ char* mtos_strcpy(char name[16], const char* src);
  * @brief Calculates the length of the string in the memory block identified by the given name.
  *
  * This function calculates the length of the string in the memory block identified by the specified name.
+ * The length is cached per block and only measured again (never past the block length) after the block is
+ * modified through mtos_grab_mb/mtos_return_mb, a transfer or a memory operation.
  *
  * @param name The name of the memory block (up to 16 characters).
  *
@@ -161,7 +498,7 @@ size_t mtos_strlen(char name[16]);
  * @param src  Pointer to the source string.
  * @param n    Maximum number of characters to concatenate.
  *
- * @return Pointer to the resulting string in the memory block.
+ * @return Pointer to the resulting string in the memory block, or NULL if the result and its terminator do not fit in the block.
  */
 char* mtos_strncat(char name[16], const char* src, size_t n);
 
@@ -315,15 +652,377 @@ int mtos_borrow_element(char name[16], void* element, size_t index);
  */
 int mtos_return_element(char name[16], void* element, size_t index);
 
+/**
+ * @brief Copies a range of elements of an array into a buffer, taking the semaphore once.
+ *
+ * @param name  The name of the memory block (up to 16 characters).
+ * @param dst   Buffer with room for count elements.
+ * @param first The index of the first element.
+ * @param count The number of elements to copy.
+ *
+ * @return 0 on success, -1 if the memory block is not found, -2 if the memory block is a blob, or -3 if the range is out of bounds.
+ */
+int mtos_borrow_elements(char name[16], void* dst, size_t first, size_t count);
+
+/**
+ * @brief Writes a range of elements of an array from a buffer, taking the semaphore and updating the checksum once.
+ *
+ * @param name  The name of the memory block (up to 16 characters).
+ * @param src   Buffer holding count elements.
+ * @param first The index of the first element.
+ * @param count The number of elements to write.
+ *
+ * @return 0 on success, -1 if the memory block is not found, -2 if the memory block is a blob, or -3 if the range is out of bounds.
+ */
+int mtos_return_elements(char name[16], const void* src, size_t first, size_t count);
+
+/**
+ * @brief Copies every stride-th element of an array, starting at first, into a contiguous buffer.
+ *
+ * @param name   The name of the memory block (up to 16 characters).
+ * @param dst    Buffer with room for count elements.
+ * @param first  The index of the first element.
+ * @param count  The number of elements to copy.
+ * @param stride Distance in elements between two consecutive copied elements (1 for a contiguous range).
+ *
+ * @return 0 on success, -1 if the memory block is not found, -2 if the memory block is a blob, or -3 if the range is out of bounds or stride is 0.
+ */
+int mtos_gather_elements(char name[16], void* dst, size_t first, size_t count, size_t stride);
+
+/**
+ * @brief Writes count contiguous elements from a buffer into every stride-th element of an array, starting at first.
+ *
+ * @param name   The name of the memory block (up to 16 characters).
+ * @param src    Buffer holding count elements.
+ * @param first  The index of the first element.
+ * @param count  The number of elements to write.
+ * @param stride Distance in elements between two consecutive written elements (1 for a contiguous range).
+ *
+ * @return 0 on success, -1 if the memory block is not found, -2 if the memory block is a blob, or -3 if the range is out of bounds or stride is 0.
+ */
+int mtos_scatter_elements(char name[16], const void* src, size_t first, size_t count, size_t stride);
+
+/**
+ * @brief Calls cb for each element of a range of an array, in place and under a single semaphore acquisition.
+ *
+ * The callback receives a pointer to the element inside the block and returns a combination of MTOS_EACH_MODIFIED, if it changed the element, and MTOS_EACH_STOP, to end the iteration. The checksum is updated once at the end if any element was modified. While the slave is sending the block, the callback gets a copy of the element, so a read-only pass does not copy the block. The callback must not keep the pointer or call other MToS functions on the same block.
+ *
+ * @param name      The name of the memory block (up to 16 characters).
+ * @param first     The index of the first element.
+ * @param count     The number of elements to visit.
+ * @param cb        Callback invoked for each element.
+ * @param user_data Pointer passed to the callback.
+ *
+ * @return The number of elements visited, -1 if the memory block is not found, -2 if the memory block is a blob, -3 if the range is out of bounds, or -4 if the slave is sending the block and there is no memory to copy it for a modification, which is then discarded.
+ */
+int mtos_for_each_element(char name[16], size_t first, size_t count, mtos_element_cb_t cb, void* user_data);
+
 /**
  * @brief Initiates a call to the memory block identified by the given name.
  *
  * This function initiates a call to the memory block identified by the specified name. The function puts the memory block in the call queue, sets the UART timeout limit, and determines the maximum chunk size for data transmission.
  *
+ * With CONFIG_MTOS_CONDITIONAL the trigger carries the CRC32 and length of the local copy. If the slave's block is the same, no chunks are sent and the call ends with MTOS_EVENT_MASTER_UNCHANGED instead of MTOS_EVENT_MASTER_UPDATED.
+ * MTOS_EVENT_MASTER_UNCHANGED is also posted when a transfer leaves the local copy as it was.
+ * Requests that get no answer are resent after a timeout derived from the measured round trip, doubled on every attempt.
+ * After CONFIG_MTOS_MAX_RETRIES resends in a row without an answer the call ends with MTOS_EVENT_MASTER_TIMEOUT before timeout_ms.
+ *
  * @param name            The name of the memory block (up to 16 characters).
  * @param timeout_ms      The timeout value in milliseconds for the UART communication.
  * @param max_chunk_size  The maximum size of each data chunk for transmission.
  *
  * @return 0 if the call is successfully initiated, -1 if the memory block is not found, or -2 if the memory block is a slave.
  */
-int mtos_call(char* name, unsigned int timeout_ms, unsigned int max_chunk_size);
\ No newline at end of file
+int mtos_call(char* name, unsigned int timeout_ms, unsigned int max_chunk_size);
+
+/**
+ * @brief Initiates a call that fetches only a slice of the remote memory block.
+ *
+ * Only bytes [offset, offset+length) are transferred, the slave trims the slice to the size of its block. When the call finishes the slice is copied over the local copy under the block semaphore, and the local copy takes the length of the remote block if they differ.
+ *
+ * @param name            The name of the memory block (up to 16 characters).
+ * @param offset          The first byte to fetch.
+ * @param length          The number of bytes to fetch.
+ * @param timeout_ms      The timeout value in milliseconds for the UART communication.
+ * @param max_chunk_size  The maximum size of each data chunk for transmission.
+ *
+ * @return 0 if the call is successfully initiated, -1 if the memory block is not found, -2 if the memory block is a slave, or -3 if the length is 0 or offset/length exceed 24 bits.
+ */
+int mtos_call_range(char* name, size_t offset, size_t length, unsigned int timeout_ms, unsigned int max_chunk_size);
+
+/**
+ * @brief Initiates a call that fetches only a range of elements of a remote array.
+ *
+ * @param name            The name of the memory block (up to 16 characters).
+ * @param first           The index of the first element to fetch.
+ * @param count           The number of elements to fetch.
+ * @param timeout_ms      The timeout value in milliseconds for the UART communication.
+ * @param max_chunk_size  The maximum size of each data chunk for transmission.
+ *
+ * @return 0 if the call is successfully initiated, -1 if the memory block is not found, -2 if the memory block is a slave, -3 if the range is empty or too large, or -4 if the memory block is not an array.
+ */
+int mtos_call_elements(char* name, size_t first, size_t count, unsigned int timeout_ms, unsigned int max_chunk_size);
+
+/**
+ * @brief Sends the local copy of a memory block to the slave, replacing the slave's block.
+ *
+ * The trigger announces the CRC32 and length of the local copy. A slave built with CONFIG_MTOS_PUT reserves a buffer for it and then requests the chunks, so the whole put takes one session. Chunks are checked with CRC32 and resent as in a call. When the last chunk arrives the slave swaps the new contents into its block under the block semaphore and posts MTOS_EVENT_SLAVE_WRITTEN.
+ * The master posts MTOS_EVENT_MASTER_PUT when the slave has confirmed the last chunk, MTOS_EVENT_MASTER_UNCHANGED if the slave already had the same contents, or MTOS_EVENT_MASTER_PUT_REFUSED if the slave does not accept puts, cannot reserve the buffer or keeps the block on a buffer of the application that is smaller than the put.
+ * The local block stays locked until the put ends.
+ *
+ * @param name            The name of the memory block (up to 16 characters).
+ * @param timeout_ms      The timeout value in milliseconds for the UART communication.
+ * @param max_chunk_size  The maximum size of each data chunk for transmission.
+ *
+ * @return 0 if the put is successfully initiated, -1 if the memory block is not found, -2 if the memory block is a slave, or -3 if the block is longer than 24 bits can describe.
+ */
+int mtos_put(char* name, unsigned int timeout_ms, unsigned int max_chunk_size);
+
+/**
+ * @brief Replicates every local modification of a memory block to the slave's block, in the background.
+ *
+ * The string functions, mtos_write_at, mtos_append, mtos_resize, the element functions and mtos_return_mb_range record the bytes they modify. The first modification queues one call. When the call leaves the queue it sends everything modified by then, in order: first the new length, then the modified bytes, as remote operations of up to CONFIG_MTOS_REMOTE_OP_MAX bytes. Modifications made meanwhile join the same batch, so a burst of small changes takes few sessions.
+ * Every operation carries a sequence number and the slave refuses one that skips a number. When the slave refuses, when the batch ends with a CRC32 different from the local copy, or when more than half of the block was modified, the whole block is sent with a put instead. A batch that times out is resent whole with the next modification.
+ * MTOS_EVENT_MASTER_REPLICATED is posted when the slave has every modification. Enabling replication starts with a put, which sends no chunks if the slave already has the block. The slave needs CONFIG_MTOS_REMOTE_OPS for the operations and CONFIG_MTOS_PUT for the puts; if it refuses a put, replication is disabled.
+ *
+ * @param name            The name of the memory block (up to 16 characters).
+ * @param enable          true to replicate the block, false to stop.
+ * @param timeout_ms      The timeout value in milliseconds for each session.
+ * @param max_chunk_size  The maximum size of each data chunk of the puts.
+ *
+ * @return 0 on success, -1 if the memory block is not found, -2 if the memory block is a slave, or -3 if the library was built without CONFIG_MTOS_REPLICATE.
+ */
+int mtos_replicate(char* name, bool enable, unsigned int timeout_ms, unsigned int max_chunk_size);
+
+/**
+ * @brief Writes bytes at an offset of the slave's copy of a memory block, without moving the rest of the block.
+ *
+ * Only the operation and its operand travel, inside the trigger. A slave built with CONFIG_MTOS_REMOTE_OPS applies it under the block semaphore, posts MTOS_EVENT_SLAVE_WRITTEN and answers with the CRC32 and length of its block.
+ * The master applies the same operation to the local copy and posts MTOS_EVENT_MASTER_OP if both copies end with the same CRC32, MTOS_EVENT_MASTER_OP_DIVERGED if they do not (call the block to resync it), or MTOS_EVENT_MASTER_OP_REFUSED if the slave does not accept operations or the range falls outside its block.
+ * Operands longer than CONFIG_MTOS_REMOTE_OP_MAX are sent as several operations, each one applied and confirmed separately.
+ *
+ * @param name        The name of the memory block (up to 16 characters).
+ * @param src         Pointer to the bytes to write.
+ * @param offset      Offset in the memory block where the bytes are written.
+ * @param n           Number of bytes to write.
+ * @param timeout_ms  The timeout value in milliseconds for the UART communication.
+ *
+ * @return 0 if the operation is successfully queued, -1 if the memory block is not found, -2 if the memory block is a slave, or -3 if the offset is larger than 24 bits can describe.
+ */
+int mtos_remote_write_at(char name[16], const void* src, size_t offset, size_t n, unsigned int timeout_ms);
+
+/**
+ * @brief Appends bytes to the slave's copy of a memory block, growing it, as mtos_remote_write_at.
+ *
+ * @param name        The name of the memory block (up to 16 characters).
+ * @param src         Pointer to the bytes to append.
+ * @param n           Number of bytes to append.
+ * @param timeout_ms  The timeout value in milliseconds for the UART communication.
+ *
+ * @return 0 if the operation is successfully queued, -1 if the memory block is not found, or -2 if the memory block is a slave.
+ */
+int mtos_remote_append(char name[16], const void* src, size_t n, unsigned int timeout_ms);
+
+/**
+ * @brief Sets the first n bytes of the slave's copy of a memory block to a character, as mtos_remote_write_at.
+ *
+ * @param name        The name of the memory block (up to 16 characters).
+ * @param chr         The character to set.
+ * @param n           Number of bytes to set.
+ * @param timeout_ms  The timeout value in milliseconds for the UART communication.
+ *
+ * @return 0 if the operation is successfully queued, -1 if the memory block is not found, -2 if the memory block is a slave, or -3 if n is 0 or larger than 24 bits can describe.
+ */
+int mtos_remote_memset(char name[16], char const chr, size_t n, unsigned int timeout_ms);
+
+/**
+ * @brief Copies a string into the slave's copy of a memory block, as mtos_remote_write_at.
+ *
+ * Not available on segmented blocks, the slave refuses it.
+ *
+ * @param name        The name of the memory block (up to 16 characters).
+ * @param src         The string to copy.
+ * @param timeout_ms  The timeout value in milliseconds for the UART communication.
+ *
+ * @return 0 if the operation is successfully queued, -1 if the memory block is not found, or -2 if the memory block is a slave.
+ */
+int mtos_remote_strcpy(char name[16], const char* src, unsigned int timeout_ms);
+
+/**
+ * @brief Copies up to n characters of a string into the slave's copy of a memory block, padding with zeros up to n, as mtos_remote_strcpy.
+ *
+ * @param name        The name of the memory block (up to 16 characters).
+ * @param src         The string to copy.
+ * @param n           Number of bytes written in the block.
+ * @param timeout_ms  The timeout value in milliseconds for the UART communication.
+ *
+ * @return 0 if the operation is successfully queued, -1 if the memory block is not found, -2 if the memory block is a slave, or -3 if n is 0 or larger than CONFIG_MTOS_REMOTE_OP_MAX.
+ */
+int mtos_remote_strncpy(char name[16], const char* src, size_t n, unsigned int timeout_ms);
+
+/**
+ * @brief Concatenates a string to the string in the slave's copy of a memory block, as mtos_remote_strcpy.
+ *
+ * @param name        The name of the memory block (up to 16 characters).
+ * @param src         The string to concatenate.
+ * @param timeout_ms  The timeout value in milliseconds for the UART communication.
+ *
+ * @return 0 if the operation is successfully queued, -1 if the memory block is not found, or -2 if the memory block is a slave.
+ */
+int mtos_remote_strcat(char name[16], const char* src, unsigned int timeout_ms);
+
+/**
+ * @brief Writes one element of the slave's copy of an array, as mtos_remote_write_at.
+ *
+ * @param name        The name of the memory block (up to 16 characters).
+ * @param element     Pointer to the element to write.
+ * @param index       Index of the element in the array.
+ * @param timeout_ms  The timeout value in milliseconds for the UART communication.
+ *
+ * @return 0 if the operation is successfully queued, -1 if the memory block is not found, -2 if the memory block is a slave, -3 if the offset of the element (index times the element size) is larger than 24 bits can describe, or -4 if the memory block is not an array.
+ */
+int mtos_remote_return_element(char name[16], const void* element, size_t index, unsigned int timeout_ms);
+
+/**
+ * @brief Computes the minimum, maximum or sum of a typed field over the slave's copy of a memory block, moving only the result.
+ *
+ * A slave built with CONFIG_MTOS_REMOTE_QUERIES scans its block under the block semaphore and answers with the result, so the block itself is never transferred.
+ * The master posts MTOS_EVENT_MASTER_QUERY with a mtos_query_result_t: the value (signed types in value.i, unsigned in value.u, float and double in value.f, sums are 64-bit wide), the index of the first element holding a minimum or maximum and the number of elements scanned.
+ * It posts MTOS_EVENT_MASTER_QUERY_REFUSED if the slave does not accept queries, the field does not fit in an element or the range starts past the end of the block.
+ * In an array the field is read at byte offset field of every element. A blob is read as consecutive values of the type, and field must be 0.
+ *
+ * @param name        The name of the memory block (up to 16 characters).
+ * @param query       MTOS_QUERY_MIN, MTOS_QUERY_MAX or MTOS_QUERY_SUM.
+ * @param type        Type of the field.
+ * @param field       Byte offset of the field inside each element.
+ * @param first       Index of the first element scanned.
+ * @param count       Number of elements scanned, 0 to scan up to the end of the block.
+ * @param timeout_ms  The timeout value in milliseconds for the UART communication.
+ *
+ * @return 0 if the query is successfully queued, -1 if the memory block is not found, -2 if the memory block is a slave, -3 if first, count or field are out of range, or -4 if the query or the type are not valid.
+ */
+int mtos_remote_reduce(char name[16], mtos_query_t query, mtos_elem_type_t type, size_t field, size_t first, size_t count, unsigned int timeout_ms);
+
+/**
+ * @brief Counts the elements of the slave's copy of a memory block whose field matches a byte pattern, as mtos_remote_reduce.
+ *
+ * In an array the pattern is compared at byte offset field of every element. In a blob every byte offset is a candidate position, and field must be 0.
+ * The count arrives in value.u of the mtos_query_result_t.
+ *
+ * @param name        The name of the memory block (up to 16 characters).
+ * @param pattern     The bytes to compare.
+ * @param len         Length of the pattern, up to CONFIG_MTOS_REMOTE_OP_MAX - 3 bytes.
+ * @param field       Byte offset of the field inside each element.
+ * @param first       Index of the first element compared.
+ * @param count       Number of elements compared, 0 to compare up to the end of the block.
+ * @param timeout_ms  The timeout value in milliseconds for the UART communication.
+ *
+ * @return 0 if the query is successfully queued, -1 if the memory block is not found, -2 if the memory block is a slave, -3 if the pattern is too long or first, count or field are out of range, or -4 if the pattern is empty.
+ */
+int mtos_remote_count(char name[16], const void* pattern, size_t len, size_t field, size_t first, size_t count, unsigned int timeout_ms);
+
+/**
+ * @brief Finds the first element of the slave's copy of a memory block whose field matches a byte pattern, as mtos_remote_count.
+ *
+ * The index of the element arrives in index of the mtos_query_result_t, MTOS_QUERY_NONE if no element matches.
+ *
+ * @param name        The name of the memory block (up to 16 characters).
+ * @param pattern     The bytes to compare.
+ * @param len         Length of the pattern, up to CONFIG_MTOS_REMOTE_OP_MAX - 3 bytes.
+ * @param field       Byte offset of the field inside each element.
+ * @param first       Index of the first element compared.
+ * @param count       Number of elements compared, 0 to compare up to the end of the block.
+ * @param timeout_ms  The timeout value in milliseconds for the UART communication.
+ *
+ * @return 0 if the query is successfully queued, -1 if the memory block is not found, -2 if the memory block is a slave, -3 if the pattern is too long or first, count or field are out of range, or -4 if the pattern is empty.
+ */
+int mtos_remote_find(char name[16], const void* pattern, size_t len, size_t field, size_t first, size_t count, unsigned int timeout_ms);
+
+/**
+ * @brief Calls a memory block periodically from a scheduler task.
+ *
+ * The scheduler issues one call at a time, so on a bus only the polled slave transmits. When several blocks are
+ * due, the one that has used the least bus time is called first: an overloaded bus is shared evenly and a large
+ * block does not delay the small ones. A block that falls a full period behind skips the missed polls.
+ * Each poll posts the same events as mtos_call. The task is created on the first call.
+ *
+ * @param name            The name of the memory block (up to 16 characters).
+ * @param period_ms       Time between polls in milliseconds, 0 stops polling the block.
+ * @param timeout_ms      The timeout value in milliseconds for each poll.
+ * @param max_chunk_size  The maximum size of each data chunk for transmission.
+ *
+ * @return 0 on success, -1 if the memory block is not found, -2 if the memory block is a slave, or -3 if the scheduler task could not be created.
+ */
+int mtos_poll(char* name, unsigned int period_ms, unsigned int timeout_ms, unsigned int max_chunk_size);
+
+/**
+ * @brief Keeps the local copy of a remote memory block fresh, refreshing it periodically from the scheduler task.
+ *
+ * Watches share the scheduler of mtos_poll. When a block is due, the watched blocks due within coalesce_ms are
+ * called in the same burst and keep that phase, so watches with similar periods end up refreshed together.
+ * A block whose remote copy did not change costs one short round trip with CONFIG_MTOS_CONDITIONAL, and posts
+ * MTOS_EVENT_MASTER_UNCHANGED: MTOS_EVENT_MASTER_UPDATED means the content changed. When a refresh times out, the
+ * scheduler falls behind or other calls are waiting, the period of the block is doubled, up to max_backoff times,
+ * and it is halved again after each refresh on a free link.
+ *
+ * @param name       The name of the memory block (up to 16 characters).
+ * @param period_ms  Time between refreshes in milliseconds, 0 stops watching the block.
+ * @param options    Timeout, chunk size, back-off and coalescing, NULL or zero fields use the defaults.
+ *
+ * @return 0 on success, -1 if the memory block is not found, -2 if the memory block is a slave, or -3 if the scheduler task could not be created.
+ */
+int mtos_watch(char* name, unsigned int period_ms, const mtos_watch_options_t* options);
+
+/**
+ * @brief Retrieves the transfer statistics of the memory block identified by the given name.
+ *
+ * This function copies the counters accumulated by the memory block identified by the specified name, as master or as slave, into 'stats'. The average RTT and the goodput are derived at the moment of the copy.
+ *
+ * @param name  The name of the memory block (up to 16 characters).
+ * @param stats Pointer to the structure where the statistics will be copied.
+ *
+ * @return 0 for success, -1 if the memory block is not found, or -2 if CONFIG_MTOS_STATS is disabled.
+ */
+int mtos_get_stats(char name[16], mtos_stats_t* stats);
+
+/**
+ * @brief Retrieves the transfer statistics of the serial link.
+ *
+ * This function copies the counters accumulated by every memory block transferred over the link into 'stats'.
+ * With several instances the counters add up the links of all of them.
+ *
+ * @param stats Pointer to the structure where the statistics will be copied.
+ *
+ * @return 0 for success, or -2 if CONFIG_MTOS_STATS is disabled.
+ */
+int mtos_get_link_stats(mtos_stats_t* stats);
+
+/**
+ * @brief Clears the transfer statistics of a memory block or of the serial link.
+ *
+ * @param name The name of the memory block (up to 16 characters), or NULL to clear the link statistics.
+ *
+ * @return 0 for success, -1 if the memory block is not found, or -2 if CONFIG_MTOS_STATS is disabled.
+ */
+int mtos_reset_stats(char name[16]);
+
+/**
+ * @brief Copies the trace buffer into a caller provided memory area.
+ *
+ * This function writes an mtos_trace_header_t, the names of the memory blocks referenced by the records and the recorded mtos_trace_record_t entries, oldest first. If the destination is too small, only the most recent records that fit are copied. The result can be converted to Chrome/Perfetto trace JSON with tools/mtos_trace.py.
+ *
+ * @param dst  Pointer to the destination memory area, or NULL to query the required size.
+ * @param size Size of the destination memory area.
+ *
+ * @return Number of bytes written (or required if 'dst' is NULL), 0 if CONFIG_MTOS_TRACE is disabled or the destination cannot hold the header.
+ */
+size_t mtos_trace_dump(void* dst, size_t size);
+
+/**
+ * @brief Discards every record in the trace buffer.
+ */
+void mtos_trace_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
\ No newline at end of file
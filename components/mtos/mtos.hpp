@@ -0,0 +1,272 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#if __has_include(<span>)
+#include <span>
+#endif
+#include "mtos.h"
+
+// Capa C++ sin costo sobre la API de C: el nombre del bloque se copia una sola vez,
+// el tamaño de los elementos se fija en tiempo de compilacion y los guards exponen
+// el bloque como T* mientras el semaforo esta tomado, sin memcpy por elemento.
+
+namespace mtos {
+
+#if defined(__cpp_lib_span) && __cpp_lib_span >= 202002L
+template <typename T>
+using span = std::span<T>;
+#else
+// sustituto minimo de std::span para compiladores anteriores a C++20
+template <typename T>
+class span {
+public:
+    constexpr span() noexcept : ptr_(nullptr), size_(0) {}
+    constexpr span(T* ptr, std::size_t size) noexcept : ptr_(ptr), size_(size) {}
+    template <std::size_t N>
+    constexpr span(T (&arr)[N]) noexcept : ptr_(arr), size_(N) {}
+    template <typename U, typename = typename std::enable_if<std::is_convertible<U(*)[], T(*)[]>::value>::type>
+    constexpr span(const span<U>& other) noexcept : ptr_(other.data()), size_(other.size()) {}
+
+    constexpr T* data() const noexcept { return ptr_; }
+    constexpr std::size_t size() const noexcept { return size_; }
+    constexpr std::size_t size_bytes() const noexcept { return size_*sizeof(T); }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+    constexpr T& operator[](std::size_t i) const noexcept { return ptr_[i]; }
+    constexpr T* begin() const noexcept { return ptr_; }
+    constexpr T* end() const noexcept { return ptr_+size_; }
+    constexpr span subspan(std::size_t offset, std::size_t count) const noexcept { return span(ptr_+offset,count); }
+
+private:
+    T* ptr_;
+    std::size_t size_;
+};
+#endif
+
+// semaforo del bloque tomado durante la vida del objeto
+// con T const se toma solo para lectura (mtos_grab_mb_ro) y se libera sin recalcular el crc (mtos_release_mb)
+template <typename T>
+class guard {
+public:
+    guard(char* name, TickType_t ticks) noexcept : name_(name), ptr_(nullptr), length_(0)
+    {
+        const void* ptr = nullptr;
+        if (grab(name_,ticks,&ptr,&length_,std::is_const<T>()) == 0) {
+            ptr_ = static_cast<T*>(const_cast<void*>(ptr));
+        }
+        else {
+            length_ = 0;
+        }
+    }
+    guard(guard&& other) noexcept : name_(other.name_), ptr_(other.ptr_), length_(other.length_)
+    {
+        other.ptr_ = nullptr;
+    }
+    guard(const guard&) = delete;
+    guard& operator=(const guard&) = delete;
+    guard& operator=(guard&&) = delete;
+    ~guard() { release(); }
+
+    // devuelve el bloque antes de que termine el scope
+    void release() noexcept
+    {
+        if (ptr_) {
+            if (std::is_const<T>::value) {
+                mtos_release_mb(name_);
+            }
+            else {
+                mtos_return_mb(name_);
+            }
+            ptr_ = nullptr;
+            length_ = 0;
+        }
+    }
+
+    explicit operator bool() const noexcept { return ptr_ != nullptr; }
+    T* data() const noexcept { return ptr_; }
+    std::size_t size() const noexcept { return length_/sizeof(T); }
+    std::size_t size_bytes() const noexcept { return length_; }
+    T& operator[](std::size_t i) const noexcept { return ptr_[i]; }
+    T* begin() const noexcept { return ptr_; }
+    T* end() const noexcept { return ptr_+size(); }
+    span<T> view() const noexcept { return span<T>(ptr_,size()); }
+
+private:
+    static int grab(char* name, TickType_t ticks, const void** ptr, std::size_t* length, std::true_type) noexcept
+    {
+        return mtos_grab_mb_ro(name,ticks,ptr,length);
+    }
+    static int grab(char* name, TickType_t ticks, const void** ptr, std::size_t* length, std::false_type) noexcept
+    {
+        void* mutable_ptr = nullptr;
+        int retval = mtos_grab_mb(name,ticks,&mutable_ptr,length);
+        *ptr = mutable_ptr;
+        return retval;
+    }
+
+    char* name_;
+    T* ptr_;
+    std::size_t length_;
+};
+
+// datos comunes a blobs y arrays: el nombre y las llamadas al equipo remoto
+class block {
+public:
+    explicit block(const char* name) noexcept
+    {
+        std::strncpy(name_,name,sizeof(name_)-1);
+        name_[sizeof(name_)-1] = '\0';
+    }
+
+    const char* name() const noexcept { return name_; }
+    int length() const noexcept { return mtos_get_length(const_cast<char*>(name_)); }
+    int call(unsigned int timeout_ms, unsigned int max_chunk_size = CONFIG_MTOS_BUFFER_SIZE) noexcept
+    {
+        return mtos_call(name_,timeout_ms,max_chunk_size);
+    }
+    int call_range(std::size_t offset, std::size_t length, unsigned int timeout_ms, unsigned int max_chunk_size = CONFIG_MTOS_BUFFER_SIZE) noexcept
+    {
+        return mtos_call_range(name_,offset,length,timeout_ms,max_chunk_size);
+    }
+    int put(unsigned int timeout_ms, unsigned int max_chunk_size = CONFIG_MTOS_BUFFER_SIZE) noexcept
+    {
+        return mtos_put(name_,timeout_ms,max_chunk_size);
+    }
+    int replicate(bool enable, unsigned int timeout_ms, unsigned int max_chunk_size = CONFIG_MTOS_BUFFER_SIZE) noexcept
+    {
+        return mtos_replicate(name_,enable,timeout_ms,max_chunk_size);
+    }
+    int remote_write_at(const void* src, std::size_t offset, std::size_t n, unsigned int timeout_ms) noexcept
+    {
+        return mtos_remote_write_at(name_,src,offset,n,timeout_ms);
+    }
+    int remote_append(const void* src, std::size_t n, unsigned int timeout_ms) noexcept
+    {
+        return mtos_remote_append(name_,src,n,timeout_ms);
+    }
+    int poll(unsigned int period_ms, unsigned int timeout_ms, unsigned int max_chunk_size = CONFIG_MTOS_BUFFER_SIZE) noexcept
+    {
+        return mtos_poll(name_,period_ms,timeout_ms,max_chunk_size);
+    }
+    int watch(unsigned int period_ms, const mtos_watch_options_t* options = nullptr) noexcept
+    {
+        return mtos_watch(name_,period_ms,options);
+    }
+    int set_remote(uint8_t address) noexcept { return mtos_set_remote(name_,address); }
+    int resize(std::size_t n) noexcept { return mtos_resize(name_,n); }
+    int stats(mtos_stats_t& stats) const noexcept { return mtos_get_stats(const_cast<char*>(name_),&stats); }
+    int reset_stats() noexcept { return mtos_reset_stats(name_); }
+
+protected:
+    // los tokens se copian a buffers de 8 bytes, que es lo que lee la API de C: uno de 8 caracteres queda sin terminador
+    // (se copia a mano, strncpy sin lugar para el terminador es un aviso de -Wall)
+    struct tokens {
+        tokens(const char* trigger, const char* pattern) noexcept
+        {
+            copy(trg,trigger);
+            copy(pat,pattern);
+        }
+        static void copy(char (&dst)[8], const char* src) noexcept
+        {
+            for (std::size_t i = 0; (i < sizeof(dst)) && src[i]; i++) {
+                dst[i] = src[i];
+            }
+        }
+        char trg[8] = {};
+        char pat[8] = {};
+    };
+
+    char name_[16];
+};
+
+class blob : public block {
+public:
+    using block::block;
+
+    int create(std::size_t length, bool slave, const char* trigger, const char* pattern,
+               mtos_instance_t* inst = nullptr) noexcept
+    {
+        tokens t(trigger,pattern);
+        return mtos_instance_new_blob(inst,name_,length,slave,t.trg,t.pat);
+    }
+    int create_segmented(std::size_t length, bool slave, const char* trigger, const char* pattern,
+                         mtos_instance_t* inst = nullptr) noexcept
+    {
+        tokens t(trigger,pattern);
+        return mtos_instance_new_segmented_blob(inst,name_,length,slave,t.trg,t.pat);
+    }
+
+    guard<uint8_t> lock(TickType_t ticks = portMAX_DELAY) noexcept { return guard<uint8_t>(name_,ticks); }
+    guard<const uint8_t> read(TickType_t ticks = portMAX_DELAY) noexcept { return guard<const uint8_t>(name_,ticks); }
+
+    char* strcpy(const char* src) noexcept { return mtos_strcpy(name_,src); }
+    char* strcat(const char* src) noexcept { return mtos_strcat(name_,src); }
+    std::size_t strlen() noexcept { return mtos_strlen(name_); }
+    void* memcpy(const void* src, std::size_t n) noexcept { return mtos_memcpy(name_,src,n); }
+
+    int append(const void* src, std::size_t n) noexcept { return mtos_append(name_,src,n); }
+    int read_at(void* dst, std::size_t offset, std::size_t n) noexcept { return mtos_read_at(name_,dst,offset,n); }
+    int write_at(const void* src, std::size_t offset, std::size_t n) noexcept { return mtos_write_at(name_,src,offset,n); }
+    int flatten() noexcept { return mtos_flatten(name_); }
+};
+
+template <typename T>
+class array : public block {
+    static_assert(std::is_trivially_copyable<T>::value, "mtos::array elements are copied as raw bytes");
+
+public:
+    using block::block;
+
+    int create(std::size_t n, bool slave, const char* trigger, const char* pattern,
+               mtos_instance_t* inst = nullptr) noexcept
+    {
+        tokens t(trigger,pattern);
+        return mtos_instance_new_array(inst,name_,n,sizeof(T),slave,t.trg,t.pat);
+    }
+
+    guard<T> lock(TickType_t ticks = portMAX_DELAY) noexcept { return guard<T>(name_,ticks); }
+    guard<const T> read(TickType_t ticks = portMAX_DELAY) noexcept { return guard<const T>(name_,ticks); }
+
+    int size() const noexcept
+    {
+        int length = this->length();
+        return (length < 0 ? length : length/static_cast<int>(sizeof(T)));
+    }
+
+    int get(std::size_t index, T& element) noexcept { return mtos_borrow_elements(name_,&element,index,1); }
+    int set(std::size_t index, const T& element) noexcept { return mtos_return_elements(name_,&element,index,1); }
+    int get(std::size_t first, span<T> dst) noexcept { return mtos_borrow_elements(name_,dst.data(),first,dst.size()); }
+    int set(std::size_t first, span<const T> src) noexcept { return mtos_return_elements(name_,src.data(),first,src.size()); }
+    int gather(std::size_t first, std::size_t stride, span<T> dst) noexcept
+    {
+        return mtos_gather_elements(name_,dst.data(),first,dst.size(),stride);
+    }
+    int scatter(std::size_t first, std::size_t stride, span<const T> src) noexcept
+    {
+        return mtos_scatter_elements(name_,src.data(),first,src.size(),stride);
+    }
+
+    // fn(T& element, size_t index) devuelve una combinacion de MTOS_EACH_MODIFIED y MTOS_EACH_STOP
+    template <typename F>
+    int for_each(std::size_t first, std::size_t count, F&& fn)
+    {
+        return mtos_for_each_element(name_,first,count,&trampoline<typename std::remove_reference<F>::type>,&fn);
+    }
+
+    int call_elements(std::size_t first, std::size_t count, unsigned int timeout_ms, unsigned int max_chunk_size = CONFIG_MTOS_BUFFER_SIZE) noexcept
+    {
+        return mtos_call_elements(name_,first,count,timeout_ms,max_chunk_size);
+    }
+
+private:
+    template <typename F>
+    static int trampoline(void* element, std::size_t index, void* user_data)
+    {
+        return (*static_cast<F*>(user_data))(*static_cast<T*>(element),index);
+    }
+};
+
+} // namespace mtos
@@ -1,3 +1,9 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 typedef enum {
     MTOS_EVENT_ANY = -1,
     MTOS_EVENT_MASTER_CALL,
@@ -13,9 +19,59 @@ typedef enum {
     MTOS_EVENT_SLAVE_RELEASED,
     MTOS_EVENT_SLAVE_FINISHED,
     MTOS_EVENT_SLAVE_TIMEOUT,
-    MTOS_EVENT_SLAVE_ALLOC_ERROR
+    MTOS_EVENT_SLAVE_ALLOC_ERROR,
+    MTOS_EVENT_MASTER_RESUMED,
+    MTOS_EVENT_SLAVE_RESUMED,
+    MTOS_EVENT_LINK_DOWN, // event_data: uint8_t con el indice del enlace agregado
+    MTOS_EVENT_LINK_UP,
+    MTOS_EVENT_MASTER_UNCHANGED, // la copia local ya era la version del slave, no se transfirio el bloque
+    MTOS_EVENT_MASTER_PUT, // el slave recibio completo el bloque enviado con mtos_put
+    MTOS_EVENT_MASTER_PUT_REFUSED, // el slave no acepta puts o no pudo reservar el bloque
+    MTOS_EVENT_SLAVE_WRITTEN, // el master remoto modifico el bloque del slave con un put o una operacion remota
+    MTOS_EVENT_MASTER_OP, // el slave aplico la operacion remota y la copia local quedo con su mismo crc32
+    MTOS_EVENT_MASTER_OP_DIVERGED, // el slave aplico la operacion remota pero la copia local quedo distinta
+    MTOS_EVENT_MASTER_OP_REFUSED, // el slave no acepta operaciones remotas o la operacion no entra en su bloque
+    MTOS_EVENT_MASTER_QUERY, // event_data: mtos_query_result_t con el resultado de la consulta remota
+    MTOS_EVENT_MASTER_QUERY_REFUSED, // el slave no acepta consultas o el campo o el rango no entran en su bloque
+    MTOS_EVENT_MASTER_REPLICATED // el slave tiene todas las modificaciones locales de un bloque replicado
 } mtos_event_id_t;
 
+// consultas que el slave resuelve sobre su bloque, solo viaja el resultado
+typedef enum {
+    MTOS_QUERY_MIN,
+    MTOS_QUERY_MAX,
+    MTOS_QUERY_SUM,
+    MTOS_QUERY_COUNT, // elementos cuyo campo coincide con un patron de bytes
+    MTOS_QUERY_FIND // primer elemento cuyo campo coincide con un patron de bytes
+} mtos_query_t;
+
+// tipo del campo que reducen min, max y sum
+typedef enum {
+    MTOS_TYPE_U8,
+    MTOS_TYPE_I8,
+    MTOS_TYPE_U16,
+    MTOS_TYPE_I16,
+    MTOS_TYPE_U32,
+    MTOS_TYPE_I32,
+    MTOS_TYPE_FLOAT,
+    MTOS_TYPE_DOUBLE
+} mtos_elem_type_t;
+
+#define MTOS_QUERY_NONE UINT32_MAX // index: ningun elemento
+
+typedef struct {
+    char name[16];
+    uint8_t query; // mtos_query_t
+    uint8_t type; // mtos_elem_type_t en min, max y sum
+    uint32_t index; // min/max: primer elemento con ese valor, find: primer elemento que coincide, MTOS_QUERY_NONE si no hay
+    uint32_t count; // elementos recorridos
+    union {
+        int64_t i; // min, max y sum de tipos con signo
+        uint64_t u; // tipos sin signo; count: elementos que coinciden, find: 1 si alguno coincide
+        double f; // float y double
+    } value;
+} mtos_query_result_t;
+
 
 typedef union {
     struct __attribute__((packed)) {
@@ -34,4 +90,116 @@ typedef union {
 } mtos_event_chunk_t;
 
 
+//maquina de estados de recepcion de datos por uart
+typedef enum {
+    MTOS_MASTER_ABORT,
+    MTOS_MASTER_IDLE,
+    MTOS_MASTER_INIT,
+    MTOS_MASTER_CHUNK,
+    MTOS_MASTER_ENDING
+} mtos_master_status_t;
+
+typedef enum {
+    MTOS_SLAVE_ABORT,
+    MTOS_SLAVE_IDLE,
+    MTOS_SLAVE_INIT,
+    MTOS_SLAVE_CHUNK,
+    MTOS_SLAVE_ENDING
+} mtos_slave_status_t;
+
+#define MTOS_MASTER_STATUS_MAX (MTOS_MASTER_ENDING+1)
+#define MTOS_SLAVE_STATUS_MAX (MTOS_SLAVE_ENDING+1)
+
+
+typedef struct {
+    uint32_t calls;
+    uint64_t bytes;
+    uint32_t chunks;
+    uint32_t crc8_errors;
+    uint32_t crc32_errors;
+    uint32_t resends;
+    uint32_t timeouts;
+    uint32_t resumes; // transferencias retomadas desde un offset distinto de cero
+    uint32_t unchanged; // llamadas respondidas sin payload porque el bloque no cambio
+    uint32_t goodput; // bytes/s durante los estados activos (INIT, CHUNK, ENDING)
+    uint32_t rtt_samples;
+    uint32_t rtt_min_us;
+    uint32_t rtt_avg_us;
+    uint32_t rtt_max_us;
+    uint64_t rtt_total_us;
+    uint32_t lock_count;
+    uint64_t lock_wait_us;
+    uint32_t snapshot_copies; // copias del bloque hechas por escrituras locales mientras el slave lo enviaba
+    uint64_t master_state_us[MTOS_MASTER_STATUS_MAX];
+    uint64_t slave_state_us[MTOS_SLAVE_STATUS_MAX];
+} mtos_stats_t;
+
+
+typedef enum {
+    MTOS_TRACE_MASTER_STATE, // value: estado en el que se permanecio durante dur_us
+    MTOS_TRACE_SLAVE_STATE,
+    MTOS_TRACE_FRAME_TX,     // value: bytes enviados
+    MTOS_TRACE_FRAME_RX,     // value: header recibido
+    MTOS_TRACE_CRC8,         // value: 1 verificado, 0 fallido
+    MTOS_TRACE_CRC32,        // value: 1 verificado/calculado, 0 fallido
+    MTOS_TRACE_LOCK_WAIT,    // value: 1 semaforo tomado, 0 tiempo agotado
+    MTOS_TRACE_LOCK_HELD,
+    MTOS_TRACE_UART_POLL,    // value: bytes en el buffer del driver
+    MTOS_TRACE_UART_READ,    // value: bytes entregados a la maquina de estados
+    MTOS_TRACE_TIMEOUT
+} mtos_trace_type_t;
+
+typedef enum {
+    MTOS_TRACE_TASK_APP,
+    MTOS_TRACE_TASK_MASTER,
+    MTOS_TRACE_TASK_SLAVE,
+    MTOS_TRACE_TASK_UART
+} mtos_trace_task_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t ts_us;
+    uint32_t dur_us;
+    uint32_t value;
+    uint8_t type;
+    uint8_t task;
+    uint16_t block; // indice del bloque en la tabla del volcado, 0xFFFF si no aplica
+} mtos_trace_record_t;
+
+// encabezado del volcado, seguido de block_count nombres de 16 bytes y record_count registros
+typedef struct __attribute__((packed)) {
+    char magic[4]; // "MTTR"
+    uint8_t version;
+    uint8_t record_size;
+    uint16_t block_count;
+    uint32_t record_count;
+    uint32_t dropped;
+} mtos_trace_header_t;
+
+
+// medio por el cual se intercambian los bytes con el equipo remoto, por defecto el driver de uart
+typedef struct {
+    int (*write)(void* ctx, const void* src, size_t len); // bytes escritos
+    int (*read)(void* ctx, void* dst, size_t len);        // bytes leidos sin bloquear
+    size_t (*buffered)(void* ctx);                        // bytes disponibles para leer
+    void* ctx;
+} mtos_transport_t;
+
+// enlace independiente con su propio registro de bloques, tareas, colas y transporte
+typedef struct mtos_instance mtos_instance_t;
+
+// opciones de mtos_watch, los campos en cero toman el valor por defecto
+typedef struct {
+    unsigned int timeout_ms; // espera maxima de cada llamada, por defecto CONFIG_MTOS_DEFAULT_TIMEOUT
+    unsigned int max_chunk_size; // por defecto el mayor que admite el buffer
+    unsigned int max_backoff; // multiplo maximo del periodo con el enlace saturado, por defecto 8, 1 no lo espacia
+    unsigned int coalesce_ms; // adelanto permitido para agruparse con otros bloques vigilados, por defecto period_ms/4
+} mtos_watch_options_t;
+
+
+// valor de retorno del callback de mtos_for_each_element
+#define MTOS_EACH_MODIFIED 0x01 // el callback modifico el elemento
+#define MTOS_EACH_STOP 0x02 // no se visitan mas elementos
+
+typedef int (*mtos_element_cb_t)(void* element, size_t index, void* user_data);
+
 typedef void (*mtos_event_handler_t)(mtos_event_id_t event_id, void* event_data, void* user_data);
\ No newline at end of file
@@ -0,0 +1,301 @@
+#!/usr/bin/env python3
+"""End-to-end MToS benchmark against a simulated serial link.
+
+Runs the bench/ application (built for the linux target) as master and slave,
+relaying the bytes between both processes through a link with configurable
+baud rate, latency, jitter and bit error rate. Every combination of block size,
+chunk size, error rate and number of bonded links is measured and the results
+are written as JSON.
+
+    cd bench && idf.py --preview set-target linux && idf.py build && cd ..
+    python3 tools/mtos_bench.py --sizes 1024,65536 --chunks 256,4096 --ber 0,1e-5 -o results.json
+    python3 tools/mtos_bench.py ... --baseline results.json   # compare against a previous run
+    python3 tools/mtos_bench.py --links 1,2,3 --link-ber 0,1e-4   # bonded links, the second one noisy
+    python3 tools/mtos_bench.py --segmented --sizes 0,1000,1024,4096   # segmented blob, empty and segment multiples
+    python3 tools/mtos_bench.py --zero-run --sizes 1024 --chunks 1024   # framed chunk that fills the COBS buffer
+"""
+import argparse
+import heapq
+import itertools
+import json
+import os
+import random
+import selectors
+import socket
+import subprocess
+import sys
+import threading
+import time
+
+DEFAULT_APP = os.path.join(os.path.dirname(__file__), "..", "bench", "build", "mtos_benchmark.elf")
+
+
+class Direction:
+    """Un sentido del enlace: serializa al baud rate, demora, agrega jitter y errores de bit."""
+
+    SLICE = 64  # bytes entregados juntos
+
+    def __init__(self, src, dst, baud, latency, jitter, ber, rng):
+        self.src = src
+        self.dst = dst
+        self.byte_time = 10.0 / baud  # start + 8 bits + stop
+        self.latency = latency
+        self.jitter = jitter
+        self.ber = ber
+        self.rng = rng
+        self.wire_free = 0.0
+        self.last_delivery = 0.0
+        self.pending = []  # (instante de entrega, orden, bytes)
+        self.order = itertools.count()
+        self.bytes = 0
+        self.flipped = 0
+
+    def corrupt(self, data):
+        if not self.ber:
+            return data
+        data = bytearray(data)
+        byte_error = 1.0 - (1.0 - self.ber) ** 8
+        for i in range(len(data)):
+            if self.rng.random() < byte_error:
+                data[i] ^= 1 << self.rng.randrange(8)
+                self.flipped += 1
+        return bytes(data)
+
+    def receive(self, data, now):
+        self.bytes += len(data)
+        # se entrega en porciones, como los bytes que van saliendo de una UART
+        for i in range(0, len(data), self.SLICE):
+            piece = data[i:i + self.SLICE]
+            start = max(now, self.wire_free)
+            self.wire_free = start + len(piece) * self.byte_time
+            delivery = self.wire_free + self.latency + self.rng.uniform(0.0, self.jitter)
+            # el jitter no reordena bytes de un mismo sentido
+            delivery = max(delivery, self.last_delivery)
+            self.last_delivery = delivery
+            heapq.heappush(self.pending, (delivery, next(self.order), self.corrupt(piece)))
+
+    def flush(self, now):
+        while self.pending and self.pending[0][0] <= now:
+            _, _, data = heapq.heappop(self.pending)
+            self.dst.sendall(data)
+
+    def next_deadline(self):
+        return self.pending[0][0] if self.pending else None
+
+
+class Link(threading.Thread):
+    def __init__(self, a, b, baud, latency, jitter, ber, seed):
+        super().__init__(daemon=True)
+        rng = random.Random(seed)
+        self.directions = {a: Direction(a, b, baud, latency, jitter, ber, rng),
+                           b: Direction(b, a, baud, latency, jitter, ber, rng)}
+        self.stopped = threading.Event()
+
+    def run(self):
+        sel = selectors.DefaultSelector()
+        for sock in self.directions:
+            sel.register(sock, selectors.EVENT_READ)
+        while not self.stopped.is_set():
+            now = time.monotonic()
+            deadlines = [d.next_deadline() for d in self.directions.values() if d.next_deadline() is not None]
+            timeout = max(0.0, min(deadlines) - now) if deadlines else 0.05
+            for key, _ in sel.select(min(timeout, 0.05)):
+                try:
+                    data = key.fileobj.recv(65536)
+                except OSError:
+                    data = b""
+                if not data:
+                    sel.unregister(key.fileobj)
+                    continue
+                self.directions[key.fileobj].receive(data, time.monotonic())
+            now = time.monotonic()
+            for direction in self.directions.values():
+                try:
+                    direction.flush(now)
+                except OSError:
+                    pass
+
+    def stop(self):
+        self.stopped.set()
+        self.join()
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    return values[min(len(values) - 1, max(0, int(round(p / 100.0 * len(values) + 0.5)) - 1))]
+
+
+def spawn(app, role, socks, env):
+    fds = [sock.fileno() for sock in socks]
+    env = dict(os.environ, MTOS_BENCH_ROLE=role, MTOS_BENCH_FD=",".join(str(fd) for fd in fds), **env)
+    return subprocess.Popen([app], env=env, pass_fds=fds, stdin=subprocess.PIPE,
+                            stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True)
+
+
+def last_json(text, role):
+    for line in reversed(text.splitlines()):
+        line = line.strip()
+        if line.startswith("{"):
+            try:
+                data = json.loads(line)
+            except ValueError:
+                continue
+            if data.get("role") == role:
+                return data
+    raise RuntimeError("%s produced no result" % role)
+
+
+def run_point(args, size, chunk, ber, links, seed):
+    # un par de sockets por enlace, cada uno con su propio simulador
+    master_app, master_sim, slave_app, slave_sim, sims = [], [], [], [], []
+    for i in range(links):
+        a, b = socket.socketpair()
+        c, d = socket.socketpair()
+        master_app.append(a)
+        master_sim.append(b)
+        slave_app.append(c)
+        slave_sim.append(d)
+        link_ber = args.link_ber[i] if i < len(args.link_ber) else ber
+        sims.append(Link(b, d, args.baud, args.latency_ms / 1000.0, args.jitter_ms / 1000.0, link_ber,
+                         seed + 1000 * i))
+    for link in sims:
+        link.start()
+    env = {"MTOS_BENCH_SIZE": str(size), "MTOS_BENCH_CHUNK": str(chunk),
+           "MTOS_BENCH_CALLS": str(args.calls), "MTOS_BENCH_TIMEOUT_MS": str(args.timeout_ms),
+           "MTOS_BENCH_SEGMENTED": "1" if args.segmented else "0",
+           "MTOS_BENCH_ZERO_RUN": "1" if args.zero_run else "0"}
+    slave = spawn(args.app, "slave", slave_app, env)
+    try:
+        ready = slave.stdout.readline()
+        if "ready" not in ready:
+            raise RuntimeError("slave did not start")
+        master = spawn(args.app, "master", master_app, env)
+        out, _ = master.communicate(timeout=args.calls * (args.timeout_ms / 1000.0 + 2) + 30)
+        master_result = last_json(out, "master")
+        out, _ = slave.communicate("stop\n", timeout=30)
+        slave_result = last_json(out, "slave")
+    finally:
+        for proc in (slave, locals().get("master")):
+            if proc and proc.poll() is None:
+                proc.kill()
+                proc.wait()
+        for link in sims:
+            link.stop()
+        for sock in master_app + master_sim + slave_app + slave_sim:
+            sock.close()
+    latencies = [v for v in master_result["latency_us"] if v is not None]
+    ok_time = sum(latencies) / 1e6
+    return {
+        "size": size,
+        "chunk": chunk,
+        "ber": ber,
+        "links": links,
+        "segmented": args.segmented,
+        "zero_run": args.zero_run,
+        "calls": master_result["calls"],
+        "ok": master_result["ok"],
+        "corrupt": master_result["corrupt"],
+        "goodput_Bps": round(master_result["ok"] * size / ok_time, 1) if ok_time else 0.0,
+        "latency_p50_us": percentile(latencies, 50),
+        "latency_p99_us": percentile(latencies, 99),
+        "retransmissions": master_result["resends"],
+        "crc8_errors": master_result["crc8_errors"] + slave_result["crc8_errors"],
+        "crc32_errors": master_result["crc32_errors"],
+        "timeouts": master_result["timeouts"],
+        "rtt_avg_us": master_result["rtt_avg_us"],
+        "peak_heap_master": master_result["peak_heap"],
+        "peak_heap_slave": slave_result["peak_heap"],
+        "wire_bytes": sum(d.bytes for link in sims for d in link.directions.values()),
+        "flipped_bytes": sum(d.flipped for link in sims for d in link.directions.values()),
+    }
+
+
+def library_version():
+    try:
+        return subprocess.check_output(["git", "describe", "--always", "--dirty"],
+                                       cwd=os.path.dirname(os.path.abspath(__file__)),
+                                       stderr=subprocess.DEVNULL, text=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+def compare(results, baseline_path, tolerance):
+    with open(baseline_path) as f:
+        baseline = json.load(f)
+    key = lambda r: (r["size"], r["chunk"], r["ber"], r.get("links", 1), r.get("segmented", False),
+                     r.get("zero_run", False))
+    old = dict((key(r), r) for r in baseline["results"])
+    regressions = 0
+    for r in results:
+        b = old.get(key(r))
+        if not b:
+            continue
+        checks = [("goodput_Bps", -1), ("latency_p99_us", 1), ("peak_heap_master", 1), ("peak_heap_slave", 1)]
+        for field, sign in checks:
+            if b.get(field) and r.get(field) is not None:
+                change = (r[field] - b[field]) / float(b[field])
+                if change * sign > tolerance:
+                    regressions += 1
+                    sys.stderr.write("regression size=%u chunk=%u ber=%g links=%u %s: %s -> %s (%+.1f%%)\n"
+                                     % (r["size"], r["chunk"], r["ber"], r["links"], field, b[field], r[field],
+                                        100 * change))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--app", default=DEFAULT_APP, help="bench application built for the linux target")
+    parser.add_argument("--sizes", default="1024,16384,262144", help="block sizes in bytes")
+    parser.add_argument("--chunks", default="256,1024,4096", help="max chunk sizes in bytes")
+    parser.add_argument("--ber", default="0,1e-6,1e-5", help="bit error rates")
+    parser.add_argument("--links", default="1", help="number of bonded links, more than one needs CONFIG_MTOS_BOND")
+    parser.add_argument("--link-ber", default="", help="bit error rate of each bonded link, overrides --ber")
+    parser.add_argument("--baud", type=int, default=921600, help="baud rate of each link")
+    parser.add_argument("--latency-ms", type=float, default=0.5)
+    parser.add_argument("--jitter-ms", type=float, default=0.2)
+    parser.add_argument("--segmented", action="store_true",
+                        help="use a segmented blob; sizes of 0 and multiples of CONFIG_MTOS_SEGMENT_SIZE hit the block end")
+    parser.add_argument("--zero-run", action="store_true",
+                        help="payload with a zero byte at offset 58 and non-zero bytes after it; chunks of 313 bytes "
+                             "or more fill the sender's COBS buffer exactly")
+    parser.add_argument("--calls", type=int, default=10, help="calls per combination")
+    parser.add_argument("--timeout-ms", type=int, default=10000)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("-o", "--output", help="results file (default stdout)")
+    parser.add_argument("--baseline", help="previous results to compare against")
+    parser.add_argument("--tolerance", type=float, default=0.1, help="relative change reported as regression")
+    args = parser.parse_args()
+    args.link_ber = [float(v) for v in args.link_ber.split(",") if v]
+
+    results = []
+    points = itertools.product([int(v) for v in args.sizes.split(",")],
+                               [int(v) for v in args.chunks.split(",")],
+                               [float(v) for v in args.ber.split(",")],
+                               [int(v) for v in args.links.split(",")])
+    for i, (size, chunk, ber, links) in enumerate(points):
+        result = run_point(args, size, chunk, ber, links, args.seed + i)
+        sys.stderr.write("size=%u chunk=%u ber=%g links=%u goodput=%.0fB/s p50=%sus p99=%sus resends=%u\n"
+                         % (size, chunk, ber, links, result["goodput_Bps"], result["latency_p50_us"],
+                            result["latency_p99_us"], result["retransmissions"]))
+        results.append(result)
+
+    document = {
+        "library": library_version(),
+        "date": time.strftime("%Y-%m-%dT%H:%M:%S"),
+        "link": {"baud": args.baud, "latency_ms": args.latency_ms, "jitter_ms": args.jitter_ms},
+        "calls": args.calls,
+        "results": results,
+    }
+    out = open(args.output, "w") if args.output else sys.stdout
+    json.dump(document, out, indent=1)
+    out.write("\n")
+    if args.output:
+        out.close()
+    if args.baseline and compare(results, args.baseline, args.tolerance):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,210 @@
+#!/usr/bin/env python3
+"""MToS multi-drop bus benchmark against a simulated shared medium.
+
+Runs the bench/ application (built for the linux target with CONFIG_MTOS_BUS)
+as one master and several slaves on a simulated half duplex bus. Every byte a
+device writes reaches all the other devices, and transmissions that overlap on
+the wire are corrupted, as on RS-485 without arbitration. The master polls one
+block per slave with mtos_poll. For every number of slaves and poll period the
+bus utilisation, collisions and per-slave polls are written as JSON.
+
+    python3 tools/mtos_bus.py --slaves 2,4,8 --sizes 256,4096 --poll-ms 100 -o bus.json
+"""
+import argparse
+import heapq
+import itertools
+import json
+import random
+import selectors
+import socket
+import sys
+import threading
+import time
+
+from mtos_bench import DEFAULT_APP, last_json, library_version, spawn
+
+
+class Bus(threading.Thread):
+    """Medio compartido: serializa al baud rate, entrega a todos menos al emisor y corrompe los solapamientos."""
+
+    SLICE = 64  # bytes entregados juntos
+
+    def __init__(self, socks, baud, latency, ber, seed):
+        super().__init__(daemon=True)
+        self.socks = socks
+        self.byte_time = 10.0 / baud  # start + 8 bits + stop
+        self.latency = latency
+        self.ber = ber
+        self.rng = random.Random(seed)
+        self.tx_free = dict((sock, 0.0) for sock in socks)  # fin de la transmision de cada equipo
+        self.on_wire = []  # (inicio, fin, emisor) de las porciones que pueden solaparse con una nueva
+        self.busy_until = 0.0
+        self.busy_time = 0.0
+        self.pending = []  # (instante de entrega, orden, destino, bytes)
+        self.order = itertools.count()
+        self.bytes = 0
+        self.collisions = 0
+        self.started = time.monotonic()
+        self.stopped = threading.Event()
+
+    def corrupt(self, data, collided):
+        if collided:
+            # dos transmisores a la vez, el receptor ve basura
+            return bytes(self.rng.randrange(256) for _ in data)
+        if not self.ber:
+            return data
+        data = bytearray(data)
+        byte_error = 1.0 - (1.0 - self.ber) ** 8
+        for i in range(len(data)):
+            if self.rng.random() < byte_error:
+                data[i] ^= 1 << self.rng.randrange(8)
+        return bytes(data)
+
+    def transmit(self, src, data, now):
+        self.bytes += len(data)
+        for i in range(0, len(data), self.SLICE):
+            piece = data[i:i + self.SLICE]
+            start = max(now, self.tx_free[src])
+            end = start + len(piece) * self.byte_time
+            self.tx_free[src] = end
+            self.on_wire = [w for w in self.on_wire if w[1] > start - 1.0]
+            collided = any(w[2] is not src and w[0] < end and start < w[1] for w in self.on_wire)
+            if collided:
+                self.collisions += 1
+            self.on_wire.append((start, end, src))
+            self.busy_time += max(0.0, end - max(start, self.busy_until))
+            self.busy_until = max(self.busy_until, end)
+            piece = self.corrupt(piece, collided)
+            for dst in self.socks:
+                if dst is not src:
+                    heapq.heappush(self.pending, (end + self.latency, next(self.order), dst, piece))
+
+    def run(self):
+        sel = selectors.DefaultSelector()
+        for sock in self.socks:
+            sel.register(sock, selectors.EVENT_READ)
+        while not self.stopped.is_set():
+            now = time.monotonic()
+            timeout = max(0.0, self.pending[0][0] - now) if self.pending else 0.05
+            for key, _ in sel.select(min(timeout, 0.05)):
+                try:
+                    data = key.fileobj.recv(65536)
+                except OSError:
+                    data = b""
+                if not data:
+                    sel.unregister(key.fileobj)
+                    continue
+                self.transmit(key.fileobj, data, time.monotonic())
+            now = time.monotonic()
+            while self.pending and self.pending[0][0] <= now:
+                _, _, dst, data = heapq.heappop(self.pending)
+                try:
+                    dst.sendall(data)
+                except OSError:
+                    pass
+
+    def utilisation(self):
+        elapsed = time.monotonic() - self.started
+        return self.busy_time / elapsed if elapsed else 0.0
+
+    def stop(self):
+        self.stopped.set()
+        self.join()
+
+
+def run_point(args, slaves, size, poll_ms, seed):
+    pairs = [socket.socketpair() for _ in range(slaves + 1)]
+    bus = Bus([b for _, b in pairs], args.baud, args.latency_ms / 1000.0, args.ber, seed)
+    bus.start()
+    env = {"MTOS_BENCH_SIZE": str(size), "MTOS_BENCH_CHUNK": str(args.chunk),
+           "MTOS_BENCH_TIMEOUT_MS": str(args.timeout_ms)}
+    procs = []
+    try:
+        for i in range(slaves):
+            slave = spawn(args.app, "slave", [pairs[i + 1][0]], dict(env, MTOS_BENCH_ADDRESS=str(i + 2)))
+            procs.append(slave)
+            if "ready" not in slave.stdout.readline():
+                raise RuntimeError("slave %u did not start" % (i + 2))
+        bus.busy_time, bus.bytes, bus.collisions, bus.started = 0.0, 0, 0, time.monotonic()
+        master = spawn(args.app, "master", [pairs[0][0]],
+                       dict(env, MTOS_BENCH_SLAVES=str(slaves), MTOS_BENCH_POLL_MS=str(poll_ms),
+                            MTOS_BENCH_DURATION_MS=str(args.duration_ms)))
+        procs.append(master)
+        out, _ = master.communicate(timeout=(args.duration_ms + args.timeout_ms) / 1000.0 + 30)
+        result = last_json(out, "master")
+        utilisation = bus.utilisation()
+        for slave in procs[:-1]:
+            slave.communicate("stop\n", timeout=30)
+    finally:
+        for proc in procs:
+            if proc.poll() is None:
+                proc.kill()
+                proc.wait()
+        bus.stop()
+        for a, b in pairs:
+            a.close()
+            b.close()
+    polls = [s["polls"] for s in result["slaves"]]
+    # cada sondeo exitoso mueve el bloque completo de un slave
+    payload = sum((s["polls"] - s["timeouts"]) * size for s in result["slaves"])
+    return {
+        "slaves": slaves,
+        "size": size,
+        "poll_ms": poll_ms,
+        "utilisation": round(utilisation, 3),
+        "efficiency": round(payload / float(bus.bytes), 3) if bus.bytes else 0.0,
+        "collisions": bus.collisions,
+        "wire_bytes": bus.bytes,
+        "polls_min": min(polls),
+        "polls_max": max(polls),
+        "timeouts": sum(s["timeouts"] for s in result["slaves"]),
+        "unchanged": sum(s.get("unchanged", 0) for s in result["slaves"]),
+        "retransmissions": result["resends"],
+        "per_slave": result["slaves"],
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--app", default=DEFAULT_APP, help="bench application built for the linux target")
+    parser.add_argument("--slaves", default="2,4,8", help="number of slaves on the bus")
+    parser.add_argument("--sizes", default="256,4096", help="block size served by each slave")
+    parser.add_argument("--poll-ms", default="100", help="poll period of each block")
+    parser.add_argument("--chunk", type=int, default=1024, help="max chunk size")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--latency-ms", type=float, default=0.1)
+    parser.add_argument("--ber", type=float, default=0.0)
+    parser.add_argument("--duration-ms", type=int, default=10000, help="polling time per combination")
+    parser.add_argument("--timeout-ms", type=int, default=2000)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("-o", "--output", help="results file (default stdout)")
+    args = parser.parse_args()
+
+    results = []
+    points = itertools.product([int(v) for v in args.slaves.split(",")],
+                               [int(v) for v in args.sizes.split(",")],
+                               [int(v) for v in args.poll_ms.split(",")])
+    for i, (slaves, size, poll_ms) in enumerate(points):
+        result = run_point(args, slaves, size, poll_ms, args.seed + i)
+        sys.stderr.write("slaves=%u size=%u poll=%ums utilisation=%.1f%% efficiency=%.1f%% collisions=%u "
+                         "polls=%u..%u timeouts=%u\n"
+                         % (slaves, size, poll_ms, 100 * result["utilisation"], 100 * result["efficiency"],
+                            result["collisions"], result["polls_min"], result["polls_max"], result["timeouts"]))
+        results.append(result)
+
+    document = {
+        "library": library_version(),
+        "date": time.strftime("%Y-%m-%dT%H:%M:%S"),
+        "bus": {"baud": args.baud, "latency_ms": args.latency_ms, "ber": args.ber, "chunk": args.chunk,
+                "duration_ms": args.duration_ms},
+        "results": results,
+    }
+    out = open(args.output, "w") if args.output else sys.stdout
+    json.dump(document, out, indent=1)
+    out.write("\n")
+    if args.output:
+        out.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""Converts MToS trace dumps (mtos_trace_dump) to Chrome/Perfetto trace JSON.
+
+Each dump becomes a process in the timeline, so the dumps of both peers can be
+viewed side by side in chrome://tracing or https://ui.perfetto.dev
+
+    python3 tools/mtos_trace.py master.bin:master slave.bin:slave -o trace.json
+
+Dumps may be raw binary or hex text (as printed by ESP_LOG_BUFFER_HEX).
+"""
+import argparse
+import json
+import re
+import struct
+import sys
+
+HEADER = struct.Struct("<4sBBHII")
+RECORD = struct.Struct("<IIIBBH")
+NAME_SIZE = 16
+
+TYPES = [
+    "master_state", "slave_state", "frame_tx", "frame_rx", "crc8", "crc32",
+    "lock_wait", "lock_held", "uart_poll", "uart_read", "timeout",
+]
+# rows of the reactor task: the state machine it was running, or "uart" while polling the transport
+TASKS = ["app", "master", "slave", "uart"]
+MASTER_STATES = ["ABORT", "IDLE", "INIT", "CHUNK", "ENDING"]
+SLAVE_STATES = ["ABORT", "IDLE", "INIT", "CHUNK", "ENDING"]
+
+
+def load(path):
+    with open(path, "rb") as f:
+        raw = f.read()
+    if not raw.startswith(b"MTTR"):
+        # volcado en texto hexadecimal
+        text = raw.decode("ascii", "ignore")
+        text = re.sub(r"^.*?:", "", text, flags=re.M)  # descarta prefijos de log
+        raw = bytes.fromhex("".join(re.findall(r"[0-9a-fA-F]{2}", text)))
+    magic, version, record_size, block_count, record_count, dropped = HEADER.unpack_from(raw)
+    if magic != b"MTTR" or version != 1 or record_size != RECORD.size:
+        raise ValueError("%s: not an MToS trace dump" % path)
+    offset = HEADER.size
+    names = []
+    for _ in range(block_count):
+        names.append(raw[offset:offset + NAME_SIZE].split(b"\0")[0].decode("ascii", "replace"))
+        offset += NAME_SIZE
+    records = []
+    wrap = 0
+    last = None
+    for _ in range(record_count):
+        ts, dur, value, kind, task, block = RECORD.unpack_from(raw, offset)
+        offset += RECORD.size
+        # los timestamps son los 32 bits bajos de esp_timer_get_time()
+        if last is not None and ts + wrap < last - (1 << 31):
+            wrap += 1 << 32
+        last = ts + wrap
+        records.append((ts + wrap, dur, value, kind, task, block))
+    return names, records, dropped
+
+
+def describe(kind, value):
+    name = TYPES[kind] if kind < len(TYPES) else "type_%u" % kind
+    if kind == 0:
+        return MASTER_STATES[value] if value < len(MASTER_STATES) else name
+    if kind == 1:
+        return SLAVE_STATES[value] if value < len(SLAVE_STATES) else name
+    if kind in (4, 5, 6):
+        return "%s %s" % (name, "ok" if value else "fail")
+    return name
+
+
+def convert(dumps, sync):
+    events = []
+    reference = None
+    for pid, (label, names, records, dropped, shift) in enumerate(dumps, 1):
+        if sync and records:
+            first_rx = next((r for r in records if r[3] == 3), None)
+            first_tx = next((r for r in records if r[3] == 2), None)
+            if reference is None and first_tx:
+                reference = first_tx[0] + first_tx[1] - shift
+            elif reference is not None and first_rx:
+                shift = reference - first_rx[0]
+        events.append({"ph": "M", "pid": pid, "name": "process_name", "args": {"name": label}})
+        for tid, task in enumerate(TASKS):
+            events.append({"ph": "M", "pid": pid, "tid": tid, "name": "thread_name", "args": {"name": task}})
+        for ts, dur, value, kind, task, block in records:
+            event = {
+                "name": describe(kind, value),
+                "cat": TYPES[kind] if kind < len(TYPES) else "unknown",
+                "pid": pid,
+                "tid": task,
+                "ts": ts + shift,
+                "args": {"value": value},
+            }
+            if block < len(names):
+                event["args"]["block"] = names[block]
+            if dur:
+                event["ph"] = "X"
+                event["dur"] = dur
+            else:
+                event["ph"] = "i"
+                event["s"] = "t"
+            events.append(event)
+        if dropped:
+            sys.stderr.write("%s: %u records overwritten before the dump\n" % (label, dropped))
+    return {"traceEvents": events, "displayTimeUnit": "ms"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("dumps", nargs="+", help="dump file, optionally followed by :label")
+    parser.add_argument("-o", "--output", help="output file (default stdout)")
+    parser.add_argument("--offset", action="append", default=[], metavar="LABEL=US",
+                        help="shift the timeline of a dump by the given microseconds")
+    parser.add_argument("--sync", action="store_true",
+                        help="align peers matching the first frame received with the first frame sent by the first dump")
+    args = parser.parse_args()
+    offsets = dict((k, int(v)) for k, v in (o.split("=", 1) for o in args.offset))
+    dumps = []
+    for item in args.dumps:
+        path, _, label = item.partition(":")
+        label = label or path
+        names, records, dropped = load(path)
+        dumps.append((label, names, records, dropped, offsets.get(label, 0)))
+    out = open(args.output, "w") if args.output else sys.stdout
+    json.dump(convert(dumps, args.sync), out)
+    if args.output:
+        out.close()
+
+
+if __name__ == "__main__":
+    main()